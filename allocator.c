@@ -0,0 +1,122 @@
+/**
+ *    Descrição: Bitmap de clusters livres usado na alocação de clusters da FAT
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <stdlib.h>
+#include <string.h>
+#include "allocator.h"
+
+// Cria o bitmap com todos os clusters livres, menos os reservados 0 e 1 e os que passam do max_cluster
+void allocator_init(cluster_allocator_t* allocator, uint32_t max_cluster) {
+	memset(allocator, 0, sizeof(cluster_allocator_t));
+	allocator->max_cluster = max_cluster;
+	allocator->word_count = max_cluster / 64 + 1;
+	allocator->bitmap = (uint64_t*) calloc(allocator->word_count, sizeof(uint64_t));
+
+	allocator->bitmap[0] |= 0x3;
+	uint32_t tail_bits = (max_cluster + 1) % 64;
+	if(tail_bits) allocator->bitmap[allocator->word_count - 1] |= ~0ULL << tail_bits;
+
+	allocator->free_count = max_cluster + 1 - FIRST_DATA_CLUSTER;
+	allocator->next_free = FIRST_DATA_CLUSTER;
+}
+
+void allocator_destroy(cluster_allocator_t* allocator) {
+	free(allocator->bitmap);
+	memset(allocator, 0, sizeof(cluster_allocator_t));
+}
+
+// Retorna 1 se o cluster está em uso (clusters fora da imagem contam como usados)
+int allocator_is_used(cluster_allocator_t* allocator, uint32_t cluster) {
+	if(cluster > allocator->max_cluster) return 1;
+	return (allocator->bitmap[cluster / 64] >> (cluster % 64)) & 1;
+}
+
+// Os bits são trocados com operações atômicas e só quem trocou o bit de fato ajusta free_count,
+// então duas threads marcando o mesmo cluster não contam ele duas vezes
+void allocator_mark_used(cluster_allocator_t* allocator, uint32_t cluster) {
+	if(cluster > allocator->max_cluster) return;
+	uint64_t bit = 1ULL << (cluster % 64);
+	if(!(__atomic_fetch_or(&allocator->bitmap[cluster / 64], bit, __ATOMIC_ACQ_REL) & bit))
+		__atomic_sub_fetch(&allocator->free_count, 1, __ATOMIC_RELEASE);
+}
+
+void allocator_mark_free(cluster_allocator_t* allocator, uint32_t cluster) {
+	if(cluster < FIRST_DATA_CLUSTER || cluster > allocator->max_cluster) return;
+	uint64_t bit = 1ULL << (cluster % 64);
+	if(__atomic_fetch_and(&allocator->bitmap[cluster / 64], ~bit, __ATOMIC_ACQ_REL) & bit)
+		__atomic_add_fetch(&allocator->free_count, 1, __ATOMIC_RELEASE);
+}
+
+// Quantidade de clusters livres, pode ser lida sem nenhuma trava
+uint32_t allocator_free_count(cluster_allocator_t* allocator) {
+	return __atomic_load_n(&allocator->free_count, __ATOMIC_ACQUIRE);
+}
+
+// Procura o primeiro cluster livre a partir de start, dando a volta no fim da imagem
+// Retorna 0 (FREE_CLUSTER) se não existir cluster livre
+uint32_t allocator_find_free(cluster_allocator_t* allocator, uint32_t start) {
+	if(allocator->free_count == 0) return 0;
+	if(start < FIRST_DATA_CLUSTER || start > allocator->max_cluster) start = FIRST_DATA_CLUSTER;
+
+	// Anda uma palavra de 64 clusters por vez, ignorando palavras totalmente ocupadas
+	uint32_t word = start / 64;
+	uint64_t bits = allocator->bitmap[word] | ((1ULL << (start % 64)) - 1);
+	for(uint32_t visited = 0; visited <= allocator->word_count; visited++) {
+		if(bits != ~0ULL) return word * 64 + __builtin_ctzll(~bits);
+		word = (word + 1) % allocator->word_count;
+		bits = allocator->bitmap[word];
+	}
+	return 0;
+}
+
+// Procura a partir de cluster o primeiro bit com o valor pedido (0 livre, 1 usado)
+// Retorna max_cluster + 1 se não encontrar
+static uint32_t scan_bits(cluster_allocator_t* allocator, uint32_t cluster, int used) {
+	uint32_t end = allocator->max_cluster + 1;
+	while(cluster < end) {
+		uint64_t bits = allocator->bitmap[cluster / 64];
+		if(!used) bits = ~bits;
+		bits &= ~0ULL << (cluster % 64);
+		if(bits) {
+			uint32_t found = (cluster & ~63U) + __builtin_ctzll(bits);
+			return found < end ? found : end;
+		}
+		cluster = (cluster & ~63U) + 64;
+	}
+	return end;
+}
+
+// Procura a menor sequência de clusters livres com pelo menos count clusters
+// Se nenhuma for grande o suficiente retorna a maior sequência livre
+// Retorna o primeiro cluster da sequência (0 se o disco estiver cheio) e o tamanho em length
+uint32_t allocator_find_run(cluster_allocator_t* allocator, uint32_t count, uint32_t* length) {
+	uint32_t best_start = 0, best_length = 0;
+	uint32_t largest_start = 0, largest_length = 0;
+
+	uint32_t cluster = scan_bits(allocator, FIRST_DATA_CLUSTER, 0);
+	while(cluster <= allocator->max_cluster) {
+		uint32_t run_end = scan_bits(allocator, cluster, 1);
+		uint32_t run_length = run_end - cluster;
+
+		if(run_length >= count && (best_length == 0 || run_length < best_length)) {
+			best_start = cluster;
+			best_length = run_length;
+			// Não existe encaixe melhor que o exato
+			if(run_length == count) break;
+		}
+		if(run_length > largest_length) {
+			largest_start = cluster;
+			largest_length = run_length;
+		}
+		cluster = scan_bits(allocator, run_end, 0);
+	}
+
+	if(best_length) {
+		*length = best_length;
+		return best_start;
+	}
+	*length = largest_length;
+	return largest_start;
+}
@@ -0,0 +1,41 @@
+/**
+ *    Descrição: Bitmap de clusters livres usado na alocação de clusters da FAT
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stdint.h>
+
+// Primeiro cluster de dados válido
+#define FIRST_DATA_CLUSTER 2
+
+// Sequência de clusters fisicamente contíguos
+typedef struct extent {
+	uint32_t start;
+	uint32_t length;
+} extent_t;
+
+// Estado do alocador, cada bit do bitmap vale 1 se o cluster está em uso
+typedef struct cluster_allocator {
+	uint64_t* bitmap;
+	uint32_t word_count;
+	// Maior cluster válido da imagem
+	uint32_t max_cluster;
+	uint32_t free_count;
+	// Dica de onde começar a procura pelo próximo cluster livre
+	uint32_t next_free;
+} cluster_allocator_t;
+
+void allocator_init(cluster_allocator_t* allocator, uint32_t max_cluster);
+void allocator_destroy(cluster_allocator_t* allocator);
+
+int allocator_is_used(cluster_allocator_t* allocator, uint32_t cluster);
+void allocator_mark_used(cluster_allocator_t* allocator, uint32_t cluster);
+void allocator_mark_free(cluster_allocator_t* allocator, uint32_t cluster);
+uint32_t allocator_free_count(cluster_allocator_t* allocator);
+uint32_t allocator_find_free(cluster_allocator_t* allocator, uint32_t start);
+uint32_t allocator_find_run(cluster_allocator_t* allocator, uint32_t count, uint32_t* length);
+
+#endif
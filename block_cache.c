@@ -0,0 +1,208 @@
+/**
+ *    Descrição: Cache write-back de setores dos metadados (FAT, entradas de diretório, FSINFO)
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <stdlib.h>
+#include <string.h>
+#include "block_cache.h"
+
+static cached_sector_t* find_sector(block_cache_t* cache, uint64_t sector) {
+	cached_sector_t* entry = cache->buckets[sector % BLOCK_CACHE_BUCKETS];
+	while(entry && entry->sector != sector) entry = entry->hash_next;
+	return entry;
+}
+
+// Copia entre o setor e o buffer a parte que se sobrepõe ao intervalo [offset, offset + size)
+// to_sector diz a direção da cópia, RELOAD_FROM_DISK lê a parte do disco (buffer não é usado)
+#define RELOAD_FROM_DISK 2
+static void copy_overlap(block_cache_t* cache, cached_sector_t* entry, uint8_t* buffer, size_t size, uint64_t offset, int to_sector) {
+	uint64_t sector_start = entry->sector * cache->sector_size;
+	uint64_t start = sector_start > offset ? sector_start : offset;
+	uint64_t end = sector_start + cache->sector_size < offset + size ? sector_start + cache->sector_size : offset + size;
+	if(start >= end) return;
+	if(to_sector == RELOAD_FROM_DISK) bdev_read(cache->disk, entry->data + (start - sector_start), end - start, start);
+	else if(to_sector) memcpy(entry->data + (start - sector_start), buffer + (start - offset), end - start);
+	else memcpy(buffer + (start - offset), entry->data + (start - sector_start), end - start);
+}
+
+// Aplica copy_overlap em todos os setores sujos dentro do intervalo
+// Em intervalos grandes percorre os setores sujos em vez de procurar setor por setor
+static void for_each_overlap(block_cache_t* cache, uint8_t* buffer, size_t size, uint64_t offset, int to_sector) {
+	if(cache->dirty_count == 0 || size == 0) return;
+	uint64_t first = offset / cache->sector_size;
+	uint64_t last = (offset + size - 1) / cache->sector_size;
+
+	if(last - first + 1 <= cache->dirty_count) {
+		for(uint64_t sector = first; sector <= last; sector++) {
+			cached_sector_t* entry = find_sector(cache, sector);
+			if(entry) copy_overlap(cache, entry, buffer, size, offset, to_sector);
+		}
+		return;
+	}
+	for(uint32_t i = 0; i < BLOCK_CACHE_BUCKETS; i++)
+		for(cached_sector_t* entry = cache->buckets[i]; entry; entry = entry->hash_next)
+			if(entry->sector >= first && entry->sector <= last) copy_overlap(cache, entry, buffer, size, offset, to_sector);
+}
+
+static void free_sectors(block_cache_t* cache) {
+	for(uint32_t i = 0; i < BLOCK_CACHE_BUCKETS; i++) {
+		cached_sector_t* entry = cache->buckets[i];
+		while(entry) {
+			cached_sector_t* next = entry->hash_next;
+			free(entry->data);
+			free(entry);
+			entry = next;
+		}
+		cache->buckets[i] = NULL;
+	}
+	cache->dirty_count = 0;
+}
+
+static int compare_sectors(const void* a, const void* b) {
+	uint64_t first = (*(cached_sector_t**)a)->sector;
+	uint64_t second = (*(cached_sector_t**)b)->sector;
+	return first < second ? -1 : first > second;
+}
+
+// Operações da cache vista como dispositivo, o dispositivo fica dentro de block_cache_t
+#define CACHE_OF(dev) ((block_cache_t*) ((uint8_t*)(dev) - offsetof(block_cache_t, device)))
+
+static size_t device_read(block_device_t* dev, void* buffer, size_t size, uint64_t offset) {
+	return block_cache_read(CACHE_OF(dev), buffer, size, offset);
+}
+
+static size_t device_write(block_device_t* dev, const void* buffer, size_t size, uint64_t offset) {
+	return block_cache_write(CACHE_OF(dev), buffer, size, offset);
+}
+
+static int device_sync(block_device_t* dev) {
+	return block_cache_flush(CACHE_OF(dev)) ? 0 : -1;
+}
+
+static const block_device_ops_t cache_ops = {
+	"cache", NULL, device_read, device_write, device_sync, NULL
+};
+
+void block_cache_init(block_cache_t* cache, block_device_t* disk, journal_t* journal, uint32_t sector_size, uint64_t threshold) {
+	memset(cache, 0, sizeof(block_cache_t));
+	cache->device.ops = &cache_ops;
+	cache->device.fd = -1;
+	cache->device.size = disk->size;
+	cache->disk = disk;
+	cache->journal = journal;
+	cache->sector_size = sector_size;
+	cache->threshold = threshold;
+}
+
+// Descarta a cache sem gravar (chamar block_cache_flush antes para não perder alterações)
+void block_cache_destroy(block_cache_t* cache) {
+	free_sectors(cache);
+}
+
+// Lê do disco e sobrepõe os setores sujos que ainda não foram gravados
+size_t block_cache_read(block_cache_t* cache, void* buffer, size_t size, uint64_t offset) {
+	size_t read_size = bdev_read(cache->disk, buffer, size, offset);
+	for_each_overlap(cache, buffer, size, offset, 0);
+	return read_size;
+}
+
+// Guarda a escrita nos setores da cache, o disco só é atualizado no flush
+size_t block_cache_write(block_cache_t* cache, const void* buffer, size_t size, uint64_t offset) {
+	if(size == 0) return 0;
+	uint64_t first = offset / cache->sector_size;
+	uint64_t last = (offset + size - 1) / cache->sector_size;
+
+	for(uint64_t sector = first; sector <= last; sector++) {
+		cached_sector_t* entry = find_sector(cache, sector);
+		if(entry == NULL) {
+			entry = (cached_sector_t*) malloc(sizeof(cached_sector_t));
+			entry->sector = sector;
+			entry->data = (uint8_t*) malloc(cache->sector_size);
+			// Setor coberto só em parte precisa do conteúdo atual do disco
+			uint64_t sector_start = sector * cache->sector_size;
+			if(sector_start < offset || sector_start + cache->sector_size > offset + size)
+				bdev_read(cache->disk, entry->data, cache->sector_size, sector_start);
+			entry->hash_next = cache->buckets[sector % BLOCK_CACHE_BUCKETS];
+			cache->buckets[sector % BLOCK_CACHE_BUCKETS] = entry;
+			cache->dirty_count++;
+		}
+		copy_overlap(cache, entry, (uint8_t*)buffer, size, offset, 1);
+	}
+	cache->writes++;
+	return size;
+}
+
+// Retorna 1 quando já existem bytes sujos demais e quem usa a cache deve fazer o flush
+// (o flush fica com quem usa para que ele aconteça entre operações completas)
+int block_cache_over_threshold(block_cache_t* cache) {
+	return (uint64_t)cache->dirty_count * cache->sector_size >= cache->threshold;
+}
+
+// Escreve direto no disco (dados de arquivos), atualizando os setores sujos que se sobrepõem
+// para que o flush não grave por cima com conteúdo antigo
+size_t block_cache_write_direct(block_cache_t* cache, const void* buffer, size_t size, uint64_t offset) {
+	for_each_overlap(cache, (uint8_t*)buffer, size, offset, 1);
+	return bdev_write(cache->disk, buffer, size, offset);
+}
+
+// Atualiza os setores sujos que se sobrepõem ao intervalo depois que ele foi escrito no disco
+// por fora da cache (por exemplo com copy_file_range)
+void block_cache_reload(block_cache_t* cache, uint64_t offset, size_t size) {
+	for_each_overlap(cache, NULL, size, offset, RELOAD_FROM_DISK);
+}
+
+// Grava os setores sujos em ordem de offset, juntando setores vizinhos em uma única escrita
+// Com journal, as escritas são confirmadas nele (um fsync) antes de irem para a imagem
+int block_cache_flush(block_cache_t* cache) {
+	if(cache->dirty_count == 0) return 1;
+
+	cached_sector_t** sorted = (cached_sector_t**) malloc(cache->dirty_count * sizeof(cached_sector_t*));
+	uint32_t count = 0;
+	for(uint32_t i = 0; i < BLOCK_CACHE_BUCKETS; i++)
+		for(cached_sector_t* entry = cache->buckets[i]; entry; entry = entry->hash_next)
+			sorted[count++] = entry;
+	qsort(sorted, count, sizeof(cached_sector_t*), compare_sectors);
+
+	// Copia os setores em ordem para um único buffer e separa as sequências de setores vizinhos
+	uint8_t* staging = (uint8_t*) malloc((uint64_t)count * cache->sector_size);
+	journal_record_t* runs = (journal_record_t*) malloc(count * sizeof(journal_record_t));
+	uint32_t run_count = 0;
+	uint32_t max_run = BLOCK_CACHE_MAX_RUN / cache->sector_size;
+	uint32_t i = 0;
+	while(i < count) {
+		uint32_t run = 1;
+		while(i + run < count && run < max_run && sorted[i + run]->sector == sorted[i]->sector + run) run++;
+		for(uint32_t j = 0; j < run; j++)
+			memcpy(staging + (uint64_t)(i + j) * cache->sector_size, sorted[i + j]->data, cache->sector_size);
+		runs[run_count].offset = sorted[i]->sector * cache->sector_size;
+		runs[run_count].length = run * cache->sector_size;
+		runs[run_count].data = staging + (uint64_t)i * cache->sector_size;
+		run_count++;
+		i += run;
+	}
+	free(sorted);
+
+	// Se o journal não confirmar a transação, as escritas vão para a imagem do mesmo jeito, porque quem chamou o
+	// flush (as threads do fsck, do du, o sendfile do cat) lê direto do disco; só que sem proteção contra uma queda
+	// no meio delas, e o retorno 0 avisa quem chamou
+	int committed = cache->journal == NULL || journal_commit(cache->journal, runs, run_count);
+
+	for(uint32_t r = 0; r < run_count; r++)
+		bdev_write(cache->disk, runs[r].data, runs[r].length, runs[r].offset);
+	cache->device_writes += run_count;
+
+	// O journal só pode ser esvaziado depois que a imagem tiver as escritas; depois de uma falha ele também é
+	// esvaziado, para que uma transação velha que ficou inteira nele não seja refeita por cima das escritas novas
+	if(cache->journal) {
+		bdev_sync(cache->disk);
+		journal_clear(cache->journal);
+	}
+
+	free(runs);
+	free(staging);
+	cache->sectors_flushed += count;
+	cache->flushes++;
+	free_sectors(cache);
+	return committed;
+}
@@ -0,0 +1,57 @@
+/**
+ *    Descrição: Cache write-back de setores dos metadados (FAT, entradas de diretório, FSINFO)
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "block_device.h"
+#include "journal.h"
+
+// Quantidade de bytes sujos a partir da qual a cache deve ser gravada
+#define BLOCK_CACHE_DEFAULT_THRESHOLD (1024 * 1024)
+// Quantidade de listas da tabela hash
+#define BLOCK_CACHE_BUCKETS 4096
+// Maior escrita feita pelo flush ao juntar setores vizinhos
+#define BLOCK_CACHE_MAX_RUN (1024 * 1024)
+
+// Setor modificado que ainda não foi para o disco
+typedef struct cached_sector {
+	uint64_t sector;
+	uint8_t* data;
+	struct cached_sector* hash_next;
+} cached_sector_t;
+
+// Estado da cache
+typedef struct block_cache {
+	// A própria cache vista como dispositivo, para a cache da FAT gravar por ela
+	block_device_t device;
+	block_device_t* disk;
+	// Se existir, cada flush é uma transação confirmada no journal antes de ir para a imagem
+	journal_t* journal;
+	uint32_t sector_size;
+	uint64_t threshold;
+	uint32_t dirty_count;
+	cached_sector_t* buckets[BLOCK_CACHE_BUCKETS];
+
+	// Contadores
+	uint64_t writes;
+	uint64_t flushes;
+	uint64_t sectors_flushed;
+	uint64_t device_writes;
+} block_cache_t;
+
+void block_cache_init(block_cache_t* cache, block_device_t* disk, journal_t* journal, uint32_t sector_size, uint64_t threshold);
+void block_cache_destroy(block_cache_t* cache);
+
+size_t block_cache_read(block_cache_t* cache, void* buffer, size_t size, uint64_t offset);
+size_t block_cache_write(block_cache_t* cache, const void* buffer, size_t size, uint64_t offset);
+size_t block_cache_write_direct(block_cache_t* cache, const void* buffer, size_t size, uint64_t offset);
+void block_cache_reload(block_cache_t* cache, uint64_t offset, size_t size);
+int block_cache_flush(block_cache_t* cache);
+int block_cache_over_threshold(block_cache_t* cache);
+
+#endif
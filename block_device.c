@@ -0,0 +1,214 @@
+/**
+ *    Descrição: Abstração de dispositivo de blocos para acesso à imagem (pread/pwrite ou mmap)
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include "block_device.h"
+
+// ----------------------------- Backend pread ------------------------------ //
+
+// Não precisa de estado além do descritor
+static int pread_open(block_device_t* dev) {
+	return 1;
+}
+
+// Lê com pread repetindo enquanto a leitura vier incompleta
+static size_t pread_read(block_device_t* dev, void* buffer, size_t size, uint64_t offset) {
+	size_t done = 0;
+	while(done < size) {
+		ssize_t n = pread(dev->fd, (uint8_t*)buffer + done, size - done, offset + done);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) break;
+		done += n;
+	}
+	return done;
+}
+
+// Escreve com pwrite repetindo enquanto a escrita vier incompleta
+static size_t pread_write(block_device_t* dev, const void* buffer, size_t size, uint64_t offset) {
+	size_t done = 0;
+	while(done < size) {
+		ssize_t n = pwrite(dev->fd, (const uint8_t*)buffer + done, size - done, offset + done);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) break;
+		done += n;
+	}
+	return done;
+}
+
+static int pread_sync(block_device_t* dev) {
+	return fsync(dev->fd) == 0;
+}
+
+static void pread_close(block_device_t* dev) {
+}
+
+static const block_device_ops_t pread_ops = {
+	"pread", pread_open, pread_read, pread_write, pread_sync, pread_close
+};
+
+// ------------------------------ Backend mmap ------------------------------ //
+
+// Mapeia a imagem inteira como compartilhada, as escritas vão direto para o arquivo
+static int mmap_open(block_device_t* dev) {
+	if(dev->size == 0) return 0;
+	void* map = mmap(NULL, dev->size, PROT_READ | PROT_WRITE, MAP_SHARED, dev->fd, 0);
+	if(map == MAP_FAILED) return 0;
+	dev->map = (uint8_t*) map;
+	return 1;
+}
+
+// Corta o tamanho para não passar do fim da imagem
+static size_t clamp_size(block_device_t* dev, size_t size, uint64_t offset) {
+	if(offset >= dev->size) return 0;
+	return offset + size > dev->size ? dev->size - offset : size;
+}
+
+static size_t mmap_read(block_device_t* dev, void* buffer, size_t size, uint64_t offset) {
+	size = clamp_size(dev, size, offset);
+	memcpy(buffer, dev->map + offset, size);
+	return size;
+}
+
+static size_t mmap_write(block_device_t* dev, const void* buffer, size_t size, uint64_t offset) {
+	size = clamp_size(dev, size, offset);
+	memcpy(dev->map + offset, buffer, size);
+	return size;
+}
+
+static int mmap_sync(block_device_t* dev) {
+	return msync(dev->map, dev->size, MS_SYNC) == 0;
+}
+
+static void mmap_close(block_device_t* dev) {
+	munmap(dev->map, dev->size);
+	dev->map = NULL;
+}
+
+static const block_device_ops_t mmap_ops = {
+	"mmap", mmap_open, mmap_read, mmap_write, mmap_sync, mmap_close
+};
+
+// ------------------------------------------------------------------------ //
+
+// Tabela de backends indexada por BDEV_*
+static const block_device_ops_t* backends[] = { &pread_ops, &mmap_ops };
+
+// Converte o nome do backend no seu número, retorna -1 se não existir
+int bdev_backend_from_name(const char* name) {
+	for(int i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+		if(!strcmp(name, backends[i]->name)) return i;
+	return -1;
+}
+
+// Abre a imagem com o backend escolhido, retorna NULL se não conseguir
+block_device_t* bdev_open(const char* path, int backend) {
+	if(backend < 0 || backend >= sizeof(backends) / sizeof(backends[0])) return NULL;
+
+	int fd = open(path, O_RDWR);
+	if(fd < 0) return NULL;
+
+	struct stat st;
+	if(fstat(fd, &st) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	block_device_t* dev = (block_device_t*) calloc(1, sizeof(block_device_t));
+	dev->ops = backends[backend];
+	dev->fd = fd;
+	dev->size = st.st_size;
+
+	if(!dev->ops->open(dev)) {
+		close(fd);
+		free(dev);
+		return NULL;
+	}
+	return dev;
+}
+
+// Fecha o backend e o descritor
+void bdev_close(block_device_t* dev) {
+	dev->ops->close(dev);
+	close(dev->fd);
+	free(dev);
+}
+
+// Lê size bytes a partir do offset, retorna quantos bytes foram lidos
+size_t bdev_read(block_device_t* dev, void* buffer, size_t size, uint64_t offset) {
+	return dev->ops->read(dev, buffer, size, offset);
+}
+
+// Escreve size bytes a partir do offset, retorna quantos bytes foram escritos
+size_t bdev_write(block_device_t* dev, const void* buffer, size_t size, uint64_t offset) {
+	return dev->ops->write(dev, buffer, size, offset);
+}
+
+// Garante que as escritas chegaram ao disco
+int bdev_sync(block_device_t* dev) {
+	return dev->ops->sync(dev);
+}
+
+// Retorna ponteiro direto para a região (sem cópia) se o backend permitir, senão NULL
+const uint8_t* bdev_map(block_device_t* dev, uint64_t offset, size_t size) {
+	if(dev->map == NULL || offset + size > dev->size) return NULL;
+	return dev->map + offset;
+}
+
+// Bloco usado quando os dados precisam passar por um buffer
+#define BDEV_SEND_CHUNK (1024 * 1024)
+
+// Escreve todo o buffer no descritor, retorna 0 se der erro
+static int write_all(int out_fd, const uint8_t* buffer, size_t size) {
+	while(size) {
+		ssize_t n = write(out_fd, buffer, size);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return 0;
+		buffer += n;
+		size -= n;
+	}
+	return 1;
+}
+
+// Copia size bytes da imagem a partir do offset para o descritor out_fd, retorna quantos bytes foram enviados
+// Para pipes e arquivos usa sendfile (os dados não passam pelo processo), senão escreve do
+// mapeamento (backend mmap) ou de um buffer lido em blocos grandes
+size_t bdev_send(block_device_t* dev, int out_fd, uint64_t offset, size_t size) {
+	size_t done = 0;
+
+	struct stat st;
+	if(fstat(out_fd, &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISREG(st.st_mode))) {
+		off_t position = offset;
+		int unsupported = 0;
+		while(done < size) {
+			ssize_t n = sendfile(out_fd, dev->fd, &position, size - done);
+			if(n < 0 && errno == EINTR) continue;
+			// EINVAL/ENOSYS: o kernel não suporta esse par de descritores, continua pelo caminho com buffer
+			if(n < 0 && done == 0 && (errno == EINVAL || errno == ENOSYS)) unsupported = 1;
+			if(n <= 0) break;
+			done += n;
+		}
+		if(!unsupported) return done;
+	}
+
+	const uint8_t* map = bdev_map(dev, offset + done, size - done);
+	if(map) return write_all(out_fd, map, size - done) ? size : done;
+
+	uint8_t* buffer = (uint8_t*) malloc(BDEV_SEND_CHUNK);
+	while(done < size) {
+		size_t chunk = size - done < BDEV_SEND_CHUNK ? size - done : BDEV_SEND_CHUNK;
+		size_t read_size = bdev_read(dev, buffer, chunk, offset + done);
+		if(read_size == 0 || !write_all(out_fd, buffer, read_size)) break;
+		done += read_size;
+	}
+	free(buffer);
+	return done;
+}
@@ -0,0 +1,48 @@
+/**
+ *    Descrição: Abstração de dispositivo de blocos para acesso à imagem (pread/pwrite ou mmap)
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#ifndef BLOCK_DEVICE_H
+#define BLOCK_DEVICE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Backends disponíveis
+#define BDEV_PREAD 0
+#define BDEV_MMAP 1
+
+struct block_device;
+
+// Operações que cada backend implementa
+typedef struct block_device_ops {
+	const char* name;
+	int (*open)(struct block_device* dev);
+	size_t (*read)(struct block_device* dev, void* buffer, size_t size, uint64_t offset);
+	size_t (*write)(struct block_device* dev, const void* buffer, size_t size, uint64_t offset);
+	int (*sync)(struct block_device* dev);
+	void (*close)(struct block_device* dev);
+} block_device_ops_t;
+
+// Dispositivo aberto
+typedef struct block_device {
+	const block_device_ops_t* ops;
+	int fd;
+	uint64_t size;
+	// Mapeamento da imagem inteira (somente no backend mmap)
+	uint8_t* map;
+} block_device_t;
+
+block_device_t* bdev_open(const char* path, int backend);
+void bdev_close(block_device_t* dev);
+
+int bdev_backend_from_name(const char* name);
+
+size_t bdev_read(block_device_t* dev, void* buffer, size_t size, uint64_t offset);
+size_t bdev_write(block_device_t* dev, const void* buffer, size_t size, uint64_t offset);
+int bdev_sync(block_device_t* dev);
+const uint8_t* bdev_map(block_device_t* dev, uint64_t offset, size_t size);
+size_t bdev_send(block_device_t* dev, int out_fd, uint64_t offset, size_t size);
+
+#endif
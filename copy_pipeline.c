@@ -0,0 +1,162 @@
+/**
+ *    Descrição: Cópia de dados com leitura e escrita sobrepostas (dois buffers e uma thread de leitura)
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "copy_pipeline.h"
+
+// Um dos dois buffers da cópia
+typedef struct copy_buffer {
+	uint8_t* data;
+	size_t size;
+	uint64_t offset;
+	// 1 quando a thread de leitura encheu o buffer e ele ainda não foi escrito
+	int full;
+} copy_buffer_t;
+
+// Estado compartilhado entre a thread de leitura e a de escrita
+typedef struct copy_state {
+	copy_io_t read;
+	void* read_context;
+	uint64_t size;
+	size_t chunk_size;
+	copy_buffer_t buffers[2];
+	// A thread de leitura terminou (fim dos dados ou leitura curta)
+	int reader_done;
+	// Escrita com erro para a thread de leitura
+	int stop;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+} copy_state_t;
+
+// Thread de leitura: enche os buffers alternadamente enquanto a outra thread escreve
+static void* reader_thread(void* argument) {
+	copy_state_t* state = (copy_state_t*) argument;
+	uint64_t offset = 0;
+	for(uint64_t chunk = 0; offset < state->size; chunk++) {
+		copy_buffer_t* buffer = &state->buffers[chunk % 2];
+
+		pthread_mutex_lock(&state->lock);
+		while(buffer->full && !state->stop) pthread_cond_wait(&state->changed, &state->lock);
+		int stop = state->stop;
+		pthread_mutex_unlock(&state->lock);
+		if(stop) break;
+
+		size_t size = state->size - offset < state->chunk_size ? state->size - offset : state->chunk_size;
+		size_t read_size = state->read(state->read_context, buffer->data, size, offset);
+
+		pthread_mutex_lock(&state->lock);
+		buffer->size = read_size;
+		buffer->offset = offset;
+		buffer->full = read_size > 0;
+		pthread_cond_broadcast(&state->changed);
+		pthread_mutex_unlock(&state->lock);
+
+		if(read_size < size) break;
+		offset += size;
+	}
+
+	pthread_mutex_lock(&state->lock);
+	state->reader_done = 1;
+	pthread_cond_broadcast(&state->changed);
+	pthread_mutex_unlock(&state->lock);
+	return NULL;
+}
+
+// Copia size bytes da origem para o destino em blocos de chunk_size
+// A leitura do próximo bloco acontece enquanto o bloco atual é escrito
+// Retorna a quantidade de bytes escritos (menor que size se alguma das pontas falhar)
+uint64_t copy_pipeline_run(copy_io_t read_io, void* read_context, copy_io_t write_io, void* write_context, uint64_t size, size_t chunk_size) {
+	if(size == 0) return 0;
+
+	copy_state_t state = { 0 };
+	state.read = read_io;
+	state.read_context = read_context;
+	state.size = size;
+	state.chunk_size = chunk_size;
+	for(int i = 0; i < 2; i++) state.buffers[i].data = (uint8_t*) malloc(chunk_size);
+	pthread_mutex_init(&state.lock, NULL);
+	pthread_cond_init(&state.changed, NULL);
+
+	pthread_t reader;
+	pthread_create(&reader, NULL, reader_thread, &state);
+
+	uint64_t written = 0;
+	for(uint64_t chunk = 0; written < size; chunk++) {
+		copy_buffer_t* buffer = &state.buffers[chunk % 2];
+
+		pthread_mutex_lock(&state.lock);
+		while(!buffer->full && !state.reader_done) pthread_cond_wait(&state.changed, &state.lock);
+		int full = buffer->full;
+		pthread_mutex_unlock(&state.lock);
+		if(!full) break;
+
+		size_t write_size = write_io(write_context, buffer->data, buffer->size, buffer->offset);
+		written += write_size;
+
+		pthread_mutex_lock(&state.lock);
+		buffer->full = 0;
+		if(write_size < buffer->size) state.stop = 1;
+		pthread_cond_broadcast(&state.changed);
+		int stop = state.stop;
+		pthread_mutex_unlock(&state.lock);
+		if(stop) break;
+	}
+
+	pthread_mutex_lock(&state.lock);
+	state.stop = 1;
+	pthread_cond_broadcast(&state.changed);
+	pthread_mutex_unlock(&state.lock);
+	pthread_join(reader, NULL);
+
+	for(int i = 0; i < 2; i++) free(state.buffers[i].data);
+	pthread_mutex_destroy(&state.lock);
+	pthread_cond_destroy(&state.changed);
+	return written;
+}
+
+size_t copy_fd_read(void* context, void* buffer, size_t size, uint64_t offset) {
+	int fd = *(int*) context;
+	size_t done = 0;
+	while(done < size) {
+		ssize_t n = pread(fd, (uint8_t*)buffer + done, size - done, offset + done);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) break;
+		done += n;
+	}
+	return done;
+}
+
+size_t copy_fd_write(void* context, void* buffer, size_t size, uint64_t offset) {
+	int fd = *(int*) context;
+	size_t done = 0;
+	while(done < size) {
+		ssize_t n = pwrite(fd, (uint8_t*)buffer + done, size - done, offset + done);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) break;
+		done += n;
+	}
+	return done;
+}
+
+// Copia dentro do kernel com copy_file_range, sem passar os dados pelo processo
+// Retorna a quantidade de bytes copiados, ou -1 se o kernel não suportar a cópia entre esses arquivos
+// (nesse caso nada foi copiado e quem chamou deve usar copy_pipeline_run)
+int64_t copy_range(int in_fd, uint64_t in_offset, int out_fd, uint64_t out_offset, uint64_t size) {
+	uint64_t done = 0;
+	while(done < size) {
+		loff_t in_position = in_offset + done;
+		loff_t out_position = out_offset + done;
+		ssize_t n = copy_file_range(in_fd, &in_position, out_fd, &out_position, size - done, 0);
+		if(n < 0 && errno == EINTR) continue;
+		if(n < 0 && done == 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) return -1;
+		if(n <= 0) break;
+		done += n;
+	}
+	return done;
+}
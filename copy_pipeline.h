@@ -0,0 +1,23 @@
+/**
+ *    Descrição: Cópia de dados com leitura e escrita sobrepostas (dois buffers e uma thread de leitura)
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#ifndef COPY_PIPELINE_H
+#define COPY_PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Lê ou escreve size bytes na posição offset da origem/destino, retorna quantos bytes foram transferidos
+typedef size_t (*copy_io_t)(void* context, void* buffer, size_t size, uint64_t offset);
+
+uint64_t copy_pipeline_run(copy_io_t read_io, void* read_context, copy_io_t write_io, void* write_context, uint64_t size, size_t chunk_size);
+
+// Funções de leitura/escrita para descritores de arquivos do computador (context aponta para o int do descritor)
+size_t copy_fd_read(void* context, void* buffer, size_t size, uint64_t offset);
+size_t copy_fd_write(void* context, void* buffer, size_t size, uint64_t offset);
+
+int64_t copy_range(int in_fd, uint64_t in_offset, int out_fd, uint64_t out_offset, uint64_t size);
+
+#endif
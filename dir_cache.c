@@ -0,0 +1,143 @@
+/**
+ *    Descrição: Cache LRU de diretórios já lidos, indexada pelo primeiro cluster
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <stdlib.h>
+#include <string.h>
+#include "dir_cache.h"
+
+// Memória ocupada por um diretório na cache
+static uint64_t entry_bytes(dir_cache_entry_t* entry) {
+	dir_index_t* index = &entry->index;
+	uint64_t bytes = sizeof(dir_cache_entry_t) + (uint64_t)entry->quantity * sizeof(DirEntry) + (uint64_t)index->size * sizeof(int32_t);
+	// Nomes longos
+	if(index->long_names) bytes += index->names_capacity + (uint64_t)index->quantity * sizeof(uint32_t) + (uint64_t)index->long_size * sizeof(int32_t);
+	return bytes;
+}
+
+static void lru_unlink(dir_cache_t* cache, dir_cache_entry_t* entry) {
+	if(entry->prev) entry->prev->next = entry->next;
+	else cache->head = entry->next;
+	if(entry->next) entry->next->prev = entry->prev;
+	else cache->tail = entry->prev;
+	entry->prev = entry->next = NULL;
+}
+
+static void lru_push_front(dir_cache_t* cache, dir_cache_entry_t* entry) {
+	entry->prev = NULL;
+	entry->next = cache->head;
+	if(cache->head) cache->head->prev = entry;
+	cache->head = entry;
+	if(!cache->tail) cache->tail = entry;
+}
+
+// Remove da tabela hash, do LRU e libera a memória
+static void remove_entry(dir_cache_t* cache, dir_cache_entry_t* entry) {
+	dir_cache_entry_t** link = &cache->buckets[entry->cluster % DIR_CACHE_BUCKETS];
+	while(*link != entry) link = &(*link)->hash_next;
+	*link = entry->hash_next;
+
+	lru_unlink(cache, entry);
+	cache->used_bytes -= entry_bytes(entry);
+	cache->entry_count--;
+	dir_index_destroy(&entry->index);
+	pthread_rwlock_destroy(&entry->lock);
+	free(entry->entries);
+	free(entry);
+}
+
+// Tira da cache os diretórios menos usados (que não estejam em uso) até caber no orçamento
+static void enforce_budget(dir_cache_t* cache) {
+	dir_cache_entry_t* entry = cache->tail;
+	while(entry && cache->used_bytes > cache->budget) {
+		dir_cache_entry_t* prev = entry->prev;
+		if(entry->refs == 0) {
+			remove_entry(cache, entry);
+			cache->evictions++;
+		}
+		entry = prev;
+	}
+}
+
+static dir_cache_entry_t* find_entry(dir_cache_t* cache, uint32_t cluster) {
+	dir_cache_entry_t* entry = cache->buckets[cluster % DIR_CACHE_BUCKETS];
+	while(entry && entry->cluster != cluster) entry = entry->hash_next;
+	return entry;
+}
+
+void dir_cache_init(dir_cache_t* cache, dir_loader_t load, void* context, uint64_t budget) {
+	memset(cache, 0, sizeof(dir_cache_t));
+	cache->load = load;
+	cache->context = context;
+	cache->budget = budget;
+}
+
+void dir_cache_destroy(dir_cache_t* cache) {
+	while(cache->head) remove_entry(cache, cache->head);
+}
+
+// Coloca na cache um diretório já montado (a cache passa a ser dona de entries) e retorna a entrada em uso
+dir_cache_entry_t* dir_cache_insert(dir_cache_t* cache, uint32_t cluster, DirEntry* entries, uint32_t quantity) {
+	dir_cache_drop(cache, cluster);
+
+	dir_cache_entry_t* entry = (dir_cache_entry_t*) calloc(1, sizeof(dir_cache_entry_t));
+	entry->cluster = cluster;
+	entry->entries = entries;
+	entry->quantity = quantity;
+	entry->refs = 1;
+	pthread_rwlock_init(&entry->lock, NULL);
+	dir_index_build(&entry->index, entries, quantity);
+
+	entry->hash_next = cache->buckets[cluster % DIR_CACHE_BUCKETS];
+	cache->buckets[cluster % DIR_CACHE_BUCKETS] = entry;
+	lru_push_front(cache, entry);
+	cache->used_bytes += entry_bytes(entry);
+	cache->entry_count++;
+
+	enforce_budget(cache);
+	return entry;
+}
+
+// Retorna o diretório do cluster marcado como em uso, lendo do disco só se não estiver na cache
+dir_cache_entry_t* dir_cache_get(dir_cache_t* cache, uint32_t cluster) {
+	dir_cache_entry_t* entry = find_entry(cache, cluster);
+	if(entry) {
+		cache->hits++;
+		entry->refs++;
+		if(cache->head != entry) {
+			lru_unlink(cache, entry);
+			lru_push_front(cache, entry);
+		}
+		return entry;
+	}
+
+	cache->misses++;
+	uint32_t quantity;
+	DirEntry* entries = cache->load(cache->context, cluster, &quantity);
+	return dir_cache_insert(cache, cluster, entries, quantity);
+}
+
+// Marca que um usuário da entrada não precisa mais dela
+void dir_cache_release(dir_cache_t* cache, dir_cache_entry_t* entry) {
+	if(entry == NULL) return;
+	if(entry->refs) entry->refs--;
+	enforce_budget(cache);
+}
+
+// Muda a quantidade de entradas (quando o diretório ganha um cluster), as novas entradas ficam zeradas
+void dir_cache_resize(dir_cache_t* cache, dir_cache_entry_t* entry, uint32_t quantity) {
+	cache->used_bytes -= entry_bytes(entry);
+	entry->entries = (DirEntry*) realloc(entry->entries, (uint64_t)quantity * sizeof(DirEntry));
+	if(quantity > entry->quantity)
+		memset(&entry->entries[entry->quantity], 0, (uint64_t)(quantity - entry->quantity) * sizeof(DirEntry));
+	entry->quantity = quantity;
+	dir_index_grow(&entry->index, quantity);
+	cache->used_bytes += entry_bytes(entry);
+}
+
+// Descarta o diretório da cache (usado quando a cadeia dele é liberada)
+void dir_cache_drop(dir_cache_t* cache, uint32_t cluster) {
+	dir_cache_entry_t* entry = find_entry(cache, cluster);
+	if(entry && entry->refs == 0) remove_entry(cache, entry);
+}
@@ -0,0 +1,65 @@
+/**
+ *    Descrição: Cache LRU de diretórios já lidos, indexada pelo primeiro cluster
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#ifndef DIR_CACHE_H
+#define DIR_CACHE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "fat32.h"
+#include "dir_index.h"
+
+// Orçamento de memória padrão da cache de diretórios
+#define DIR_CACHE_DEFAULT_BUDGET (8 * 1024 * 1024)
+// Quantidade de listas da tabela hash
+#define DIR_CACHE_BUCKETS 1024
+
+// Função que lê um diretório do disco (com o contexto passado no init), retorna as entradas alocadas com malloc e a quantidade
+typedef DirEntry* (*dir_loader_t)(void* context, uint32_t cluster, uint32_t* quantity);
+
+// Diretório na cache
+typedef struct dir_cache_entry {
+	uint32_t cluster;
+	DirEntry* entries;
+	uint32_t quantity;
+	// Índice dos nomes, mantido junto com as entries
+	dir_index_t index;
+	// Quantidade de directory_t usando a entrada, entradas em uso não saem da cache
+	uint32_t refs;
+	// Trava das funções da API: lida por quem percorre as entradas fora de metadata_lock, escrita por quem altera o diretório
+	pthread_rwlock_t lock;
+	struct dir_cache_entry* prev;
+	struct dir_cache_entry* next;
+	struct dir_cache_entry* hash_next;
+} dir_cache_entry_t;
+
+// Estado da cache
+typedef struct dir_cache {
+	dir_loader_t load;
+	// Passado para load
+	void* context;
+	uint64_t budget;
+	uint64_t used_bytes;
+	uint32_t entry_count;
+	dir_cache_entry_t* buckets[DIR_CACHE_BUCKETS];
+	dir_cache_entry_t* head;
+	dir_cache_entry_t* tail;
+
+	// Contadores
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+} dir_cache_t;
+
+void dir_cache_init(dir_cache_t* cache, dir_loader_t load, void* context, uint64_t budget);
+void dir_cache_destroy(dir_cache_t* cache);
+
+dir_cache_entry_t* dir_cache_get(dir_cache_t* cache, uint32_t cluster);
+dir_cache_entry_t* dir_cache_insert(dir_cache_t* cache, uint32_t cluster, DirEntry* entries, uint32_t quantity);
+void dir_cache_release(dir_cache_t* cache, dir_cache_entry_t* entry);
+void dir_cache_resize(dir_cache_t* cache, dir_cache_entry_t* entry, uint32_t quantity);
+void dir_cache_drop(dir_cache_t* cache, uint32_t cluster);
+
+#endif
@@ -0,0 +1,258 @@
+/**
+ *    Descrição: Índice hash dos nomes (DIR_Name e nomes longos) das entradas de um diretório
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <stdlib.h>
+#include <string.h>
+#include "dir_index.h"
+#include "lfn.h"
+
+#define SLOT_EMPTY -1
+#define SLOT_REMOVED -2
+
+// FNV-1a dos 11 bytes do nome
+static uint32_t hash_name(const char* name) {
+	uint32_t hash = 2166136261u;
+	for(int i = 0; i < 11; i++) {
+		hash ^= (uint8_t) name[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// Retorna 1 se a entrada deve estar no índice (ocupada e não for parte de nome longo)
+static int is_indexed(DirEntry* entry) {
+	uint8_t status_byte = entry->short_dir.DIR_Name[0];
+	if(status_byte == 0x00 || status_byte == 0xE5) return 0;
+	return (entry->short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) != ATTR_LONG_NAME;
+}
+
+// Coloca a posição na tabela, sem verificar tamanho
+static void insert_slot(dir_index_t* index, DirEntry* entries, uint32_t position) {
+	uint32_t mask = index->size - 1;
+	uint32_t slot = hash_name(entries[position].short_dir.DIR_Name) & mask;
+	while(index->slots[slot] >= 0) slot = (slot + 1) & mask;
+	if(index->slots[slot] == SLOT_REMOVED) index->removed--;
+	index->slots[slot] = position;
+	index->count++;
+}
+
+// Recria a tabela com capacidade para pelo menos o dobro das entradas atuais
+static void rehash(dir_index_t* index, DirEntry* entries, uint32_t min_count) {
+	uint32_t size = 16;
+	while(size < min_count * 2) size *= 2;
+
+	int32_t* old_slots = index->slots;
+	uint32_t old_size = index->size;
+
+	index->slots = (int32_t*) malloc(size * sizeof(int32_t));
+	for(uint32_t i = 0; i < size; i++) index->slots[i] = SLOT_EMPTY;
+	index->size = size;
+	index->count = 0;
+	index->removed = 0;
+
+	for(uint32_t i = 0; i < old_size; i++)
+		if(old_slots[i] >= 0) insert_slot(index, entries, old_slots[i]);
+	free(old_slots);
+}
+
+// Procura a próxima posição livre a partir de start
+static uint32_t next_free(dir_index_t* index, DirEntry* entries, uint32_t start) {
+	for(uint32_t i = start; i < index->end; i++)
+		if((uint8_t) entries[i].short_dir.DIR_Name[0] == 0xE5) return i;
+	return index->end;
+}
+
+// Letra ASCII em maiúscula, os outros bytes (inclusive os de UTF-8) ficam iguais
+static inline uint8_t fold_case(char c) {
+	return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : (uint8_t) c;
+}
+
+// FNV-1a do nome longo sem diferenciar maiúsculas
+static uint32_t hash_long_name(const char* name) {
+	uint32_t hash = 2166136261u;
+	for(; *name; name++) {
+		hash ^= fold_case(*name);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static int long_name_equal(const char* name, const char* other) {
+	for(; *name && fold_case(*name) == fold_case(*other); name++, other++);
+	return fold_case(*name) == fold_case(*other);
+}
+
+// Coloca a posição na tabela dos nomes longos, sem verificar tamanho
+static void insert_long_slot(dir_index_t* index, uint32_t position) {
+	uint32_t mask = index->long_size - 1;
+	uint32_t slot = hash_long_name(index->names + index->long_names[position] - 1) & mask;
+	while(index->long_slots[slot] >= 0) slot = (slot + 1) & mask;
+	if(index->long_slots[slot] == SLOT_REMOVED) index->long_removed--;
+	index->long_slots[slot] = position;
+	index->long_count++;
+}
+
+// Recria a tabela dos nomes longos com capacidade para pelo menos o dobro de min_count
+static void rehash_long(dir_index_t* index, uint32_t min_count) {
+	uint32_t size = 16;
+	while(size < min_count * 2) size *= 2;
+
+	int32_t* old_slots = index->long_slots;
+	uint32_t old_size = index->long_size;
+
+	index->long_slots = (int32_t*) malloc(size * sizeof(int32_t));
+	for(uint32_t i = 0; i < size; i++) index->long_slots[i] = SLOT_EMPTY;
+	index->long_size = size;
+	index->long_count = 0;
+	index->long_removed = 0;
+
+	for(uint32_t i = 0; i < old_size; i++)
+		if(old_slots[i] >= 0) insert_long_slot(index, old_slots[i]);
+	free(old_slots);
+}
+
+// Converte o nome longo da entrada curta da posição para UTF-8 direto na área de nomes e coloca na tabela
+static void add_long_name(dir_index_t* index, uint32_t position, const uint16_t* units, uint32_t length) {
+	if(index->long_names == NULL) index->long_names = (uint32_t*) calloc(index->quantity, sizeof(uint32_t));
+	uint32_t needed = index->names_size + length * 3 + 1;
+	if(needed > index->names_capacity) {
+		while(index->names_capacity < needed) index->names_capacity = index->names_capacity ? index->names_capacity * 2 : 1024;
+		index->names = (char*) realloc(index->names, index->names_capacity);
+	}
+
+	index->long_names[position] = index->names_size + 1;
+	index->names_size += lfn_utf16_to_utf8(index->names + index->names_size, units, length) + 1;
+
+	if((index->long_count + index->long_removed + 1) * 2 > index->long_size) rehash_long(index, index->long_count + 1);
+	insert_long_slot(index, position);
+}
+
+// Monta o índice lendo as entradas uma única vez
+// Os nomes longos são montados durante a mesma leitura e ligados à entrada curta que vem logo depois deles
+void dir_index_build(dir_index_t* index, DirEntry* entries, uint32_t quantity) {
+	memset(index, 0, sizeof(dir_index_t));
+	index->quantity = quantity;
+	index->end = quantity;
+	index->first_free = quantity;
+
+	// A tabela é dimensionada pela quantidade de entradas, então os nomes entram nela sem uma segunda leitura
+	rehash(index, entries, quantity);
+
+	lfn_decoder_t decoder;
+	lfn_reset(&decoder);
+	for(uint32_t i = 0; i < quantity; i++) {
+		uint8_t status_byte = entries[i].short_dir.DIR_Name[0];
+		if(status_byte == 0x00) {
+			index->end = i;
+			break;
+		}
+		if(status_byte == 0xE5) {
+			if(index->first_free == quantity) index->first_free = i;
+			lfn_reset(&decoder);
+			continue;
+		}
+		if((entries[i].short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) {
+			lfn_push(&decoder, &entries[i].long_dir);
+			continue;
+		}
+
+		insert_slot(index, entries, i);
+		uint32_t length = lfn_finish(&decoder, entries[i].short_dir.DIR_Name);
+		if(length) add_long_name(index, i, decoder.units, length);
+	}
+	if(index->first_free > index->end) index->first_free = index->end;
+}
+
+void dir_index_destroy(dir_index_t* index) {
+	free(index->slots);
+	free(index->names);
+	free(index->long_names);
+	free(index->long_slots);
+	memset(index, 0, sizeof(dir_index_t));
+}
+
+// Retorna a posição da entrada com o nome de 11 bytes, ou -1 se não existir
+int32_t dir_index_find(dir_index_t* index, DirEntry* entries, const char* name) {
+	uint32_t mask = index->size - 1;
+	uint32_t slot = hash_name(name) & mask;
+	while(index->slots[slot] != SLOT_EMPTY) {
+		int32_t position = index->slots[slot];
+		if(position >= 0 && !memcmp(entries[position].short_dir.DIR_Name, name, 11)) return position;
+		slot = (slot + 1) & mask;
+	}
+	return -1;
+}
+
+// Retorna a posição da entrada curta cujo nome longo é name (sem diferenciar maiúsculas), ou -1 se não existir
+int32_t dir_index_find_long(dir_index_t* index, const char* name) {
+	if(index->long_size == 0) return -1;
+	uint32_t mask = index->long_size - 1;
+	uint32_t slot = hash_long_name(name) & mask;
+	while(index->long_slots[slot] != SLOT_EMPTY) {
+		int32_t position = index->long_slots[slot];
+		if(position >= 0 && long_name_equal(index->names + index->long_names[position] - 1, name)) return position;
+		slot = (slot + 1) & mask;
+	}
+	return -1;
+}
+
+// Nome longo em UTF-8 da entrada curta da posição, NULL se ela não tiver
+const char* dir_index_long_name(dir_index_t* index, uint32_t position) {
+	if(index->long_names == NULL || index->long_names[position] == 0) return NULL;
+	return index->names + index->long_names[position] - 1;
+}
+
+// Registra a entrada recém escrita na posição
+void dir_index_add(dir_index_t* index, DirEntry* entries, uint32_t position) {
+	if(position >= index->end) index->end = position + 1;
+	if(position == index->first_free) index->first_free = next_free(index, entries, position + 1);
+
+	if(!is_indexed(&entries[position])) return;
+	if((index->count + index->removed + 1) * 2 > index->size) rehash(index, entries, index->count + 1);
+	insert_slot(index, entries, position);
+}
+
+// Tira a entrada do índice, deve ser chamado antes de mudar o nome dela na memória
+void dir_index_remove(dir_index_t* index, DirEntry* entries, uint32_t position) {
+	uint32_t mask = index->size - 1;
+	uint32_t slot = hash_name(entries[position].short_dir.DIR_Name) & mask;
+	while(index->slots[slot] != SLOT_EMPTY) {
+		if(index->slots[slot] == position) {
+			index->slots[slot] = SLOT_REMOVED;
+			index->count--;
+			index->removed++;
+			break;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	// O nome longo sai da tabela, o espaço dele na área de nomes só volta quando o índice for montado de novo
+	const char* long_name = dir_index_long_name(index, position);
+	if(long_name) {
+		mask = index->long_size - 1;
+		slot = hash_long_name(long_name) & mask;
+		while(index->long_slots[slot] != SLOT_EMPTY) {
+			if(index->long_slots[slot] == position) {
+				index->long_slots[slot] = SLOT_REMOVED;
+				index->long_count--;
+				index->long_removed++;
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
+		index->long_names[position] = 0;
+	}
+	if(position < index->first_free) index->first_free = position;
+}
+
+// Atualiza o índice quando o diretório ganha novas entradas (zeradas) no fim
+void dir_index_grow(dir_index_t* index, uint32_t quantity) {
+	if(index->first_free == index->quantity) index->first_free = index->end;
+	if(index->long_names) {
+		index->long_names = (uint32_t*) realloc(index->long_names, quantity * sizeof(uint32_t));
+		memset(index->long_names + index->quantity, 0, (quantity - index->quantity) * sizeof(uint32_t));
+	}
+	index->quantity = quantity;
+}
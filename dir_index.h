@@ -0,0 +1,49 @@
+/**
+ *    Descrição: Índice hash dos nomes (DIR_Name e nomes longos) das entradas de um diretório
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#ifndef DIR_INDEX_H
+#define DIR_INDEX_H
+
+#include <stdint.h>
+#include "fat32.h"
+
+// Índice de um diretório, as posições guardadas são índices no vetor de entries
+typedef struct dir_index {
+	// Tabela com endereçamento aberto: -1 vazio, -2 removido, >= 0 posição da entrada
+	int32_t* slots;
+	uint32_t size;
+	uint32_t count;
+	uint32_t removed;
+	// Quantidade de entradas do diretório
+	uint32_t quantity;
+	// Posição da entrada 0x00 que marca o fim do diretório (ou quantity se não houver)
+	uint32_t end;
+	// Menor posição livre (0xE5 ou o fim), quantity se o diretório estiver cheio
+	uint32_t first_free;
+
+	// Nomes longos em UTF-8, um atrás do outro na mesma área (alocados só se o diretório tiver algum)
+	char* names;
+	uint32_t names_size;
+	uint32_t names_capacity;
+	// Para cada posição, deslocamento + 1 do nome longo da entrada curta em names (0 se ela não tiver)
+	uint32_t* long_names;
+	// Tabela dos nomes longos, sem diferenciar maiúsculas, com as mesmas marcas da tabela dos nomes curtos
+	int32_t* long_slots;
+	uint32_t long_size;
+	uint32_t long_count;
+	uint32_t long_removed;
+} dir_index_t;
+
+void dir_index_build(dir_index_t* index, DirEntry* entries, uint32_t quantity);
+void dir_index_destroy(dir_index_t* index);
+
+int32_t dir_index_find(dir_index_t* index, DirEntry* entries, const char* name);
+int32_t dir_index_find_long(dir_index_t* index, const char* name);
+const char* dir_index_long_name(dir_index_t* index, uint32_t position);
+void dir_index_add(dir_index_t* index, DirEntry* entries, uint32_t position);
+void dir_index_remove(dir_index_t* index, DirEntry* entries, uint32_t position);
+void dir_index_grow(dir_index_t* index, uint32_t quantity);
+
+#endif
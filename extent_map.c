@@ -0,0 +1,130 @@
+/**
+ *    Descrição: Cache de mapas de extents (sequências contíguas) das cadeias de clusters
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <stdlib.h>
+#include <string.h>
+#include "extent_map.h"
+
+// Valor da FAT a partir do qual a cadeia termina
+#define EXTENT_MAP_END_OF_CHAIN 0x0FFFFFF8
+
+void extent_map_cache_init(extent_map_cache_t* cache, fat_reader_t read_fat, void* context, uint32_t max_chain) {
+	memset(cache, 0, sizeof(extent_map_cache_t));
+	cache->read_fat = read_fat;
+	cache->context = context;
+	cache->max_chain = max_chain;
+}
+
+static void unlink_map(extent_map_cache_t* cache, extent_map_t* map) {
+	if(map->prev) map->prev->next = map->next;
+	else cache->head = map->next;
+	if(map->next) map->next->prev = map->prev;
+	else cache->tail = map->prev;
+	map->prev = map->next = NULL;
+}
+
+static void push_front(extent_map_cache_t* cache, extent_map_t* map) {
+	map->prev = NULL;
+	map->next = cache->head;
+	if(cache->head) cache->head->prev = map;
+	cache->head = map;
+	if(!cache->tail) cache->tail = map;
+}
+
+static void drop_map(extent_map_cache_t* cache, extent_map_t* map) {
+	unlink_map(cache, map);
+	free(map->extents);
+	free(map);
+	cache->map_count--;
+}
+
+void extent_map_cache_destroy(extent_map_cache_t* cache) {
+	while(cache->head) drop_map(cache, cache->head);
+}
+
+// Anda na cadeia uma única vez juntando clusters fisicamente vizinhos em extents
+static extent_map_t* build_map(extent_map_cache_t* cache, uint32_t first_cluster) {
+	extent_map_t* map = (extent_map_t*) calloc(1, sizeof(extent_map_t));
+	map->first_cluster = first_cluster;
+	map->min_cluster = first_cluster;
+	map->max_cluster = first_cluster;
+
+	uint32_t capacity = 4;
+	map->extents = (chain_extent_t*) malloc(capacity * sizeof(chain_extent_t));
+
+	uint32_t cluster = first_cluster;
+	while(cluster >= 2 && cluster < EXTENT_MAP_END_OF_CHAIN && map->cluster_count < cache->max_chain) {
+		chain_extent_t* last = map->extent_count ? &map->extents[map->extent_count - 1] : NULL;
+		if(last && last->physical + last->length == cluster) {
+			last->length++;
+		} else {
+			if(map->extent_count == capacity) {
+				capacity *= 2;
+				map->extents = (chain_extent_t*) realloc(map->extents, capacity * sizeof(chain_extent_t));
+			}
+			map->extents[map->extent_count].logical = map->cluster_count;
+			map->extents[map->extent_count].physical = cluster;
+			map->extents[map->extent_count].length = 1;
+			map->extent_count++;
+		}
+		if(cluster < map->min_cluster) map->min_cluster = cluster;
+		if(cluster > map->max_cluster) map->max_cluster = cluster;
+		map->cluster_count++;
+		cluster = cache->read_fat(cache->context, cluster);
+	}
+	return map;
+}
+
+// Retorna o mapa da cadeia que começa em first_cluster, montando se não estiver na cache
+extent_map_t* extent_map_get(extent_map_cache_t* cache, uint32_t first_cluster) {
+	for(extent_map_t* map = cache->head; map; map = map->next) {
+		if(map->first_cluster != first_cluster) continue;
+		cache->hits++;
+		if(cache->head != map) {
+			unlink_map(cache, map);
+			push_front(cache, map);
+		}
+		return map;
+	}
+
+	cache->misses++;
+	if(cache->map_count >= EXTENT_MAP_MAX_MAPS) drop_map(cache, cache->tail);
+
+	extent_map_t* map = build_map(cache, first_cluster);
+	push_front(cache, map);
+	cache->map_count++;
+	return map;
+}
+
+// Retorna o cluster físico do cluster lógico (posição na cadeia) com busca binária, ou 0 se passar do fim
+uint32_t extent_map_lookup(extent_map_t* map, uint32_t logical) {
+	if(logical >= map->cluster_count) return 0;
+
+	uint32_t low = 0, high = map->extent_count - 1;
+	while(low < high) {
+		uint32_t mid = (low + high + 1) / 2;
+		if(map->extents[mid].logical <= logical) low = mid;
+		else high = mid - 1;
+	}
+	return map->extents[low].physical + (logical - map->extents[low].logical);
+}
+
+// Descarta os mapas que passam pelo cluster, chamado quando a entrada dele na FAT muda
+void extent_map_invalidate(extent_map_cache_t* cache, uint32_t cluster) {
+	extent_map_t* map = cache->head;
+	while(map) {
+		extent_map_t* next = map->next;
+		if(cluster >= map->min_cluster && cluster <= map->max_cluster) {
+			for(uint32_t i = 0; i < map->extent_count; i++) {
+				if(cluster >= map->extents[i].physical && cluster < map->extents[i].physical + map->extents[i].length) {
+					drop_map(cache, map);
+					cache->invalidations++;
+					break;
+				}
+			}
+		}
+		map = next;
+	}
+}
@@ -0,0 +1,62 @@
+/**
+ *    Descrição: Cache de mapas de extents (sequências contíguas) das cadeias de clusters
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#ifndef EXTENT_MAP_H
+#define EXTENT_MAP_H
+
+#include <stdint.h>
+
+// Quantidade de cadeias mantidas na cache
+#define EXTENT_MAP_MAX_MAPS 64
+
+// Função usada para ler a FAT: recebe o contexto e um cluster e retorna o próximo da cadeia
+typedef uint32_t (*fat_reader_t)(void* context, uint32_t cluster);
+
+// Sequência contígua da cadeia: clusters lógicos [logical, logical + length) estão em [physical, physical + length)
+typedef struct chain_extent {
+	uint32_t logical;
+	uint32_t physical;
+	uint32_t length;
+} chain_extent_t;
+
+// Mapa de uma cadeia inteira
+typedef struct extent_map {
+	uint32_t first_cluster;
+	chain_extent_t* extents;
+	uint32_t extent_count;
+	// Quantidade de clusters da cadeia
+	uint32_t cluster_count;
+	// Menor e maior cluster físico, para descartar rápido na invalidação
+	uint32_t min_cluster;
+	uint32_t max_cluster;
+	struct extent_map* prev;
+	struct extent_map* next;
+} extent_map_t;
+
+// Cache LRU de mapas
+typedef struct extent_map_cache {
+	fat_reader_t read_fat;
+	// Passado para read_fat
+	void* context;
+	// Limite de clusters seguidos antes de considerar a cadeia um laço
+	uint32_t max_chain;
+	uint32_t map_count;
+	extent_map_t* head;
+	extent_map_t* tail;
+
+	// Contadores
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t invalidations;
+} extent_map_cache_t;
+
+void extent_map_cache_init(extent_map_cache_t* cache, fat_reader_t read_fat, void* context, uint32_t max_chain);
+void extent_map_cache_destroy(extent_map_cache_t* cache);
+
+extent_map_t* extent_map_get(extent_map_cache_t* cache, uint32_t first_cluster);
+uint32_t extent_map_lookup(extent_map_t* map, uint32_t logical);
+void extent_map_invalidate(extent_map_cache_t* cache, uint32_t cluster);
+
+#endif
@@ -5,31 +5,106 @@
  * */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <time.h>
 #include <math.h>
+#include <fnmatch.h>
+#include <pthread.h>
 #include "fat32.h"
-
-// Ponteiro do disco/imagem
-FILE *disk;
-
-// Struct do boot sector
-static struct boot_sector bs;
-
-// Struct da FSINFO
-static struct FSInfo fs;
-
-// Primeiro cluster de dados
-uint64_t first_data_sector;
-// Offset do diretório /
-uint64_t rootdir_offset;
-
-// Stack do diretório
-directory_t* directory_stack;
-// Contador de diretórios na stack
-uint32_t directory_stack_count;
+#include "block_device.h"
+#include "block_cache.h"
+#include "journal.h"
+#include "allocator.h"
+#include "extent_map.h"
+#include "dir_cache.h"
+#include "fat_simd.h"
+#include "copy_pipeline.h"
+#include "thread_pool.h"
+#include "host_tree.h"
+#include "path_index.h"
+#include "lfn.h"
+
+// Estado de uma imagem montada; todas as operações recebem o contexto, então um processo pode ter várias imagens abertas
+struct fat32 {
+	// Dispositivo do disco/imagem
+	block_device_t* disk;
+
+	// Struct do boot sector
+	struct boot_sector bs;
+
+	// Struct da FSINFO
+	struct FSInfo fs;
+
+	// Cache das entradas da FAT
+	fat_cache_t fat_cache;
+
+	// Cache dos setores de metadados modificados
+	block_cache_t block_cache;
+
+	// Journal dos metadados (NULL se não estiver em uso)
+	journal_t* journal;
+
+	// Bitmap de clusters livres
+	cluster_allocator_t allocator;
+	// Se 0, o bitmap ainda não foi montado e só max_cluster do alocador é válido
+	int free_bitmap_loaded;
+
+	// Cache dos mapas de extents das cadeias
+	extent_map_cache_t extent_maps;
+
+	// Cache de diretórios lidos
+	dir_cache_t dir_cache;
+
+	// Offset da FSINFO na imagem
+	uint64_t fsinfo_offset;
+
+	// Quantidade de threads usadas nas cópias paralelas
+	uint32_t worker_count;
+
+	// Caminho da imagem aberta
+	char* image_name;
+	// Índice de caminhos <imagem>.idx (NULL se não estiver em uso)
+	path_index_t* path_index;
+	// Escritas de metadados quando o índice foi aberto, qualquer escrita depois deixa o índice desatualizado
+	uint64_t path_index_writes;
+	// Escritas da FSINFO, que não mudam nenhum caminho e não contam para o índice
+	uint64_t fsinfo_writes;
+
+	// Primeiro cluster de dados
+	uint64_t first_data_sector;
+	// Offset do diretório /
+	uint64_t rootdir_offset;
+
+	// Stack do diretório
+	directory_t* directory_stack;
+	// Contador de diretórios na stack
+	uint32_t directory_stack_count;
+
+	// 1 se o comando atual imprimiu um erro (zerado por take_command_failure)
+	int command_failed;
+
+	// Travas das funções da API, que podem ser chamadas por várias threads (os comandos da shell não travam nada)
+	// Ordem: writer_lock, trava do diretório (dir_cache_entry_t.lock), metadata_lock, cache_lock
+	// metadata_lock protege as caches, a FAT, o alocador e a pilha de diretórios: as consultas a compartilham
+	// e as alterações a pegam sozinhas; as leituras e escritas de dados ficam fora dela
+	pthread_rwlock_t metadata_lock;
+	// Com metadata_lock compartilhada as caches ainda mudam (LRU, contadores, diretórios e mapas carregados),
+	// então pegar e soltar uma entrada delas passa por esta trava curta
+	pthread_mutex_t cache_lock;
+	// As alterações da API são feitas uma de cada vez
+	pthread_mutex_t writer_lock;
+	// Contador de cada região de FAT_REGION_CLUSTERS clusters, incrementado quando um cluster dela é liberado
+	// (a leitura de dados confere os contadores das regiões do arquivo no fim e repete se algum mudou)
+	uint32_t* region_sequence;
+};
+
+// Clusters de cada região da FAT com um contador de liberações (16 KiB da FAT)
+#define FAT_REGION_SHIFT 12
 
 // Flag de free cluster para escrever na FAT
 uint32_t FREE_CLUSTER_POINTER = FREE_CLUSTER;
@@ -39,25 +114,60 @@ uint8_t AVAILABLE_ENTRY_POINTER = 0xE5;
 // Lista de caracteres proibidos em um nome da ShortEntry
 char prohibited[] = {'+', ',', ';', '=', '[', ']', '.', ' ', 0};
 
+// Imprime a mensagem de erro do comando e marca a falha, que vira o código de saída no modo não interativo
+void command_error(fat32_t* volume, const char* format, ...) {
+	va_list arguments;
+	va_start(arguments, format);
+	vprintf(format, arguments);
+	va_end(arguments);
+	volume->command_failed = 1;
+}
+
+// Retorna 1 se o último comando falhou e limpa a marca para o próximo
+int take_command_failure(fat32_t* volume) {
+	int failed = volume->command_failed;
+	volume->command_failed = 0;
+	return failed;
+}
+
+// Nome do diretório atual para o prompt, NULL na raiz
+const char* current_directory_name(fat32_t* volume) {
+	return volume->directory_stack_count ? volume->directory_stack->name : NULL;
+}
+
 // Função que retorna o offset do cluster do setor passado em parâmetro
-uint64_t get_cluster_offset(uint64_t sector) {
-	return (((sector - 2) * bs.BPB_SecPerClus) + first_data_sector);
+uint64_t get_cluster_offset(fat32_t* volume, uint64_t sector) {
+	return (((sector - 2) * volume->bs.BPB_SecPerClus) + volume->first_data_sector);
+}
+
+// Função que retorna o endereço em bytes do início do cluster
+uint64_t get_cluster_address(fat32_t* volume, uint32_t cluster) {
+	return get_cluster_offset(volume, cluster) * volume->bs.BPB_BytsPerSec;
 }
 
 // Função que retorna endereço da FAT do setor passado em parâmetro
-uint32_t get_fat_address(uint32_t sector) {
-	return (bs.BPB_RsvdSecCnt * bs.BPB_BytsPerSec) + sector * sizeof(uint32_t);
+uint32_t get_fat_address(fat32_t* volume, uint32_t sector) {
+	return (volume->bs.BPB_RsvdSecCnt * volume->bs.BPB_BytsPerSec) + sector * sizeof(uint32_t);
 }
 
 // Função que retorna o que está escrito na FAT na posicao do setor
-uint32_t get_cluster_info(uint64_t sector) {
-	uint32_t fat_address = get_fat_address(sector);
-	uint32_t value;
-	fseek(disk, fat_address, SEEK_SET);
-	fread(&value, sizeof(uint32_t), 1, disk);
+uint32_t get_cluster_info(fat32_t* volume, uint64_t sector) {
+	uint32_t value = fat_cache_get(&volume->fat_cache, sector);
 	return value >= END_OF_CHAIN ? END_OF_CHAIN : value;
 }
 
+// Leitura da FAT no formato usado pela cache de extents
+// O contexto é a imagem montada
+static uint32_t read_fat_entry(void* context, uint32_t cluster) {
+	return get_cluster_info((fat32_t*) context, cluster);
+}
+
+// Retorna o cluster físico na posição index da cadeia que começa em chain_start, ou END_OF_CHAIN se a cadeia for menor
+uint32_t get_chain_cluster(fat32_t* volume, uint32_t chain_start, uint32_t index) {
+	uint32_t cluster = extent_map_lookup(extent_map_get(&volume->extent_maps, chain_start), index);
+	return cluster ? cluster : END_OF_CHAIN;
+}
+
 // Cria nova estrutura de diretório e retorna
 directory_t* create_directory_struct(directory_t* previous, char* name){
 	// Aloca um novo diretório e preenche com os dados passados por parâmetro
@@ -73,103 +183,372 @@ directory_t* create_directory_struct(directory_t* previous, char* name){
 	return new_dir;
 }
 
+// Verifica se a FSINFO possui as assinaturas válidas
+int fsinfo_is_valid(fat32_t* volume) {
+	return volume->fs.FSI_LeadSig == 0x41615252 && volume->fs.FSI_StrucSig == 0x61417272 && volume->fs.FSI_TrailSig == 0xAA550000;
+}
+
+// Maior cluster válido, limitado pela quantidade de setores de dados e pelo tamanho da FAT
+uint32_t compute_max_cluster(fat32_t* volume) {
+	uint64_t data_clusters = (volume->bs.BPB_TotSec32 - volume->first_data_sector) / volume->bs.BPB_SecPerClus;
+	uint64_t fat_entries = (uint64_t)volume->bs.BPB_FATSz32 * volume->bs.BPB_BytsPerSec / sizeof(uint32_t);
+	return data_clusters + 1 < fat_entries - 1 ? data_clusters + 1 : fat_entries - 1;
+}
+
+// Verifica se a contagem de livres da FSINFO existe e cabe na imagem (0xFFFFFFFF é desconhecida)
+int fsinfo_free_count_is_valid(fat32_t* volume) {
+	return fsinfo_is_valid(volume) && volume->fs.FSI_Free_Count <= volume->allocator.max_cluster + 1 - FIRST_DATA_CLUSTER;
+}
+
+// Lê a FAT1 inteira em blocos grandes e marca no bitmap os clusters em uso
+// Só roda na primeira vez que o bitmap é necessário, depois não faz nada
+void build_free_bitmap(fat32_t* volume) {
+	if(volume->free_bitmap_loaded) return;
+	volume->free_bitmap_loaded = 1;
+	uint32_t max_cluster = volume->allocator.max_cluster;
+
+	// Os blocos começam em múltiplos de 64, então os kernels escrevem direto nas palavras do bitmap
+	const fat_kernels_t* kernels = fat_kernels();
+	uint32_t chunk_entries = 256 * 1024;
+	uint32_t* chunk = (uint32_t*) malloc(chunk_entries * sizeof(uint32_t));
+	uint32_t free_count = 0;
+	for(uint32_t first = 0; first <= max_cluster; first += chunk_entries) {
+		uint32_t count = max_cluster + 1 - first < chunk_entries ? max_cluster + 1 - first : chunk_entries;
+		bdev_read(volume->disk, chunk, count * sizeof(uint32_t), get_fat_address(volume, first));
+		kernels->mark_used(chunk, count, volume->allocator.bitmap + first / 64);
+		// As entradas 0 e 1 são reservadas e não entram na contagem
+		uint32_t skip = first < FIRST_DATA_CLUSTER ? FIRST_DATA_CLUSTER - first : 0;
+		if(count > skip) free_count += kernels->count_free(chunk + skip, count - skip);
+	}
+	free(chunk);
+	volume->allocator.free_count = free_count;
+
+	// Usa a dica da FSINFO para começar as buscas, se ela for válida
+	if(fsinfo_is_valid(volume) && volume->fs.FSI_Nxt_Free >= FIRST_DATA_CLUSTER && volume->fs.FSI_Nxt_Free <= max_cluster)
+		volume->allocator.next_free = volume->fs.FSI_Nxt_Free;
+}
+
 // Lê a imagem/disco passado por parâmetro
-void read_disk(const char *disk_name) {
+// Retorna o contexto da imagem montada (liberado por close_disk) ou NULL se nao conseguiu abrir
+fat32_t* read_disk(const char *disk_name, mount_options_t* options) {
+	fat32_t* volume = (fat32_t*) calloc(1, sizeof(fat32_t));
 	// Abre o arquivo .img
-	disk = fopen(disk_name, "rb+");
+	volume->disk = bdev_open(disk_name, options->backend);
+	if(volume->disk == NULL) {
+		free(volume);
+		return NULL;
+	}
+	volume->image_name = strdup(disk_name);
+
+	// Antes de ler qualquer coisa, termina de aplicar a última transação confirmada no journal
+	volume->journal = NULL;
+	if(options->journal) {
+		volume->journal = journal_open(disk_name);
+		if(volume->journal == NULL) {
+			printf("journal: %s: Unable to open journal\n", disk_name);
+			bdev_close(volume->disk);
+			free(volume->image_name);
+			free(volume);
+			return NULL;
+		}
+		int replayed = journal_replay(volume->journal, volume->disk);
+		if(replayed) printf("journal: %s: Replayed %d writes\n", disk_name, replayed);
+	}
 	// Le os primeiros bytes e coloca em uma estrutura de Boot Sector
-	fread(&bs, sizeof(struct boot_sector), 1, disk);
+	bdev_read(volume->disk, &volume->bs, sizeof(struct boot_sector), 0);
 
 	// Calcula a posição do FSINFO
-	uint32_t fsinfo_offset = bs.BPB_BytsPerSec * bs.BPB_FSInfo;
+	volume->fsinfo_offset = volume->bs.BPB_BytsPerSec * volume->bs.BPB_FSInfo;
 
 	// Procura a posição do FSINFO e coloca em uma estrutura de FSINFO
-	fseek(disk, fsinfo_offset, SEEK_SET);
-	fread(&fs, sizeof(struct FSInfo), 1, disk);
+	bdev_read(volume->disk, &volume->fs, sizeof(struct FSInfo), volume->fsinfo_offset);
 
 	// Calcula a posição do primeiro setor de arquivos e inicia na pasta "/"
-	first_data_sector = bs.BPB_RsvdSecCnt + (bs.BPB_NumFATs * bs.BPB_FATSz32);
-	rootdir_offset = get_cluster_offset(bs.BPB_RootClus) * bs.BPB_BytsPerSec;
+	volume->first_data_sector = volume->bs.BPB_RsvdSecCnt + (volume->bs.BPB_NumFATs * volume->bs.BPB_FATSz32);
+	volume->rootdir_offset = get_cluster_offset(volume, volume->bs.BPB_RootClus) * volume->bs.BPB_BytsPerSec;
+
+	// Entradas de diretório, FSINFO e as páginas da FAT gravadas ficam em memória até o sync,
+	// assim todo flush é uma única transação (no journal, se estiver em uso)
+	block_cache_init(&volume->block_cache, volume->disk, volume->journal, volume->bs.BPB_BytsPerSec, BLOCK_CACHE_DEFAULT_THRESHOLD);
+
+	// Inicia a cache da FAT, as páginas só são lidas quando usadas e são gravadas pela cache de setores
+	uint64_t fat_size = (uint64_t)volume->bs.BPB_FATSz32 * volume->bs.BPB_BytsPerSec;
+	fat_cache_init(&volume->fat_cache, &volume->block_cache.device, get_fat_address(volume, 0), fat_size, volume->bs.BPB_NumFATs, options->fat_cache_size);
 
-	directory_stack_count = 0;
-	directory_stack = create_directory_struct(NULL, "/");
-	directory_stack->cluster = bs.BPB_RootClus;
+	// O bitmap de clusters livres só é montado na primeira alocação, quem só lê a imagem não percorre a FAT
+	allocator_init(&volume->allocator, compute_max_cluster(volume));
+	volume->free_bitmap_loaded = 0;
+
+	// Nenhuma cadeia válida é maior que a quantidade de clusters da imagem
+	extent_map_cache_init(&volume->extent_maps, read_fat_entry, volume, volume->allocator.max_cluster);
+
+	dir_cache_init(&volume->dir_cache, load_dir_entries, volume, options->dir_cache_size);
+
+	volume->worker_count = options->threads ? options->threads : thread_pool_default_size();
+
+	// Com preferência para quem altera, uma sequência de consultas não deixa a escrita esperando para sempre
+	pthread_rwlockattr_t attributes;
+	pthread_rwlockattr_init(&attributes);
+	pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+	pthread_rwlock_init(&volume->metadata_lock, &attributes);
+	pthread_rwlockattr_destroy(&attributes);
+	pthread_mutex_init(&volume->cache_lock, NULL);
+	pthread_mutex_init(&volume->writer_lock, NULL);
+	volume->region_sequence = (uint32_t*) calloc((volume->allocator.max_cluster >> FAT_REGION_SHIFT) + 1, sizeof(uint32_t));
+
+	volume->directory_stack_count = 0;
+	volume->directory_stack = create_directory_struct(NULL, "/");
+	volume->directory_stack->cluster = volume->bs.BPB_RootClus;
 
 	// Lê o diretorio "/"
-	read_dir();
+	read_dir(volume);
+
+	// O índice de caminhos é gerado de novo se não existir ou se a imagem mudou desde que ele foi gravado
+	volume->path_index = NULL;
+	if(options->path_index) {
+		path_index_stamp_t stamp;
+		path_index_stamp(volume->image_name, volume->bs.BS_VolID, &stamp);
+		volume->path_index = path_index_open(volume->image_name, &stamp);
+		if(volume->path_index == NULL) {
+			uint32_t count = build_path_index(volume);
+			path_index_stamp(volume->image_name, volume->bs.BS_VolID, &stamp);
+			if(count) volume->path_index = path_index_open(volume->image_name, &stamp);
+			if(volume->path_index) printf("index: %s.idx: Indexed %u paths\n", volume->image_name, count);
+			else printf("index: %s.idx: Unable to write index\n", volume->image_name);
+		}
+		volume->path_index_writes = volume->block_cache.writes - volume->fsinfo_writes;
+	}
+	return volume;
 }
 
 // Imprime as informações da FAT
-void info() {
+void info(fat32_t* volume) {
 	printf("FAT Filesystem information\n\n");
-	printf("OEM name: %s\n", bs.BS_OEMName);
-	printf("Total sectors: %d\n", bs.BPB_TotSec32);
-	printf("Jump: 0x%X%X%X\n", bs.BS_jmpBoot[0], bs.BS_jmpBoot[1], bs.BS_jmpBoot[2]);
-	printf("Sector size: %d\n", bs.BPB_BytsPerSec);	
-	printf("Sectors per cluster: %d\n", bs.BPB_SecPerClus);
-	printf("Reserved sectors: %d\n", bs.BPB_RsvdSecCnt);
-	printf("Number of fats: %d\n", bs.BPB_NumFATs);
-	printf("Root dir entries: %d\n", bs.BPB_RootEntCnt);
-	printf("Media: 0x%X\n", bs.BPB_Media);
-	printf("Sectors by FAT: %d\n", bs.BPB_FATSz32);
-	printf("Sectors per track: %d\n", bs.BPB_SecPerTrk);
-	printf("Number of heads: %d\n", bs.BPB_NumHeads);
-	printf("Hidden sectors: %d\n", bs.BPB_HiddSec);
-  printf("Drive number: 0x%02X\n", bs.BS_DrvNum);
-  printf("Current head: 0x%02X\n", bs.BS_Reserved1);
-  printf("Boot signature: 0x%02X\n", bs.BS_BootSig);
-  printf("Volume ID: 0x%08X\n", bs.BS_VolID);
+	printf("OEM name: %s\n", volume->bs.BS_OEMName);
+	printf("Total sectors: %d\n", volume->bs.BPB_TotSec32);
+	printf("Jump: 0x%X%X%X\n", volume->bs.BS_jmpBoot[0], volume->bs.BS_jmpBoot[1], volume->bs.BS_jmpBoot[2]);
+	printf("Sector size: %d\n", volume->bs.BPB_BytsPerSec);	
+	printf("Sectors per cluster: %d\n", volume->bs.BPB_SecPerClus);
+	printf("Reserved sectors: %d\n", volume->bs.BPB_RsvdSecCnt);
+	printf("Number of fats: %d\n", volume->bs.BPB_NumFATs);
+	printf("Root dir entries: %d\n", volume->bs.BPB_RootEntCnt);
+	printf("Media: 0x%X\n", volume->bs.BPB_Media);
+	printf("Sectors by FAT: %d\n", volume->bs.BPB_FATSz32);
+	printf("Sectors per track: %d\n", volume->bs.BPB_SecPerTrk);
+	printf("Number of heads: %d\n", volume->bs.BPB_NumHeads);
+	printf("Hidden sectors: %d\n", volume->bs.BPB_HiddSec);
+  printf("Drive number: 0x%02X\n", volume->bs.BS_DrvNum);
+  printf("Current head: 0x%02X\n", volume->bs.BS_Reserved1);
+  printf("Boot signature: 0x%02X\n", volume->bs.BS_BootSig);
+  printf("Volume ID: 0x%08X\n", volume->bs.BS_VolID);
   printf("Volume label: ");
   for(int i = 0; i < 11; i++) {
-    printf("%c", bs.BS_VolLab[i]);
+    printf("%c", volume->bs.BS_VolLab[i]);
   }
   printf("\n");
   printf("Filesystem type: ");
   for(int i = 0; i < 8; i++) {
-    printf("%c", bs.BS_FilSysType[i]);
+    printf("%c", volume->bs.BS_FilSysType[i]);
   }
   printf("\n");
-  printf("BS Signature: 0x%04X\n", bs.BS_Signature);
+  printf("BS Signature: 0x%04X\n", volume->bs.BS_Signature);
 
-	uint64_t fat1_address = bs.BPB_RsvdSecCnt * bs.BPB_BytsPerSec;
-	uint64_t fat2_address = (bs.BPB_RsvdSecCnt + bs.BPB_FATSz32) * bs.BPB_BytsPerSec;
+	uint64_t fat1_address = volume->bs.BPB_RsvdSecCnt * volume->bs.BPB_BytsPerSec;
+	uint64_t fat2_address = (volume->bs.BPB_RsvdSecCnt + volume->bs.BPB_FATSz32) * volume->bs.BPB_BytsPerSec;
 
   printf("FAT1 start address: 0x%016lX\n", fat1_address);
   printf("FAT2 start address: 0x%016lX\n", fat2_address);
-  printf("Data start address: 0x%016lX\n", rootdir_offset);
+  printf("Data start address: 0x%016lX\n", volume->rootdir_offset);
+}
+
+// Percorre a FAT1 do disco em blocos grandes procurando a maior sequência de clusters livres
+// Se free_count não for NULL, conta também os clusters livres na mesma passada
+// Só é usado antes do bitmap ser montado, quando a FAT do disco ainda é a atual
+static void scan_free_space(fat32_t* volume, uint32_t* free_count, uint32_t* largest_start, uint32_t* largest_length) {
+	const fat_kernels_t* kernels = fat_kernels();
+	uint32_t chunk_entries = 256 * 1024;
+	uint32_t* chunk = (uint32_t*) malloc(chunk_entries * sizeof(uint32_t));
+	// Sequência livre que chega até o fim do bloco anterior
+	uint32_t run_start = 0, run_length = 0;
+	*largest_start = 0;
+	*largest_length = 0;
+	if(free_count) *free_count = 0;
+
+	uint32_t count;
+	for(uint32_t first = FIRST_DATA_CLUSTER; first <= volume->allocator.max_cluster; first += count) {
+		count = volume->allocator.max_cluster + 1 - first < chunk_entries ? volume->allocator.max_cluster + 1 - first : chunk_entries;
+		bdev_read(volume->disk, chunk, count * sizeof(uint32_t), get_fat_address(volume, first));
+		if(free_count) *free_count += kernels->count_free(chunk, count);
+
+		// Continua a sequência do bloco anterior
+		uint32_t i = 0;
+		while(i < count && !(chunk[i] & FAT_ENTRY_MASK)) i++;
+		if(run_length == 0) run_start = first;
+		run_length += i;
+		if(i == count) continue;
+		if(run_length > *largest_length) {
+			*largest_start = run_start;
+			*largest_length = run_length;
+		}
+
+		// Dentro do bloco só interessa uma sequência maior que a maior já encontrada
+		while(1) {
+			size_t found = i + kernels->find_free_run(chunk + i, count - i, *largest_length + 1);
+			if(found >= count) break;
+			uint32_t end = found + *largest_length + 1;
+			while(end < count && !(chunk[end] & FAT_ENTRY_MASK)) end++;
+			*largest_start = first + found;
+			*largest_length = end - found;
+			i = end;
+		}
+
+		// Sequência que termina no fim do bloco e pode continuar no próximo
+		run_length = 0;
+		while(run_length < count && !(chunk[count - 1 - run_length] & FAT_ENTRY_MASK)) run_length++;
+		run_start = first + count - run_length;
+	}
+	if(run_length > *largest_length) {
+		*largest_start = run_start;
+		*largest_length = run_length;
+	}
+	free(chunk);
 }
 
-// Coloca todas as entradas de diretorios de uma pasta
-void read_dir() {
-	uint32_t next_cluster = directory_stack->cluster;
-	uint32_t currsec;
+// Imprime o espaço total, usado e livre da imagem e a maior sequência de clusters livres
+// A contagem de livres vem do bitmap se ele já foi montado, senão da FSINFO quando ela for válida;
+// se não for, a contagem sai da varredura da FAT e é gravada de volta na FSINFO
+void df(fat32_t* volume) {
+	uint64_t cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+	uint32_t total = volume->allocator.max_cluster + 1 - FIRST_DATA_CLUSTER;
+	uint32_t free_count, largest_start, largest_length;
+	const char* source;
+
+	if(volume->free_bitmap_loaded) {
+		free_count = allocator_free_count(&volume->allocator);
+		// Nenhuma sequência tem UINT32_MAX clusters, então a busca retorna a maior
+		largest_start = allocator_find_run(&volume->allocator, UINT32_MAX, &largest_length);
+		source = "allocation bitmap";
+	} else if(fsinfo_free_count_is_valid(volume)) {
+		free_count = volume->fs.FSI_Free_Count;
+		scan_free_space(volume, NULL, &largest_start, &largest_length);
+		source = "FSInfo";
+	} else {
+		scan_free_space(volume, &free_count, &largest_start, &largest_length);
+		source = "FAT scan";
+		if(fsinfo_is_valid(volume)) {
+			volume->fs.FSI_Free_Count = free_count;
+			block_cache_write(&volume->block_cache, &volume->fs, sizeof(struct FSInfo), volume->fsinfo_offset);
+			volume->fsinfo_writes++;
+			flush_disk(volume);
+			source = "FAT scan, FSInfo updated";
+		}
+	}
 
+	uint32_t used = total - free_count;
+	printf("Filesystem usage\n\n");
+	printf("Cluster size: %lu bytes\n", cluster_size);
+	printf("Total: %u clusters (%lu bytes)\n", total, total * cluster_size);
+	printf("Used: %u clusters (%lu bytes, %.1f%%)\n", used, used * cluster_size, total ? 100.0 * used / total : 0.0);
+	printf("Free: %u clusters (%lu bytes) [%s]\n", free_count, free_count * cluster_size, source);
+	if(largest_length) printf("Largest free run: %u clusters (%lu bytes) at cluster %u\n", largest_length, largest_length * cluster_size, largest_start);
+	else printf("Largest free run: 0 clusters\n");
+}
 
-	if(directory_stack->entries != NULL) free(directory_stack->entries);
+// Imprime as estatísticas da cache da FAT
+void cache_info(fat32_t* volume) {
+	uint64_t accesses = volume->fat_cache.hits + volume->fat_cache.misses;
+	printf("FAT cache\n\n");
+	printf("Budget: %u pages (%u KiB)\n", volume->fat_cache.max_pages, volume->fat_cache.max_pages * FAT_CACHE_PAGE_SIZE / 1024);
+	printf("Loaded pages: %u of %u\n", volume->fat_cache.loaded_pages, volume->fat_cache.page_count);
+	printf("Hits: %lu\n", volume->fat_cache.hits);
+	printf("Misses: %lu\n", volume->fat_cache.misses);
+	printf("Hit rate: %.2f%%\n", accesses ? 100.0 * volume->fat_cache.hits / accesses : 0.0);
+	printf("Evictions: %lu\n", volume->fat_cache.evictions);
+	printf("Pages written back: %lu\n", volume->fat_cache.writebacks);
+	printf("Scan kernels: %s\n", fat_kernels()->name);
+
+	accesses = volume->extent_maps.hits + volume->extent_maps.misses;
+	printf("\nExtent map cache\n\n");
+	printf("Cached chains: %u of %u\n", volume->extent_maps.map_count, EXTENT_MAP_MAX_MAPS);
+	printf("Hits: %lu\n", volume->extent_maps.hits);
+	printf("Misses: %lu\n", volume->extent_maps.misses);
+	printf("Hit rate: %.2f%%\n", accesses ? 100.0 * volume->extent_maps.hits / accesses : 0.0);
+	printf("Invalidations: %lu\n", volume->extent_maps.invalidations);
+
+	accesses = volume->dir_cache.hits + volume->dir_cache.misses;
+	printf("\nDirectory cache\n\n");
+	printf("Budget: %lu KiB\n", volume->dir_cache.budget / 1024);
+	printf("Cached directories: %u (%lu KiB)\n", volume->dir_cache.entry_count, volume->dir_cache.used_bytes / 1024);
+	printf("Hits: %lu\n", volume->dir_cache.hits);
+	printf("Misses: %lu\n", volume->dir_cache.misses);
+	printf("Hit rate: %.2f%%\n", accesses ? 100.0 * volume->dir_cache.hits / accesses : 0.0);
+	printf("Evictions: %lu\n", volume->dir_cache.evictions);
+
+	printf("\nMetadata block cache\n\n");
+	printf("Dirty sectors: %u (threshold %lu KiB)\n", volume->block_cache.dirty_count, volume->block_cache.threshold / 1024);
+	printf("Buffered writes: %lu\n", volume->block_cache.writes);
+	printf("Flushes: %lu\n", volume->block_cache.flushes);
+	printf("Sectors flushed: %lu in %lu writes\n", volume->block_cache.sectors_flushed, volume->block_cache.device_writes);
+
+	if(volume->journal) {
+		printf("\nJournal\n\n");
+		printf("Commits: %lu\n", volume->journal->commits);
+		printf("Writes journaled: %lu (%lu KiB)\n", volume->journal->records, volume->journal->bytes / 1024);
+		printf("Writes replayed at mount: %lu\n", volume->journal->replayed);
+	}
+}
 
-	int max_dir_entries = 0;
-	int max_dir_entry_per_cluster = bs.BPB_BytsPerSec * bs.BPB_SecPerClus / sizeof(DirEntry);
+// Lê do disco todas as entradas de diretorio da cadeia que começa em cluster
+// A cadeia é resolvida antes pelo mapa de extents, então o buffer é alocado uma vez só
+// e cada sequência de clusters fisicamente vizinhos vira uma única leitura
+DirEntry* load_dir_entries(void* context, uint32_t cluster, uint32_t* quantity) {
+	fat32_t* volume = (fat32_t*) context;
+	uint64_t cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+	extent_map_t* map = extent_map_get(&volume->extent_maps, cluster);
+
+	DirEntry* entries = (DirEntry*) malloc(map->cluster_count * cluster_size);
+	for(uint32_t i = 0; i < map->extent_count; i++) {
+		chain_extent_t* extent = &map->extents[i];
+		uint8_t* destination = (uint8_t*)entries + extent->logical * cluster_size;
+		block_cache_read(&volume->block_cache, destination, extent->length * cluster_size, get_cluster_address(volume, extent->physical));
+	}
 
+	*quantity = map->cluster_count * cluster_size / sizeof(DirEntry);
+	return entries;
+}
 
-	while (next_cluster != END_OF_CHAIN) {
-		currsec = get_cluster_offset(next_cluster);
-		
-		int old_max_dir_entries = max_dir_entries;
-		max_dir_entries += max_dir_entry_per_cluster;
+// Coloca todas as entradas de diretorios de uma pasta, usando a cache de diretórios
+void read_dir(fat32_t* volume) {
+	dir_cache_release(&volume->dir_cache, volume->directory_stack->cached);
 
-		DirEntry* new_dir_entries = (DirEntry*) malloc(max_dir_entries * sizeof(DirEntry));
-		memcpy(new_dir_entries, directory_stack->entries, old_max_dir_entries * sizeof(DirEntry));
-		free(directory_stack->entries);
+	volume->directory_stack->cached = dir_cache_get(&volume->dir_cache, volume->directory_stack->cluster);
+	volume->directory_stack->entries = volume->directory_stack->cached->entries;
+	volume->directory_stack->quantity = volume->directory_stack->cached->quantity;
+}
 
-		directory_stack->entries = new_dir_entries;
+// Procura no índice do diretório atual a entrada com o nome formatado, retorna a posição ou -1
+int32_t find_in_current_dir(fat32_t* volume, char* name) {
+	return dir_index_find(&volume->directory_stack->cached->index, volume->directory_stack->entries, name);
+}
 
-    fseek(disk, currsec * bs.BPB_SecPerClus * bs.BPB_BytsPerSec, SEEK_SET);
-    fread(&directory_stack->entries[old_max_dir_entries], sizeof(DirEntry), max_dir_entry_per_cluster, disk);
+// Procura o nome digitado entre os nomes longos do diretório e, se não achar, como nome 8.3
+// formated recebe o nome 8.3 (primeiro byte 0 se o nome não couber no formato); retorna a posição ou -1
+static int32_t find_entry_by_name(dir_index_t* index, DirEntry* entries, char* user_name, char* formated) {
+	create_formated_name(formated, user_name);
+	int32_t position = dir_index_find_long(index, user_name);
+	if(position < 0 && formated[0]) position = dir_index_find(index, entries, formated);
+	return position;
+}
 
-		next_cluster = get_cluster_info(next_cluster);
-	}
+// Mesma busca no diretório atual
+static int32_t find_named_in_current_dir(fat32_t* volume, char* user_name, char* formated) {
+	return find_entry_by_name(&volume->directory_stack->cached->index, volume->directory_stack->entries, user_name, formated);
+}
 
-	directory_stack->quantity = max_dir_entries;
+// Libera a estrutura de diretório e a referência dela na cache
+void free_directory_struct(fat32_t* volume, directory_t* directory) {
+	dir_cache_release(&volume->dir_cache, directory->cached);
+	free(directory);
 }
 
 // Função para Imprimir a data do sistema com os calculos já feitos
@@ -190,47 +569,140 @@ void print_time(uint16_t time) {
 	printf("%02d:%02d:%02d", hour, minutes, seconds);
 }
 
-// Comando ls para listar arquivos/pastas da pasta atual
-void ls() {
-	printf("CREATEDATE CRT_TIME UPDATEDATE UPD_TIME LSTACCDATE SIZE\t\tNAME\n");
-	// Procura todos os diretorios encontrados na pasta atual através da quantidade de diretorios dentro da pilha da estrutura Dir_stack
-	for(int i = 0; i < directory_stack->quantity; i++) {
-		uint8_t status_byte = directory_stack->entries[i].short_dir.DIR_Name[0];
-		if(status_byte == 0x00) break; 
+// Converte a data e hora atual do computador para o formato binário da FAT
+void get_current_date_time(uint16_t* date, uint16_t* time_value) {
+  time_t t = time(NULL);
+  struct tm *tm = localtime(&t);
+
+  // Converte a data em binário
+  *date = 0;
+  *date |= tm->tm_mday;
+  *date |= (tm->tm_mon + 1) << 5;
+  *date |= (tm->tm_year - 80) << 9;
+
+  // Converte hora em binário
+  *time_value = 0;
+  tm->tm_sec = tm->tm_sec >= 58 ? 58 : tm->tm_sec;
+  *time_value |= (tm->tm_sec) >> 1;
+  *time_value |= (tm->tm_min << 5);
+  *time_value |= (tm->tm_hour << 11);
+}
+
+// Converte o nome 8.3 da entrada em um nome de arquivo do computador (NOME.EXT, sem os espaços)
+static void entry_host_name(char* host_name, DirEntry* entry) {
+	char* name = entry->short_dir.DIR_Name;
+	int length = 0;
+	for(int i = 0; i < 8 && name[i] != 0x20; i++) host_name[length++] = name[i];
+	if(name[8] != 0x20) {
+		host_name[length++] = '.';
+		for(int i = 8; i < 11 && name[i] != 0x20; i++) host_name[length++] = name[i];
+	}
+	host_name[length] = '\0';
+	// 0x05 no primeiro byte guarda um 0xE5 de verdade, e '/' de imagens corrompidas não pode virar subpasta
+	if((uint8_t) host_name[0] == 0x05) host_name[0] = (char) 0xE5;
+	for(int i = 0; i < length; i++)
+		if(host_name[i] == '/') host_name[i] = '_';
+}
+
+// Nome da entrada nos caminhos e na saída dos comandos: o nome longo (long_name) se ela tiver um, senão o 8.3
+// name precisa ter FAT32_NAME_MAX bytes; '/' de imagens corrompidas vira '_', como no entry_host_name
+static void entry_display_name(char* name, DirEntry* entry, const char* long_name) {
+	if(long_name == NULL) {
+		entry_host_name(name, entry);
+		return;
+	}
+	snprintf(name, FAT32_NAME_MAX, "%s", long_name);
+	for(char* c = name; *c; c++)
+		if(*c == '/') *c = '_';
+}
+
+// entry_display_name com o nome longo juntado pelo decoder nas entradas anteriores, para os percursos que leem
+// os diretórios direto do disco (a entrada curta fecha o nome em andamento)
+static void decoded_display_name(char* name, DirEntry* entry, lfn_decoder_t* decoder) {
+	uint32_t length = lfn_finish(decoder, entry->short_dir.DIR_Name);
+	if(length == 0) {
+		entry_host_name(name, entry);
+		return;
+	}
+	lfn_utf16_to_utf8(name, decoder->units, length);
+	for(char* c = name; *c; c++)
+		if(*c == '/') *c = '_';
+}
+
+// Nome do arquivo criado no computador pelo extract: o nome longo, ou o 8.3 se o longo passar do limite
+// de um nome no computador (NAME_MAX bytes; um nome longo da FAT em UTF-8 pode ter até 780)
+static void entry_extract_name(char* name, DirEntry* entry, const char* long_name) {
+	entry_display_name(name, entry, long_name && strlen(long_name) <= NAME_MAX ? long_name : NULL);
+}
+
+// Preenche a entrada vista pela API, long_name é o nome longo da entrada ou NULL
+static void fill_stat(fat32_t* volume, fat32_stat_t* status, DirEntry* entry, const char* long_name) {
+	entry_display_name(status->name, entry, long_name);
+	status->entry = *entry;
+	status->first_cluster = (entry->short_dir.DIR_FstClusHI << 16) | entry->short_dir.DIR_FstClusLO;
+	if(status->first_cluster < FIRST_DATA_CLUSTER && (entry->short_dir.DIR_Attr & ATTR_DIRECTORY)) status->first_cluster = volume->bs.BPB_RootClus;
+	status->size = entry->short_dir.DIR_FileSize;
+	status->attributes = entry->short_dir.DIR_Attr;
+}
+
+// Chama callback para cada entrada do diretório ('.', '..' e o rótulo inclusos, sem as apagadas e as de nome longo)
+// Retorna a quantidade de entradas passadas para o callback
+static int list_entries(fat32_t* volume, dir_cache_entry_t* directory, fat32_list_callback_t callback, void* context) {
+	fat32_stat_t status;
+	int count = 0;
+	for(uint32_t i = 0; i < directory->quantity; i++) {
+		uint8_t status_byte = directory->entries[i].short_dir.DIR_Name[0];
+		if(status_byte == 0x00) break;
 		if(status_byte == 0xE5) continue;
-		if((directory_stack->entries[i].short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) continue;
-
-		// Imprime as informações do arquivo
-		print_date(directory_stack->entries[i].short_dir.DIR_CrtDate);
-		printf(" ");
-		print_time(directory_stack->entries[i].short_dir.DIR_CrtTime);
-		printf(" ");
-		print_date(directory_stack->entries[i].short_dir.DIR_WrtDate);
-		printf(" ");
-		print_time(directory_stack->entries[i].short_dir.DIR_WrtTime);
-		printf(" ");
-		print_date(directory_stack->entries[i].short_dir.DIR_LstAccDate);
-		printf(" %u\t\t", directory_stack->entries[i].short_dir.DIR_FileSize);
-
-		// Verifica se é um diretorio e imprime no ls
-		int is_directory = (directory_stack->entries[i].short_dir.DIR_Attr & (ATTR_DIRECTORY | ATTR_VOLUME_ID)) == ATTR_DIRECTORY ? 1 : 0;
-		if(is_directory) printf("d ");
-		else printf("- ");
-
-		print_name(directory_stack->entries[i].short_dir.DIR_Name);
+		if((directory->entries[i].short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) continue;
 
-		printf("\n");
+		fill_stat(volume, &status, &directory->entries[i], dir_index_long_name(&directory->index, i));
+		count++;
+		if(callback(context, &status)) break;
 	}
+	return count;
+}
+
+// Imprime uma linha do ls
+static int print_ls_entry(void* context, const fat32_stat_t* status) {
+	const struct ShortDirEntry* entry = &status->entry.short_dir;
+	print_date(entry->DIR_CrtDate);
+	printf(" ");
+	print_time(entry->DIR_CrtTime);
+	printf(" ");
+	print_date(entry->DIR_WrtDate);
+	printf(" ");
+	print_time(entry->DIR_WrtTime);
+	printf(" ");
+	print_date(entry->DIR_LstAccDate);
+	printf(" %u\t\t", status->size);
+
+	// Verifica se é um diretorio e imprime no ls
+	int is_directory = (status->attributes & (ATTR_DIRECTORY | ATTR_VOLUME_ID)) == ATTR_DIRECTORY;
+	printf("%s %s\n", is_directory ? "d" : "-", status->name);
+	return 0;
+}
+
+// Comando ls para listar arquivos/pastas da pasta atual
+void ls(fat32_t* volume) {
+	printf("CREATEDATE CRT_TIME UPDATEDATE UPD_TIME LSTACCDATE SIZE\t\tNAME\n");
+	list_entries(volume, volume->directory_stack->cached, print_ls_entry, NULL);
 }
 
 // Exibe informação do cluster com posição passado por parâmetro
-void cluster(int i) {
-  // Procura a posição do cluster
-	fseek(disk, i * bs.BPB_SecPerClus * bs.BPB_BytsPerSec, SEEK_SET);
-	uint32_t cluster_size = bs.BPB_SecPerClus * bs.BPB_BytsPerSec;
-	uint8_t* cluster_data = (uint8_t*) malloc(cluster_size);
-  // Grava as informações do cluster no cluster_data
-	fread(cluster_data, 1, cluster_size, disk);
+void cluster(fat32_t* volume, int i) {
+	// Grava a FAT pendente para que o dump mostre o conteúdo atual
+	flush_disk(volume);
+	uint32_t cluster_size = volume->bs.BPB_SecPerClus * volume->bs.BPB_BytsPerSec;
+	uint64_t cluster_address = (uint64_t)i * cluster_size;
+	uint8_t* buffer = NULL;
+  // Com o backend mmap lê direto do mapeamento, senão copia o cluster para um buffer
+	const uint8_t* cluster_data = bdev_map(volume->disk, cluster_address, cluster_size);
+	if(cluster_data == NULL) {
+		buffer = (uint8_t*) calloc(1, cluster_size);
+		bdev_read(volume->disk, buffer, cluster_size, cluster_address);
+		cluster_data = buffer;
+	}
 
 	int colunas = 16;
 
@@ -241,25 +713,225 @@ void cluster(int i) {
 			printf("%02X ", cluster_data[linha*colunas + coluna]);
 		printf("   ");
 		for(int coluna = 0; coluna < colunas; coluna++) {
-			int currChar = linha*colunas + coluna;
-			cluster_data[currChar] = cluster_data[currChar] != '\n' ? cluster_data[currChar] : ' ';
-			cluster_data[currChar] = cluster_data[currChar] != 0x08 ? cluster_data[currChar] : ' ';
-			cluster_data[currChar] = cluster_data[currChar] != 0x09 ? cluster_data[currChar] : ' ';
-			cluster_data[currChar] = cluster_data[currChar] != 0x0A ? cluster_data[currChar] : ' ';
-			cluster_data[currChar] = cluster_data[currChar] != 0x0B ? cluster_data[currChar] : ' ';
-			cluster_data[currChar] = cluster_data[currChar] != 0x0C ? cluster_data[currChar] : ' ';
-			cluster_data[currChar] = cluster_data[currChar] != 0x0D ? cluster_data[currChar] : ' ';
-			cluster_data[currChar] = cluster_data[currChar] != 0 ? cluster_data[currChar] : '.';
-			printf("%c", cluster_data[currChar]);
+			uint8_t currChar = cluster_data[linha*colunas + coluna];
+			currChar = currChar != '\n' ? currChar : ' ';
+			currChar = currChar != 0x08 ? currChar : ' ';
+			currChar = currChar != 0x09 ? currChar : ' ';
+			currChar = currChar != 0x0A ? currChar : ' ';
+			currChar = currChar != 0x0B ? currChar : ' ';
+			currChar = currChar != 0x0C ? currChar : ' ';
+			currChar = currChar != 0x0D ? currChar : ' ';
+			currChar = currChar != 0 ? currChar : '.';
+			printf("%c", currChar);
 		}
 		printf("\n");
 	}
-	free(cluster_data);
+	free(buffer);
+}
+
+// Imprime o conteúdo do arquivo, seguindo a cadeia até DIR_FileSize
+// Cada sequência contígua de clusters é enviada de uma vez, sem passar por buffer quando a saída permite
+void cat(fat32_t* volume, char* file_name) {
+	char name[11];
+	int32_t position = find_named_in_current_dir(volume, file_name, name);
+	if(position < 0 && !name[0]) {
+		command_error(volume, "cat: %s: Invalid file name\n", file_name);
+		return;
+	}
+	if(position < 0) {
+		command_error(volume, "cat: %s: No such file\n", file_name);
+		return;
+	}
+	struct ShortDirEntry* entry = &volume->directory_stack->entries[position].short_dir;
+	if(entry->DIR_Attr & (ATTR_DIRECTORY | ATTR_VOLUME_ID)) {
+		command_error(volume, "cat: %s: Is a directory\n", file_name);
+		return;
+	}
+
+	uint32_t first_cluster = (entry->DIR_FstClusHI << 16) | entry->DIR_FstClusLO;
+	uint64_t remaining = entry->DIR_FileSize;
+	if(remaining == 0 || first_cluster < FIRST_DATA_CLUSTER) return;
+
+	// As alterações dos comandos anteriores vão para a imagem antes de entregar a saída ao sendfile,
+	// assim uma falha na escrita da saída não perde metadados que já estavam prontos
+	flush_disk(volume);
+	// Os dados pendentes do printf precisam sair antes dos que vão direto para o descritor
+	fflush(stdout);
+
+	uint64_t cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+	extent_map_t* map = extent_map_get(&volume->extent_maps, first_cluster);
+	for(uint32_t i = 0; i < map->extent_count && remaining; i++) {
+		uint64_t extent_bytes = map->extents[i].length * cluster_size;
+		if(extent_bytes > remaining) extent_bytes = remaining;
+		if(bdev_send(volume->disk, fileno(stdout), get_cluster_address(volume, map->extents[i].physical), extent_bytes) < extent_bytes) {
+			command_error(volume, "cat: %s: Write error\n", file_name);
+			return;
+		}
+		remaining -= extent_bytes;
+	}
+}
+
+// dir_cache_get e dir_cache_release para as consultas, que podem rodar juntas com metadata_lock compartilhada
+static dir_cache_entry_t* get_shared_directory(fat32_t* volume, uint32_t cluster) {
+	pthread_mutex_lock(&volume->cache_lock);
+	dir_cache_entry_t* directory = dir_cache_get(&volume->dir_cache, cluster);
+	pthread_mutex_unlock(&volume->cache_lock);
+	return directory;
+}
+
+static void release_shared_directory(fat32_t* volume, dir_cache_entry_t* directory) {
+	pthread_mutex_lock(&volume->cache_lock);
+	dir_cache_release(&volume->dir_cache, directory);
+	pthread_mutex_unlock(&volume->cache_lock);
+}
+
+// Procura component no diretório de *cluster e troca *cluster pelo cluster da entrada encontrada
+// Se name não for NULL, recebe o nome longo ou 8.3 da entrada (FAT32_NAME_MAX bytes)
+// Retorna 0 se o nome for inválido ou não existir
+static int lookup_in_directory(fat32_t* volume, char* component, DirEntry* found, uint32_t* cluster, char* name) {
+	char formated[11];
+	dir_cache_entry_t* directory = get_shared_directory(volume, *cluster);
+	int32_t position;
+	if(!strcmp(component, "..")) position = dir_index_find(&directory->index, directory->entries, "..         ");
+	else position = find_entry_by_name(&directory->index, directory->entries, component, formated);
+	if(position >= 0) {
+		*found = directory->entries[position];
+		if(name) entry_display_name(name, found, dir_index_long_name(&directory->index, position));
+	}
+	release_shared_directory(volume, directory);
+	if(position < 0 || (found->short_dir.DIR_Attr & ATTR_VOLUME_ID)) return 0;
+
+	*cluster = (found->short_dir.DIR_FstClusHI << 16) | found->short_dir.DIR_FstClusLO;
+	if(*cluster < FIRST_DATA_CLUSTER && (found->short_dir.DIR_Attr & ATTR_DIRECTORY)) *cluster = volume->bs.BPB_RootClus;
+	return 1;
+}
+
+// Retorna 1 se o índice de caminhos está aberto e nada mudou na imagem desde então
+int path_index_usable(fat32_t* volume) {
+	return volume->path_index && volume->block_cache.writes - volume->fsinfo_writes == volume->path_index_writes;
+}
+
+// Escreve no buffer (com size bytes) o caminho absoluto do diretório da pilha e retorna o tamanho
+// Um caminho que não cabe é cortado, sem passar do fim do buffer
+static size_t write_stack_path(char* buffer, size_t size, directory_t* directory) {
+	if(directory->previous == NULL) return 0;
+	size_t length = write_stack_path(buffer, size, directory->previous);
+	if(length + 1 >= size) return length;
+	int written = snprintf(buffer + length, size - length, "/%s", directory->name);
+	return written < 0 ? length : length + written >= size ? size - 1 : length + written;
+}
+
+// Monta o caminho absoluto no formato do índice (/Pasta/Arq.txt), resolvendo '.' e '..' pelo texto
+// Caminhos relativos partem do diretório atual; os nomes ficam como foram escritos, a busca no índice
+// não diferencia maiúsculas (liberar com free)
+char* absolute_image_path(fat32_t* volume, char* path) {
+	size_t size = strlen(path) + 2;
+	for(directory_t* directory = volume->directory_stack; directory->previous; directory = directory->previous) size += strlen(directory->name) + 1;
+	char* absolute = (char*) malloc(size);
+	size_t length = path[0] == '/' ? 0 : write_stack_path(absolute, size, volume->directory_stack);
+
+	char* copy = strdup(path);
+	char* save;
+	for(char* component = strtok_r(copy, "/", &save); component; component = strtok_r(NULL, "/", &save)) {
+		if(!strcmp(component, ".")) continue;
+		// O pai da raiz é ela mesma
+		if(!strcmp(component, "..")) {
+			while(length && absolute[length - 1] != '/') length--;
+			if(length) length--;
+			continue;
+		}
+		absolute[length++] = '/';
+		for(char* c = component; *c; c++) absolute[length++] = *c;
+	}
+	free(copy);
+	if(length == 0) absolute[length++] = '/';
+	absolute[length] = '\0';
+	return absolute;
+}
+
+// resolve_image_path pelo índice de caminhos, sem ler nenhum diretório
+static int resolve_indexed_path(fat32_t* volume, char* path, DirEntry* found, uint32_t* cluster, char* name) {
+	char* absolute = absolute_image_path(volume, path);
+	uint32_t record = path_index_lookup(volume->path_index, absolute);
+	free(absolute);
+	if(record == PATH_INDEX_NONE) return 0;
+
+	// O último nome do caminho gravado é o da entrada (a raiz não tem nome)
+	if(name) {
+		const char* indexed_path = path_index_path(volume->path_index, record);
+		snprintf(name, FAT32_NAME_MAX, "%s", strcmp(indexed_path, "/") ? strrchr(indexed_path, '/') + 1 : "");
+	}
+	memcpy(found, volume->path_index->records[record].entry, sizeof(DirEntry));
+	*cluster = (found->short_dir.DIR_FstClusHI << 16) | found->short_dir.DIR_FstClusLO;
+	if(*cluster < FIRST_DATA_CLUSTER && (found->short_dir.DIR_Attr & ATTR_DIRECTORY)) *cluster = volume->bs.BPB_RootClus;
+	return 1;
+}
+
+// cd com um caminho de vários níveis: o caminho inteiro é resolvido antes de trocar a pilha,
+// então um caminho inválido não muda o diretório atual
+// Só o último diretório é lido; com o índice de caminhos, os intermediários nem são procurados nos diretórios
+// (a não ser os que o índice não conhece, como o nome 8.3 de um diretório com nome longo)
+void cd_path(fat32_t* volume, char* path) {
+	char* absolute = absolute_image_path(volume, path);
+	directory_t* root = volume->directory_stack;
+	while(root->previous) root = root->previous;
+
+	// Novo ramo da pilha a partir da raiz
+	directory_t* top = root;
+	uint32_t count = 0;
+	int found = 1;
+	for(char* component = absolute + 1; *component && found;) {
+		char* end = strchr(component, '/');
+		if(end) *end = '\0';
+
+		// A pilha guarda o nome de exibição da entrada (o longo, se existir), como o cd de um nome só
+		DirEntry entry;
+		char name[FAT32_NAME_MAX];
+		uint32_t cluster = top->cluster;
+		uint32_t record = path_index_usable(volume) ? path_index_lookup(volume->path_index, absolute) : PATH_INDEX_NONE;
+		if(record != PATH_INDEX_NONE) {
+			memcpy(&entry, volume->path_index->records[record].entry, sizeof(DirEntry));
+			cluster = (entry.short_dir.DIR_FstClusHI << 16) | entry.short_dir.DIR_FstClusLO;
+			if(cluster < FIRST_DATA_CLUSTER) cluster = volume->bs.BPB_RootClus;
+			snprintf(name, sizeof(name), "%s", strrchr(path_index_path(volume->path_index, record), '/') + 1);
+		} else found = lookup_in_directory(volume, component, &entry, &cluster, name);
+
+		if(found && (entry.short_dir.DIR_Attr & ATTR_DIRECTORY)) {
+			top = create_directory_struct(top, "");
+			snprintf(top->name, sizeof(top->name), "%s", name);
+			top->cluster = cluster;
+			count++;
+		} else found = 0;
+
+		if(end) {
+			*end = '/';
+			component = end + 1;
+		} else component += strlen(component);
+	}
+
+	if(!found) {
+		command_error(volume, "cd: %s: No such directory\n", path);
+		while(top != root) {
+			directory_t* previous = top->previous;
+			free_directory_struct(volume, top);
+			top = previous;
+		}
+	} else {
+		while(volume->directory_stack != root) {
+			directory_t* previous = volume->directory_stack->previous;
+			free_directory_struct(volume, volume->directory_stack);
+			volume->directory_stack = previous;
+		}
+		volume->directory_stack = top;
+		volume->directory_stack_count = count;
+		if(volume->directory_stack->cached == NULL) read_dir(volume);
+	}
+	free(absolute);
 }
 
 // Navegar entre pastas e usado em outros lugares entao criamos esse wrapper para poder ser utilizado por outras funcoes
 // Retorna 1 se conseguiu navegar ate a pasta ou 0 se nao conseguiu
-int cd_wrapper(char* folder, char* command) {
+int cd_wrapper(fat32_t* volume, char* folder, char* command) {
 	// Se a pasta for a atual não faz nada
 	if(!strcmp(folder, ".")) {
 		return 1;
@@ -267,55 +939,47 @@ int cd_wrapper(char* folder, char* command) {
 
 	// Se a pasta for a pasta pai, volta para a pasta pai
 	if(!strcmp(folder, "..")) {
-		if(directory_stack_count == 0) return 1;
-		directory_t* old_directory = directory_stack;
-		directory_stack = directory_stack->previous;
-		directory_stack_count--;
-		free(old_directory);
-		read_dir();
+		if(volume->directory_stack_count == 0) return 1;
+		directory_t* old_directory = volume->directory_stack;
+		volume->directory_stack = volume->directory_stack->previous;
+		volume->directory_stack_count--;
+		// O diretório pai continua em uso na cache, então não precisa ser lido de novo
+		// (menos quando ele foi pulado por um cd com caminho)
+		free_directory_struct(volume, old_directory);
+		if(volume->directory_stack->cached == NULL) read_dir(volume);
 		return 1;
 	}
 
   // Converte o nome de entrada da pasta na função
+  // Procura o diretório no índice, pelo nome longo ou 8.3 (arquivos com o mesmo nome não servem)
 	char folder_name[11];
-	create_formated_name(folder_name, folder);
+	int32_t i = find_named_in_current_dir(volume, folder, folder_name);
   // Verifica a validade do nome
-	if(!folder_name[0]) {
-		printf("%s: %s: Invalid folder name\n", command, folder);
+	if(i < 0 && !folder_name[0]) {
+		command_error(volume, "%s: %s: Invalid folder name\n", command, folder);
 		return 0;
 	}
-
-  // Procura o diretório
-	for(int i = 0; i < directory_stack->quantity; i++) {
-		uint8_t status_byte = directory_stack->entries[i].short_dir.DIR_Name[0];
-    // Se status_byte == 0 significa que acabou as dir_entry
-		if(status_byte == 0x00) break;
-    // Se status_byte == E5 significa que o espaço está livre
-		if(status_byte == 0xE5) continue;
-    // Se for dir de long name ignora
-		if((directory_stack->entries[i].short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) continue;
-    // Se for arquivo ignora
-		if((directory_stack->entries[i].short_dir.DIR_Attr & ATTR_DIRECTORY) != ATTR_DIRECTORY) continue;
-
-    // Se acha o diretório, muda a stack para ele
-		if(!memcmp(folder_name, directory_stack->entries[i].short_dir.DIR_Name, 11)) {
-			directory_t* new_directory = create_directory_struct(directory_stack, directory_stack->entries[i].short_dir.DIR_Name);
-			new_directory->cluster = (directory_stack->entries[i].short_dir.DIR_FstClusHI<<16) | directory_stack->entries[i].short_dir.DIR_FstClusLO;
-			directory_stack = new_directory;
-			directory_stack_count++;
-			read_dir();
-			return 1;
-		}
+	if(i < 0 || (volume->directory_stack->entries[i].short_dir.DIR_Attr & ATTR_DIRECTORY) != ATTR_DIRECTORY) {
+		command_error(volume, "%s: %s: No such directory\n", command, folder);
+		return 0;
 	}
-  // Se não achar, retorna erro
-	printf("%s: %s: No such directory\n", command, folder);
-	return 0;
+
+  // Se acha o diretório, muda a stack para ele
+	directory_t* new_directory = create_directory_struct(volume->directory_stack, volume->directory_stack->entries[i].short_dir.DIR_Name);
+	new_directory->cluster = (volume->directory_stack->entries[i].short_dir.DIR_FstClusHI<<16) | volume->directory_stack->entries[i].short_dir.DIR_FstClusLO;
+	entry_display_name(new_directory->name, &volume->directory_stack->entries[i], dir_index_long_name(&volume->directory_stack->cached->index, i));
+	volume->directory_stack = new_directory;
+	volume->directory_stack_count++;
+	read_dir(volume);
+	return 1;
 }
 
 // Comando do CD
-void cd(char* folder) {
+void cd(fat32_t* volume, char* folder) {
+	// Caminhos com mais de um nível trocam a pilha inteira de uma vez
+	if(strchr(folder, '/')) cd_path(volume, folder);
 	// Usa o wrapper da funcao anterior
-	cd_wrapper(folder, "cd");
+	else cd_wrapper(volume, folder, "cd");
 }
 
 // Função que formata o nome da entrada recebida
@@ -404,42 +1068,30 @@ void pwd_r(int pos, directory_t* curr) {
   // Procura recursivamente até a pasta raiz e vai imprimindo na tela a pasta que está passando atualmente
 	if(pos != 0) {
 		pwd_r(pos-1, curr->previous);
-		printf("/");
-		print_name(curr->name);
+		printf("/%s", curr->name);
 	} 
 }
 
 // Imprime o diretório atual
-void pwd() {
-	if(directory_stack_count) pwd_r(directory_stack_count, directory_stack);
+void pwd(fat32_t* volume) {
+	if(volume->directory_stack_count) pwd_r(volume->directory_stack_count, volume->directory_stack);
 	else printf("/");
 	printf("\n");
 }
 
 // Imprime as informações do arquivo/diretorio
-void attr(char* entry_name) {
+void attr(fat32_t* volume, char* entry_name) {
   //Cria nome formatado
+  // Procura por arquivo/diretório no diretório atual
 	char name[11];
-	create_formated_name(name, entry_name);
-	if(!name[0]) {
-		printf("attr: %s: Invalid file name\n", entry_name);
+	int32_t position = find_named_in_current_dir(volume, entry_name, name);
+	if(position < 0 && !name[0]) {
+		command_error(volume, "attr: %s: Invalid file name\n", entry_name);
 		return;
 	}
-
-  // Procura por arquivo/diretório no diretório atual
-	for(int i = 0; i < directory_stack->quantity; i++) {
-		uint8_t status_byte = directory_stack->entries[i].short_dir.DIR_Name[0];
-		// Se status_byte == 0 significa que acabou as dir_entry
-		if(status_byte == 0x00) break;
-    // Se status_byte == E5 significa que o espaço está livre
-		if(status_byte == 0xE5) continue;
-    // Se for dir de long name ignora
-		if((directory_stack->entries[i].short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) continue;
-    // Se não for o arquivo/diretório, ignora
-		if(memcmp(name, directory_stack->entries[i].short_dir.DIR_Name, 11)) continue;
-
+	if(position >= 0) {
     // Imprime as informações do arquivo/diretório
-		DirEntry file  = directory_stack->entries[i];
+		DirEntry file  = volume->directory_stack->entries[position];
 		printf("Name = ");
 		for (int i = 0; i < 8; i++) {
 			printf("%c", file.short_dir.DIR_Name[i]);
@@ -481,31 +1133,47 @@ void attr(char* entry_name) {
 		return;
 	}
 
-	printf("attr: %s: No such file or directory\n",entry_name);
+	command_error(volume, "attr: %s: No such file or directory\n",entry_name);
 }
 
 // Pega a posição de entrada no disco
-uint32_t get_entry_disk_position(uint32_t cluster, int entry_pos) {
+uint64_t get_entry_disk_position(fat32_t* volume, uint32_t cluster, int entry_pos) {
   // Calcula offset partindo do cluster inicial para a posição
-	uint32_t offset_from_cluster_begining = (entry_pos  * sizeof(DirEntry))  % (bs.BPB_BytsPerSec * bs.BPB_SecPerClus);
+	uint32_t offset_from_cluster_begining = (entry_pos  * sizeof(DirEntry))  % (volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus);
   // Calcula o cluster que está o dir_entry
-	uint32_t file_cluster = (entry_pos  * sizeof(DirEntry)) / (bs.BPB_BytsPerSec * bs.BPB_SecPerClus);
+	uint32_t file_cluster = (entry_pos  * sizeof(DirEntry)) / (volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus);
 
-	for(int i = 0; i < file_cluster; i++)
-		cluster = get_cluster_info(cluster);
+	// Acha o cluster com busca binária no mapa de extents em vez de andar na cadeia
+	cluster = get_chain_cluster(volume, cluster, file_cluster);
 
   // Retorna a posição de entrada no disco
-	return get_cluster_offset(cluster) * bs.BPB_SecPerClus * bs.BPB_BytsPerSec + offset_from_cluster_begining;
+	return get_cluster_address(volume, cluster) + offset_from_cluster_begining;
+}
+
+// Marca como livres as entradas de nome longo que precedem a entrada do diretório atual (as que têm o checksum do nome curto dela)
+static void remove_long_name_entries(fat32_t* volume, int32_t entry_pos) {
+	uint8_t checksum = lfn_checksum(volume->directory_stack->entries[entry_pos].short_dir.DIR_Name);
+	for(int32_t i = entry_pos - 1; i >= 0; i--) {
+		struct LongDirEntry* long_dir = &volume->directory_stack->entries[i].long_dir;
+		if(long_dir->LDIR_Ord == AVAILABLE_ENTRY_POINTER || (long_dir->LDIR_Attr & ATTR_LONG_NAME_MASK) != ATTR_LONG_NAME ||
+			long_dir->LDIR_Chksum != checksum) break;
+		uint8_t ordinal = long_dir->LDIR_Ord;
+		dir_index_remove(&volume->directory_stack->cached->index, volume->directory_stack->entries, i);
+		long_dir->LDIR_Ord = AVAILABLE_ENTRY_POINTER;
+		block_cache_write(&volume->block_cache, &AVAILABLE_ENTRY_POINTER, 1, get_entry_disk_position(volume, volume->directory_stack->cluster, i));
+		// A entrada com o bit de última é a primeira do nome no disco
+		if(ordinal & LFN_LAST_ENTRY) break;
+	}
 }
 
 // Renomeia o arquivo/diretório
-void rename_dir_entry(char* entry_name, char* new_name) {
+void rename_dir_entry(fat32_t* volume, char* entry_name, char* new_name) {
 	char old_entry_name[11];
-  // Formata o nome antigo
-	create_formated_name(old_entry_name, entry_name);
+  // Procura a entrada antiga pelo nome longo ou 8.3
+	int32_t entry_pos = find_named_in_current_dir(volume, entry_name, old_entry_name);
   // Verifica se nome é valido
-	if(!old_entry_name[0]) {
-		printf("rename: %s: Invalid entry name\n", entry_name);
+	if(entry_pos < 0 && !old_entry_name[0]) {
+		command_error(volume, "rename: %s: Invalid entry name\n", entry_name);
 		return;
 	}
 		
@@ -514,364 +1182,306 @@ void rename_dir_entry(char* entry_name, char* new_name) {
 	create_formated_name(new_entry_name, new_name);
   // Verifica se nome é valido
 	if(!new_entry_name[0]) {
-		printf("rename: %s: Invalid new name\n", new_name);
+		command_error(volume, "rename: %s: Invalid new name\n", new_name);
 		return;
 	}
 
-  // Se os nomes são iguais, retorna
-	if(!memcmp(old_entry_name, new_entry_name, 11)) return;
+  // Se a entrada antiga não existir retorna com erro
+	if(entry_pos < 0) {
+		command_error(volume, "rename: '%s': No such file or directory\n", entry_name);
+		return;
+	}
 
-	int entry_pos = -1;
+  // Se o nome não muda, retorna; com o mesmo nome curto, um nome longo diferente do pedido ainda precisa
+  // sair (rename ReadMe.md README.MD), senão o nome exibido continuaria o antigo
+	const char* long_name = dir_index_long_name(&volume->directory_stack->cached->index, entry_pos);
+	int same_short_name = !memcmp(volume->directory_stack->entries[entry_pos].short_dir.DIR_Name, new_entry_name, 11);
+	if(long_name ? !strcmp(long_name, new_name) : same_short_name) return;
 
-  // Procura por diretório que possui o mesmo nome
-	for(int i = 0; i < directory_stack->quantity; i++) {
-		uint8_t status_byte = directory_stack->entries[i].short_dir.DIR_Name[0];
-    // Se status_byte == E5 significa que o espaço está livre
-		if(status_byte == 0xE5) continue;
-    // Se for dir de long name ignora
-		if((directory_stack->entries[i].short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) continue;
-		
-    // Se acabou de ler o diretório e não encontrou o diretório antigo, retorna com erro
-		if(status_byte == 0x00 && entry_pos == -1) {
-			printf("rename: '%s': No such file or directory\n", entry_name);
-			return;
-		};
+  // Se o novo nome já existir em outra entrada, retorna com erro
+	if(!same_short_name && find_in_current_dir(volume, new_entry_name) >= 0) {
+		command_error(volume, "rename: '%s': Already exists\n", new_name);
+		return;
+	}
 
-    // Se achou o diretório antigo guarda a informação da posição dele
-		if(!memcmp(old_entry_name, directory_stack->entries[i].short_dir.DIR_Name, 11)) {
-			entry_pos = i;
-		};
+  // Pega a data e hora atual do computador no formato da FAT
+  uint16_t date, time;
+  get_current_date_time(&date, &time);
 
-    // Se o novo nome já existir, retorna com erro
-		if(!memcmp(new_entry_name, directory_stack->entries[i].short_dir.DIR_Name, 11)) {
-			printf("rename: '%s': Already exists\n", new_name);
-			return;
-		}
-	}
+  // O nome longo antigo não vale para o novo nome curto (o checksum muda), então as entradas dele são liberadas
+	remove_long_name_entries(volume, entry_pos);
 
-  // Pega a data atual do computador
-  time_t t = time(NULL);
-  struct tm *tm = localtime(&t);
+  // Atualiza nome e data de escrita do arquivo, tirando o nome antigo do índice antes
+	dir_index_remove(&volume->directory_stack->cached->index, volume->directory_stack->entries, entry_pos);
+	memcpy(volume->directory_stack->entries[entry_pos].short_dir.DIR_Name, new_entry_name, 11);
+  volume->directory_stack->entries[entry_pos].short_dir.DIR_WrtDate = date;
+  volume->directory_stack->entries[entry_pos].short_dir.DIR_WrtTime = time;
+	dir_index_add(&volume->directory_stack->cached->index, volume->directory_stack->entries, entry_pos);
 
-  // Converte a data em binário
-  uint16_t date = 0;
-  date |= tm->tm_mday;
-  date |= (tm->tm_mon + 1) << 5;
-  date |= (tm->tm_year - 80) << 9;
+  // Copia para a memória
+  block_cache_write(&volume->block_cache, &volume->directory_stack->entries[entry_pos], sizeof(DirEntry), get_entry_disk_position(volume, volume->directory_stack->cluster, entry_pos));
 
-  // Converte hora em binário
-  uint16_t time = 0;
-  tm->tm_sec = tm->tm_sec >= 58 ? 58 : tm->tm_sec;
-  time |= (tm->tm_sec) >> 1;
-  time |= (tm->tm_min << 5);
-  time |= (tm->tm_hour << 11);
+}
 
-  // Atualiza nome e data de escrita do arquivo
-	memcpy(directory_stack->entries[entry_pos].short_dir.DIR_Name, new_entry_name, 11);
-  directory_stack->entries[entry_pos].short_dir.DIR_WrtDate = date;
-  directory_stack->entries[entry_pos].short_dir.DIR_WrtTime = time;
+// Marca a entrada do diretório atual como livre e, se free_clusters, libera a cadeia dela
+void remove_dir_entry(fat32_t* volume, int32_t entry_pos, int free_clusters) {
+	remove_long_name_entries(volume, entry_pos);
+  // Tira do índice (enquanto o nome ainda é o original), limpa o ponteiro da pasta e marca como livre
+	dir_index_remove(&volume->directory_stack->cached->index, volume->directory_stack->entries, entry_pos);
+	volume->directory_stack->entries[entry_pos].short_dir.DIR_Name[0] = AVAILABLE_ENTRY_POINTER;
 
-  // Copia para a memória
-  fseek(disk, get_entry_disk_position(directory_stack->cluster, entry_pos), SEEK_SET);
-	fwrite(&directory_stack->entries[entry_pos], sizeof(DirEntry), 1, disk);
+  // Marca arquivo/pasta como livre no disco
+	block_cache_write(&volume->block_cache, &AVAILABLE_ENTRY_POINTER, 1, get_entry_disk_position(volume, volume->directory_stack->cluster, entry_pos));
 
+  // Libera a cadeia de clusters da entrada
+	if(free_clusters) free_chain(volume, (volume->directory_stack->entries[entry_pos].short_dir.DIR_FstClusHI<<16) | volume->directory_stack->entries[entry_pos].short_dir.DIR_FstClusLO);
 }
 
-// Remove o diretóro com entry_name e, se existir, com flag de verificação se é pasta
-void rm_wrapped(char* entry_name, int is_folder) {
+// Tipos de entrada que remove_entry aceita remover
+#define REMOVE_FILE 0x1
+#define REMOVE_DIRECTORY 0x2
+
+// Retorna 1 se o diretório do cluster está na pilha do diretório atual
+static int directory_in_stack(fat32_t* volume, uint32_t cluster) {
+	for(directory_t* directory = volume->directory_stack; directory; directory = directory->previous)
+		if(directory->cluster == cluster) return 1;
+	return 0;
+}
+
+// Remove a entrada com entry_name do diretório atual, se ela for de um dos tipos em kinds
+// Diretórios só são removidos vazios; retorna FAT32_OK ou o código do erro
+static int remove_entry(fat32_t* volume, char* entry_name, int kinds) {
+	// '.' e '..' não são entradas que possam ser removidas
+	if(!strcmp(entry_name, ".") || !strcmp(entry_name, "..")) return FAT32_EINVAL;
+
 	char rm_entry_name[11];
-  // Cria nome formatado da entry_name
-	create_formated_name(rm_entry_name, entry_name);
-  
-  // Se entry_name está inválido retorna com erro
-	if(!rm_entry_name[0]) {
-		if(is_folder) printf("rmdir");
-		else printf("rm");
-		printf(": %s: Invalid entry name\n", entry_name);
-		return;
+  // Procura entrada com mesmo nome (longo ou 8.3) no diretório
+	int32_t entry_pos = find_named_in_current_dir(volume, entry_name, rm_entry_name);
+	if(entry_pos < 0) return rm_entry_name[0] ? FAT32_ENOENT : FAT32_EINVAL;
+
+	DirEntry* entry = &volume->directory_stack->entries[entry_pos];
+	int is_folder = (entry->short_dir.DIR_Attr & ATTR_DIRECTORY) == ATTR_DIRECTORY;
+	if(is_folder && !(kinds & REMOVE_DIRECTORY)) return FAT32_EISDIR;
+	if(!is_folder && !(kinds & REMOVE_FILE)) return FAT32_ENOTDIR;
+
+	if(is_folder) {
+		// O índice do subdiretório já conta as entradas vivas, só pode ter duas (. e ..)
+		uint32_t subdir_cluster = (entry->short_dir.DIR_FstClusHI<<16) | entry->short_dir.DIR_FstClusLO;
+		dir_cache_entry_t* subdir = dir_cache_get(&volume->dir_cache, subdir_cluster);
+		uint32_t total_entries = subdir->index.count;
+		dir_cache_release(&volume->dir_cache, subdir);
+		if(total_entries > 2) return FAT32_ENOTEMPTY;
+		// Um diretório da pilha (um ancestral do atual, pela API) continuaria sendo usado depois de liberado
+		if(directory_in_stack(volume, subdir_cluster)) return FAT32_EBUSY;
 	}
 
-  // Procura entrada com mesmo nome no diretório
-	for(int entry_pos = 0; entry_pos < directory_stack->quantity; entry_pos++) {
-		uint8_t status_byte = directory_stack->entries[entry_pos].short_dir.DIR_Name[0];
-    // Se status_byte == E5 significa que o espaço está livre
-		if(status_byte == 0xE5) continue;
-    // Se for dir de long name ignora
-		if((directory_stack->entries[entry_pos].short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) continue;
-		
-    // Se não possui mais entradas no diretório, retorna com erro
-		if(status_byte == 0x00) {
-			if(is_folder) printf("rmdir");
-			else printf("rm");
-			printf(": '%s': No such file\n", entry_name);
-			return;
-		};
-
-    // Se achou o arquivo e 
-		if(!memcmp(rm_entry_name, directory_stack->entries[entry_pos].short_dir.DIR_Name, 11)) {
-      // Se não existir flag de pasta e estar tentando remover uma, retorna com erro
-			if((directory_stack->entries[entry_pos].short_dir.DIR_Attr & ATTR_DIRECTORY) == ATTR_DIRECTORY && !is_folder) {
-				printf("rm: '%s': Can't remove a folder\n", entry_name);
-				return;
-			};
-      // Se existir flag de pasta e estar tentando remover um arquivo, retorna com erro
-			if((directory_stack->entries[entry_pos].short_dir.DIR_Attr & ATTR_DIRECTORY) != ATTR_DIRECTORY && is_folder) {
-				printf("rmdir: '%s': Can't remove a file\n", entry_name);
-				return;
-			};
-
-      // Limpa o ponteiro da pasta e marca como livre
-			directory_stack->entries[entry_pos].short_dir.DIR_Name[0] = AVAILABLE_ENTRY_POINTER;
-
-      // Procura a posição da dir_entry para atualização na memória
-			fseek(disk, get_entry_disk_position(directory_stack->cluster, entry_pos), SEEK_SET);
-      // Marca arquivo/pasta como livre
-			fwrite(&AVAILABLE_ENTRY_POINTER, 1, 1, disk);
-
-			uint32_t next_cluster = 0;
-      uint32_t curr_cluster = (directory_stack->entries[entry_pos].short_dir.DIR_FstClusHI<<16) | directory_stack->entries[entry_pos].short_dir.DIR_FstClusLO;
-			// Vai andando na cadeia da FAT e marcando como livre
-			while (next_cluster != END_OF_CHAIN) {
-				next_cluster = get_cluster_info(curr_cluster);
-				write_in_fat(curr_cluster, &FREE_CLUSTER_POINTER);
-				curr_cluster = next_cluster;
-			}
+	remove_dir_entry(volume, entry_pos, 1);
+	return FAT32_OK;
+}
 
-			return;
-		};
-	}
+// Remove o diretóro com entry_name e, se existir, com flag de verificação se é pasta
+void rm_wrapped(fat32_t* volume, char* entry_name, int is_folder) {
+	char* command_name = is_folder ? "rmdir" : "rm";
+	int result = remove_entry(volume, entry_name, is_folder ? REMOVE_DIRECTORY : REMOVE_FILE);
+	if(result == FAT32_EINVAL) command_error(volume, "%s: %s: Invalid entry name\n", command_name, entry_name);
+	else if(result == FAT32_ENOENT) command_error(volume, "%s: '%s': No such file\n", command_name, entry_name);
+	else if(result == FAT32_EISDIR) command_error(volume, "rm: '%s': Can't remove a folder\n", entry_name);
+	else if(result == FAT32_ENOTDIR) command_error(volume, "rmdir: '%s': Can't remove a file\n", entry_name);
+	else if(result != FAT32_OK) command_error(volume, "%s: '%s': %s\n", command_name, entry_name, fat32_strerror(result));
 }
 
 // Chama a função de remover genérica passando flag de arquivo
-void rm(char* entry_name) {
-	rm_wrapped(entry_name, 0);
+void rm(fat32_t* volume, char* entry_name) {
+	rm_wrapped(volume, entry_name, 0);
 }
 
 // Chama a função de remover genérica passando a flag de diretório
-void rmdir(char* entry_name) {
-	char rm_entry_name[11];
+void rmdir(fat32_t* volume, char* entry_name) {
+	rm_wrapped(volume, entry_name, 1);
+}
 
-  //Cria nome formatado e valida o mesmo
-	create_formated_name(rm_entry_name, entry_name);
-	if(!rm_entry_name[0]) {
-		printf("rmdir: %s: Invalid entry name\n", entry_name);
-		return;
+// Encadeia na FAT as sequências de clusters, uma depois da outra, terminando com fim de cadeia
+void link_extents(fat32_t* volume, extent_t* extents, uint32_t extent_count) {
+	for(uint32_t i = 0; i < extent_count; i++) {
+		for(uint32_t j = 0; j < extents[i].length; j++) {
+			uint32_t curr_cluster = extents[i].start + j;
+			uint32_t next_cluster;
+			if(j + 1 < extents[i].length) next_cluster = curr_cluster + 1;
+			else if(i + 1 < extent_count) next_cluster = extents[i + 1].start;
+			else next_cluster = END_OF_CHAIN;
+			write_in_fat(volume, curr_cluster, &next_cluster);
+		}
 	}
+}
 
-	// Procura entrada com mesmo nome no diretório
-	for(int entry_pos = 0; entry_pos < directory_stack->quantity; entry_pos++) {
-		uint8_t status_byte = directory_stack->entries[entry_pos].short_dir.DIR_Name[0];
-    // Se status_byte == E5 significa que o espaço está livre
-		if(status_byte == 0xE5) continue;
-    // Se for dir de long name ignora
-		if((directory_stack->entries[entry_pos].short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) continue;
-		
-    // Se não existir diretório com o nome e não existir mais entradas, retorna com erro
-		if(status_byte == 0x00) {
-			printf("rmdir: '%s': No such file\n", entry_name);
-			return;
-		};
-
-    // Se a entrada da fun
-		if(!memcmp(rm_entry_name, directory_stack->entries[entry_pos].short_dir.DIR_Name, 11)) {
-			if((directory_stack->entries[entry_pos].short_dir.DIR_Attr & ATTR_DIRECTORY) != ATTR_DIRECTORY) {
-				printf("rmdir: '%s': Can't remove a file\n", entry_name);
-				return;
-			};
-
-			// Contar quantas entries estão num diretório
-			cd(entry_name);
-			int total_entries = 0;
-			for(int entry = 0; entry < directory_stack->quantity; entry++) {
-				uint8_t subdir_entry_status_byte = directory_stack->entries[entry].short_dir.DIR_Name[0];
-        // Se status_byte == 0 significa que acabou as dir_entry
-        if(subdir_entry_status_byte == 0x00) break;
-        // Se status_byte == E5 significa que o espaço está livre
-        if(subdir_entry_status_byte == 0xE5) continue;
-        // Se for dir de long name ignora
-        if((directory_stack->entries[entry].short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) continue;
-				
-				
-				// Só pode ter duas entradas no diretório (. e ..)
-				if(++total_entries > 2) {
-					printf("rmdir: '%s': Directory not empty\n", entry_name);
-					cd("..");
-					return;
-				}
-			};
-			
-			cd("..");
-
-			break;
-		};
+// Reserva cluster_count clusters no menor espaço contíguo que comporte todos
+// Se não existir, usa as maiores sequências livres para gerar o menor número de pedaços
+// Os clusters ficam marcados como usados no bitmap, mas a FAT não é alterada (quem chama encadeia)
+// Retorna um vetor alocado com as sequências (liberar com free) ou NULL se não houver espaço
+extent_t* reserve_extents(fat32_t* volume, uint32_t cluster_count, uint32_t* extent_count) {
+	*extent_count = 0;
+	build_free_bitmap(volume);
+	if(cluster_count == 0 || volume->allocator.free_count < cluster_count) return NULL;
+
+	uint32_t capacity = 4;
+	extent_t* extents = (extent_t*) malloc(capacity * sizeof(extent_t));
+
+	uint32_t remaining = cluster_count;
+	while(remaining) {
+		uint32_t run_length;
+		uint32_t run_start = allocator_find_run(&volume->allocator, remaining, &run_length);
+		if(run_length > remaining) run_length = remaining;
+
+		// Marca como usado para a próxima busca não retornar a mesma sequência
+		for(uint32_t i = 0; i < run_length; i++) allocator_mark_used(&volume->allocator, run_start + i);
+
+		if(*extent_count == capacity) {
+			capacity *= 2;
+			extents = (extent_t*) realloc(extents, capacity * sizeof(extent_t));
+		}
+		extents[*extent_count].start = run_start;
+		extents[*extent_count].length = run_length;
+		(*extent_count)++;
+		remaining -= run_length;
 	}
 
-	rm_wrapped(entry_name, 1);
+	volume->allocator.next_free = extents[*extent_count - 1].start + extents[*extent_count - 1].length;
+	return extents;
 }
 
-// Funcao recursiva que aloca na tabela FAT o espaco preciso
-uint32_t allocate_clusters_wrapped(uint32_t cluster_count, uint32_t last_cluster) {
-	uint32_t status;
-
-	// Calcula a quantidade de endereços da fat
-	uint32_t fat_addresses = bs.BPB_TotSec32 - (bs.BPB_RsvdSecCnt + (2 * bs.BPB_FATSz32));
+// Aloca cluster_count clusters (como reserve_extents) já encadeados na FAT em uma única cadeia
+extent_t* allocate_extents(fat32_t* volume, uint32_t cluster_count, uint32_t* extent_count) {
+	extent_t* extents = reserve_extents(volume, cluster_count, extent_count);
+	if(extents) link_extents(volume, extents, *extent_count);
+	return extents;
+}
 
-	// Procura entre os clusters da fat o cluster que está livre
-	for(uint32_t i = last_cluster; i < fat_addresses; i++) {
-		status = get_cluster_info(i);
-		
-		// Se encontra o cluster livre, ele marca a posicao do proximo cluster 
-		//que ele achar recursivamente ou marca como fim de cadeia
-		if(status == FREE_CLUSTER) {
-			uint32_t next_in_chain = cluster_count-1 ? allocate_clusters_wrapped(cluster_count-1, i+1) : END_OF_CHAIN;
-      write_in_fat(i, &next_in_chain);
-			return i;
-		}
+// Aloca na tabela FAT uma cadeia de cluster_count clusters livres
+// Um cluster sai direto da dica de próximo livre, mais de um usa a alocação por sequências contíguas
+// Retorna o primeiro cluster da cadeia ou FREE_CLUSTER se não houver espaço
+uint32_t allocate_clusters(fat32_t* volume, uint32_t cluster_count) {
+	build_free_bitmap(volume);
+	if(cluster_count == 0 || volume->allocator.free_count < cluster_count) return FREE_CLUSTER;
+
+	if(cluster_count == 1) {
+		uint32_t cluster = allocator_find_free(&volume->allocator, volume->allocator.next_free);
+		uint32_t end_of_chain = END_OF_CHAIN;
+		write_in_fat(volume, cluster, &end_of_chain);
+		volume->allocator.next_free = cluster + 1;
+		return cluster;
 	}
-  return FREE_CLUSTER;
+
+	uint32_t extent_count;
+	extent_t* extents = allocate_extents(volume, cluster_count, &extent_count);
+	uint32_t chain_start = extents[0].start;
+	free(extents);
+	return chain_start;
 }
 
-// Chama a função para alocar clusters
-uint32_t allocate_clusters(uint32_t cluster_count) {
-	return allocate_clusters_wrapped(cluster_count, 2);
+// Libera na FAT todos os clusters da cadeia
+void free_chain(fat32_t* volume, uint32_t chain_start) {
+	uint32_t next_cluster = 0;
+	uint32_t curr_cluster = chain_start;
+	// Vai andando na cadeia da FAT e marcando como livre
+	// Se a cadeia era de um diretório ele não pode continuar na cache
+	dir_cache_drop(&volume->dir_cache, chain_start);
+	while (next_cluster != END_OF_CHAIN && curr_cluster >= FIRST_DATA_CLUSTER) {
+		next_cluster = get_cluster_info(volume, curr_cluster);
+		write_in_fat(volume, curr_cluster, &FREE_CLUSTER_POINTER);
+		curr_cluster = next_cluster;
+	}
 }
 
 // Procura o último cluster na cadeia
-uint32_t get_last_cluster_in_chain(uint32_t chain_start) {
-	// Pega o cluster inicial e utiliza para busca
-	uint32_t next_cluster = get_cluster_info(chain_start);
-	uint32_t curr_cluster = chain_start;
-	// Procura o cluster final através da flag END_OF_CHAIN
-	while (next_cluster != END_OF_CHAIN) {
-    curr_cluster = next_cluster;
-    next_cluster = get_cluster_info(next_cluster);
-  }
-  // Retorna último cluster
-  return curr_cluster;
+uint32_t get_last_cluster_in_chain(fat32_t* volume, uint32_t chain_start) {
+	// O último cluster é o fim do último extent do mapa da cadeia
+	extent_map_t* map = extent_map_get(&volume->extent_maps, chain_start);
+	if(map->extent_count == 0) return chain_start;
+	chain_extent_t* last = &map->extents[map->extent_count - 1];
+  return last->physical + last->length - 1;
 }
 
-// Função genérica para criaçao de arquivos/diretórios com parametro de nome do arquivo/pasta e flag
-int touch_wrapper(char* file_name, uint8_t attr, DirEntry* created_entry) {
-	
-  // Procura o comando certo para tratar erros de acordo com a flag passada
-	char command_name[6] = { 0 };
-	if(created_entry != NULL) strcpy(command_name, "mv");
-	else if(attr == ATTR_ARCHIVE) strcpy(command_name, "touch");
-	else if(attr == ATTR_DIRECTORY) strcpy(command_name, "mkdir");
-	else return 0;
+// Função genérica para criaçao de arquivos/diretórios no diretório atual com parametro de nome do arquivo/pasta e flag
+// Se created_entry for passada ela é copiada para o diretório no lugar de uma entrada nova
+// Retorna FAT32_OK ou o código do erro
+static int create_entry(fat32_t* volume, char* file_name, uint8_t attr, DirEntry* created_entry) {
 
 	char new_entry_name[11];
   // Cria nome formatado da entrada e valida
 	create_formated_name(new_entry_name, file_name);
-	if(!new_entry_name[0]) {
-		printf("%s: %s: Invalid name\n", command_name, file_name);
-		return 0;
-	}
+	if(!new_entry_name[0]) return FAT32_EINVAL;
 
-	int entry_pos = -1;
+  // Se já existe arquivo/diretório com nome, retorna com erro
+	if(find_in_current_dir(volume, new_entry_name) >= 0) return FAT32_EEXIST;
 
-  // Procura nos diretórios do diretório atual
-	for(int i = 0; i < directory_stack->quantity; i++) {
-		uint8_t status_byte = directory_stack->entries[i].short_dir.DIR_Name[0];
-    // Se for dir de long name, ignora
-		if((directory_stack->entries[i].short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) continue;
-		
-    // Se não existe mais entradas, sai do for
-		if(status_byte == 0x00) {
-			if(entry_pos == -1) entry_pos = i;
-			break;
-		};
-
-    // Se achou espaço livre no diretório, guarda a posição e continua a busca
-		if(status_byte == 0xE5 && entry_pos == -1) {
-			entry_pos = i;
-			continue;
-		}
-
-    // Se já existe arquivo/diretório com nome, retorna com erro
-		if(!memcmp(new_entry_name, directory_stack->entries[i].short_dir.DIR_Name, 11)) {
-			printf("%s: '%s': Already exists\n", command_name, file_name);
-			return 0;
-		}
-	}
+  // O índice guarda a primeira posição livre, se o diretório estiver cheio precisa de mais um cluster
+	dir_index_t* name_index = &volume->directory_stack->cached->index;
+	int entry_pos = name_index->first_free < volume->directory_stack->quantity ? (int) name_index->first_free : -1;
   
 	uint32_t new_entry_cluster;
 	
 	if(created_entry == NULL) {
 		// Procura novo cluster para alocar
-		new_entry_cluster = allocate_clusters(1);
+		new_entry_cluster = allocate_clusters(volume, 1);
 
 		// Se cluster não possuir local para alocar, retorna com erro
-		if(new_entry_cluster == FREE_CLUSTER) {
-			printf("%s: '%s': Unable to alocate new cluster, disk is full?\n", command_name, file_name);
-			return 0;
-		}
+		if(new_entry_cluster == FREE_CLUSTER) return FAT32_ENOSPC;
 	}
 
   // Se não tiver espaço, aloca novo cluster na fat
 	if(entry_pos == -1) {
 	// Pega o último cluster na cadeia
-    uint32_t last_cluster_currfolder = get_last_cluster_in_chain(directory_stack->cluster);
-    uint32_t extra_entries_start = allocate_clusters(1);
+    uint32_t last_cluster_currfolder = get_last_cluster_in_chain(volume, volume->directory_stack->cluster);
+    uint32_t extra_entries_start = allocate_clusters(volume, 1);
 
-    entry_pos = directory_stack->quantity;
+    entry_pos = volume->directory_stack->quantity;
 
 		// Se não conseguir alocar mais um cluster para o diretório retorna um erro e libera o cluster alocado pelo arquivo gerado do touch.
     if(extra_entries_start == FREE_CLUSTER) {
-			printf("%s: '%s': Unable to alocate new cluster, disk is full?\n", command_name, file_name);
-			if(created_entry == NULL) {
-				uint32_t address_to_free_cluster = get_cluster_offset(new_entry_cluster);
-				uint32_t free = FREE_CLUSTER;
-				write_in_fat(address_to_free_cluster, &free);
-			}
-      return 0;
+			if(created_entry == NULL) write_in_fat(volume, new_entry_cluster, &FREE_CLUSTER_POINTER);
+      return FAT32_ENOSPC;
     }
 
-    write_in_fat(last_cluster_currfolder, &extra_entries_start);
-
-    read_dir();
-	}
+    write_in_fat(volume, last_cluster_currfolder, &extra_entries_start);
 
-  // Pega a data atual do computador
-  time_t t = time(NULL);
-  struct tm *tm = localtime(&t);
+		// Zera o novo cluster no disco e aumenta o diretório na cache sem ler tudo de novo
+		uint32_t cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+		uint8_t* zeros = (uint8_t*) calloc(1, cluster_size);
+		block_cache_write(&volume->block_cache, zeros, cluster_size, get_cluster_address(volume, extra_entries_start));
+		free(zeros);
 
-  // Converte a data em binário
-  uint16_t date = 0;
-  date |= tm->tm_mday;
-  date |= (tm->tm_mon + 1) << 5;
-  date |= (tm->tm_year - 80) << 9;
+		dir_cache_resize(&volume->dir_cache, volume->directory_stack->cached, volume->directory_stack->quantity + cluster_size / sizeof(DirEntry));
+		volume->directory_stack->entries = volume->directory_stack->cached->entries;
+		volume->directory_stack->quantity = volume->directory_stack->cached->quantity;
+	}
 
-  // Converte hora em binário
-  uint16_t time = 0;
-  tm->tm_sec = tm->tm_sec >= 58 ? 58 : tm->tm_sec;
-  time |= (tm->tm_sec) >> 1;
-  time |= (tm->tm_min << 5);
-  time |= (tm->tm_hour << 11);
+  // Pega a data e hora atual do computador no formato da FAT
+  uint16_t date, time;
+  get_current_date_time(&date, &time);
 
   // Atualiza parâmetros do arquivo
-	memset(&directory_stack->entries[entry_pos], 0, sizeof(DirEntry));
-  memcpy(directory_stack->entries[entry_pos].short_dir.DIR_Name, new_entry_name, 11);
+	memset(&volume->directory_stack->entries[entry_pos], 0, sizeof(DirEntry));
+  memcpy(volume->directory_stack->entries[entry_pos].short_dir.DIR_Name, new_entry_name, 11);
 	if(created_entry == NULL) {
-		directory_stack->entries[entry_pos].short_dir.DIR_FstClusLO = new_entry_cluster & 0x0000FFFF;
-		directory_stack->entries[entry_pos].short_dir.DIR_FstClusHI = (new_entry_cluster & 0xFFFF0000) >> 16;
-		directory_stack->entries[entry_pos].short_dir.DIR_FileSize = 0;
-		directory_stack->entries[entry_pos].short_dir.DIR_Attr = attr;
-		directory_stack->entries[entry_pos].short_dir.DIR_CrtDate = date;
-		directory_stack->entries[entry_pos].short_dir.DIR_CrtTime = time;
-		directory_stack->entries[entry_pos].short_dir.DIR_WrtDate = date;
-		directory_stack->entries[entry_pos].short_dir.DIR_WrtTime = time;
-		directory_stack->entries[entry_pos].short_dir.DIR_LstAccDate = date;
+		volume->directory_stack->entries[entry_pos].short_dir.DIR_FstClusLO = new_entry_cluster & 0x0000FFFF;
+		volume->directory_stack->entries[entry_pos].short_dir.DIR_FstClusHI = (new_entry_cluster & 0xFFFF0000) >> 16;
+		volume->directory_stack->entries[entry_pos].short_dir.DIR_FileSize = 0;
+		volume->directory_stack->entries[entry_pos].short_dir.DIR_Attr = attr;
+		volume->directory_stack->entries[entry_pos].short_dir.DIR_CrtDate = date;
+		volume->directory_stack->entries[entry_pos].short_dir.DIR_CrtTime = time;
+		volume->directory_stack->entries[entry_pos].short_dir.DIR_WrtDate = date;
+		volume->directory_stack->entries[entry_pos].short_dir.DIR_WrtTime = time;
+		volume->directory_stack->entries[entry_pos].short_dir.DIR_LstAccDate = date;
 	} else {
-		memcpy(&directory_stack->entries[entry_pos], created_entry, sizeof(DirEntry));
+		memcpy(&volume->directory_stack->entries[entry_pos], created_entry, sizeof(DirEntry));
 	}
 
   // Coloca na memória o novo arquivo
-  fseek(disk, get_entry_disk_position(directory_stack->cluster, entry_pos), SEEK_SET);
-	fwrite(&directory_stack->entries[entry_pos], sizeof(DirEntry), 1, disk);
+  block_cache_write(&volume->block_cache, &volume->directory_stack->entries[entry_pos], sizeof(DirEntry), get_entry_disk_position(volume, volume->directory_stack->cluster, entry_pos));
+	dir_index_add(&volume->directory_stack->cached->index, volume->directory_stack->entries, entry_pos);
 
   // Se flag de diretório
-	if(attr == ATTR_DIRECTORY) {
+	if(attr == ATTR_DIRECTORY && created_entry == NULL) {
 		char dot[] = {'.', 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20};
 		char dotdot[] = {'.', '.', 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20};
 
@@ -890,8 +1500,8 @@ int touch_wrapper(char* file_name, uint8_t attr, DirEntry* created_entry) {
     // Copia dados para a memória do dir ..
 		DirEntry dotdotEntry = { 0 };
 		memcpy(&dotdotEntry.short_dir.DIR_Name, dotdot, 11);
-		dotdotEntry.short_dir.DIR_FstClusLO = directory_stack->cluster & 0x0000FFFF;
-		dotdotEntry.short_dir.DIR_FstClusHI = (directory_stack->cluster & 0xFFFF0000) >> 16;
+		dotdotEntry.short_dir.DIR_FstClusLO = volume->directory_stack->cluster & 0x0000FFFF;
+		dotdotEntry.short_dir.DIR_FstClusHI = (volume->directory_stack->cluster & 0xFFFF0000) >> 16;
 		dotdotEntry.short_dir.DIR_Attr = attr;
 		dotdotEntry.short_dir.DIR_CrtDate = date;
 		dotdotEntry.short_dir.DIR_CrtTime = time;
@@ -899,344 +1509,2430 @@ int touch_wrapper(char* file_name, uint8_t attr, DirEntry* created_entry) {
 		dotdotEntry.short_dir.DIR_WrtTime = time;
 		dotdotEntry.short_dir.DIR_LstAccDate = date;
 
-    // Escreve os dados da memória dos dir's '.' e '..'
-		uint64_t write_dotpos = get_cluster_offset(new_entry_cluster) * bs.BPB_SecPerClus * bs.BPB_BytsPerSec;
-		fseek(disk, write_dotpos, SEEK_SET);
-		fwrite(&dotEntry, sizeof(dotEntry), 1, disk);
-		fwrite(&dotdotEntry, sizeof(dotEntry), 1, disk);
+    // Monta o cluster do novo diretório com '.', '..' e o resto zerado
+		uint32_t cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+		uint32_t new_dir_quantity = cluster_size / sizeof(DirEntry);
+		DirEntry* new_dir_entries = (DirEntry*) calloc(new_dir_quantity, sizeof(DirEntry));
+		new_dir_entries[0] = dotEntry;
+		new_dir_entries[1] = dotdotEntry;
+
+    // Escreve o cluster inteiro e já deixa o diretório na cache
+		block_cache_write(&volume->block_cache, new_dir_entries, cluster_size, get_cluster_address(volume, new_entry_cluster));
+		dir_cache_release(&volume->dir_cache, dir_cache_insert(&volume->dir_cache, new_entry_cluster, new_dir_entries, new_dir_quantity));
 	}
-	return 1;
+	return FAT32_OK;
+}
+
+// create_entry com as mensagens de erro da shell, command_name é o nome do comando usado nelas
+// Retorna 1 se criou a entrada
+int touch_wrapper(fat32_t* volume, char* file_name, uint8_t attr, DirEntry* created_entry, char* command_name) {
+	int result = create_entry(volume, file_name, attr, created_entry);
+	if(result == FAT32_EINVAL) command_error(volume, "%s: %s: Invalid name\n", command_name, file_name);
+	else if(result == FAT32_EEXIST) command_error(volume, "%s: '%s': Already exists\n", command_name, file_name);
+	else if(result == FAT32_ENOSPC) command_error(volume, "%s: '%s': Unable to alocate new cluster, disk is full?\n", command_name, file_name);
+	return result == FAT32_OK;
 }
 
 // Chama função genérica de criação de dir_entry com flag de arquivo
-void touch(char* file_name) {
-	touch_wrapper(file_name, ATTR_ARCHIVE, NULL);
+void touch(fat32_t* volume, char* file_name) {
+	touch_wrapper(volume, file_name, ATTR_ARCHIVE, NULL, "touch");
 }
 
 // Função que escreve valores na FAT
-void write_in_fat(uint32_t cluster, uint32_t* value) {
-	uint32_t fat_address = get_fat_address(cluster);
-	uint32_t fat2_address = fat_address + bs.BPB_FATSz32 * bs.BPB_BytsPerSec;
-
-	fseek(disk, fat_address, SEEK_SET);
-	fwrite(value, sizeof(uint32_t), 1, disk);
-	fseek(disk, fat2_address, SEEK_SET);
-	fwrite(value, sizeof(uint32_t), 1, disk);
+// A escrita passa pela cache, que grava FAT1 e FAT2 juntas no flush
+void write_in_fat(fat32_t* volume, uint32_t cluster, uint32_t* value) {
+	// O bitmap é montado a partir da FAT do disco, então precisa existir antes da primeira alteração
+	build_free_bitmap(volume);
+	// Um cluster que estava livre não pertence a nenhuma cadeia mapeada
+	if(fat_cache_get(&volume->fat_cache, cluster) != FREE_CLUSTER) {
+		extent_map_invalidate(&volume->extent_maps, cluster);
+		// Uma leitura em andamento na cadeia antiga pode pegar dados do próximo dono do cluster
+		if(*value == FREE_CLUSTER) __atomic_add_fetch(&volume->region_sequence[cluster >> FAT_REGION_SHIFT], 1, __ATOMIC_SEQ_CST);
+	}
+	fat_cache_set(&volume->fat_cache, cluster, *value);
+	// Mantém o bitmap de livres sincronizado com a FAT
+	if(*value == FREE_CLUSTER) allocator_mark_free(&volume->allocator, cluster);
+	else allocator_mark_used(&volume->allocator, cluster);
 }
 
 // Chama função genérica de criação de dir_entry com flag de diretório
-void mkdir(char* entry_name) {
-	touch_wrapper(entry_name, ATTR_DIRECTORY, NULL);
+void mkdir(fat32_t* volume, char* entry_name) {
+	touch_wrapper(volume, entry_name, ATTR_DIRECTORY, NULL, "mkdir");
 }
 
-/*
-
-Como comentado no relatório na parte de Resultados e Discussão nós desistimos de implementar o CP e o MV, 
-o código abaixo é referente ao MV não chegamos a fazer o CP. 
+// Tamanho máximo de cada escrita de dados na imagem
+#define DATA_IO_CHUNK (8 * 1024 * 1024)
+
+// Converte um tamanho com sufixo opcional (K, M ou G) para bytes, retorna -1 se for inválido
+int64_t parse_size(char* size_str) {
+	char* end;
+	double value = strtod(size_str, &end);
+	if(end == size_str || value < 0) return -1;
+
+	switch(toupper(*end)) {
+		case 'G': value *= 1024;
+		case 'M': value *= 1024;
+		case 'K': value *= 1024; end++;
+		case '\0': break;
+		default: return -1;
+	}
+	if(*end != '\0' && toupper(*end) != 'B') return -1;
+	return (int64_t) value;
+}
 
-// Seguindo a documentação da Microsoft converter um nome de longentry para um nome de shortentry
-void basis_name_generator(char* name, char* output) {
-	int i, j;
+// Preenche uma entrada nova (o nome já deve estar em DIR_Name) com o primeiro cluster, tamanho, atributo e a data atual
+void fill_new_entry(DirEntry* entry, uint32_t first_cluster, uint32_t size, uint8_t attr) {
+	uint16_t date, time;
+	get_current_date_time(&date, &time);
+	entry->short_dir.DIR_FstClusLO = first_cluster & 0x0000FFFF;
+	entry->short_dir.DIR_FstClusHI = (first_cluster & 0xFFFF0000) >> 16;
+	entry->short_dir.DIR_FileSize = size;
+	entry->short_dir.DIR_Attr = attr;
+	entry->short_dir.DIR_CrtDate = date;
+	entry->short_dir.DIR_CrtTime = time;
+	entry->short_dir.DIR_WrtDate = date;
+	entry->short_dir.DIR_WrtTime = time;
+	entry->short_dir.DIR_LstAccDate = date;
+}
 
-	int prohibitedLen = strlen(prohibited);
+// Cria um arquivo já com size_str bytes reservados em clusters contíguos (preenchidos com zero)
+void prealloc(fat32_t* volume, char* file_name, char* size_str) {
+	int64_t size = parse_size(size_str);
+	if(size < 0 || size > UINT32_MAX) {
+		command_error(volume, "prealloc: %s: Invalid size\n", size_str);
+		return;
+	}
 
-	int len = strlen(name);
-	int dotPosition = 0;
+	DirEntry entry = { 0 };
+	create_formated_name(entry.short_dir.DIR_Name, file_name);
+	if(!entry.short_dir.DIR_Name[0]) {
+		command_error(volume, "prealloc: %s: Invalid name\n", file_name);
+		return;
+	}
 
-	for(i = 0; i < 11; i++)
-		output[i] = 0x20;
+	uint32_t cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+	uint32_t cluster_count = (size + cluster_size - 1) / cluster_size;
+	if(cluster_count == 0) cluster_count = 1;
 
-	// Transforma todo caracter para maiusculo e transforma os caracteres proibidos no shortentry para _
-	for(i = 0; i < len; i++) {
-		char c = name[i];
-		if(c == '.')
-			dotPosition = i;
+	uint32_t extent_count;
+	extent_t* extents = allocate_extents(volume, cluster_count, &extent_count);
+	if(extents == NULL) {
+		command_error(volume, "prealloc: '%s': Unable to alocate clusters, disk is full?\n", file_name);
+		return;
+	}
 
-		for(int j = 0; j < prohibitedLen; j++) {
-			if(c == prohibited[j]) {
-				c = '_';
-				break;
-			}
+	// Zera os clusters reservados para não expor dados antigos
+	uint8_t* zeros = (uint8_t*) calloc(1, DATA_IO_CHUNK);
+	for(uint32_t i = 0; i < extent_count; i++) {
+		uint64_t write_pos = get_cluster_address(volume, extents[i].start);
+		uint64_t extent_bytes = (uint64_t)extents[i].length * cluster_size;
+		while(extent_bytes) {
+			size_t chunk = extent_bytes < DATA_IO_CHUNK ? extent_bytes : DATA_IO_CHUNK;
+			block_cache_write_direct(&volume->block_cache, zeros, chunk, write_pos);
+			write_pos += chunk;
+			extent_bytes -= chunk;
 		}
-
-		name[i] = toupper(c);
 	}
+	free(zeros);
 
-	// Copia todo o nome ate chegar no ultimo ponto ou na 8 posicao, qual vier primeiro
-	for(i = 0; i < dotPosition && i < 8; i++) {
-		output[i] = name[i];
-	}
+	fill_new_entry(&entry, extents[0].start, size, ATTR_ARCHIVE);
 
-	// Copia os 3 primeiros caracteres da extensao na parte da extensao
-	if(dotPosition) {
-		for(i = dotPosition+1, j = 8; j < 11 && i < len; i++, j++) {
-			output[j] = name[i];
-		}
-	}
+	// Se não conseguir criar a entrada devolve os clusters
+	if(!touch_wrapper(volume, file_name, ATTR_ARCHIVE, &entry, "prealloc")) free_chain(volume, extents[0].start);
+	else printf("prealloc: '%s': %u clusters in %u extent(s)\n", file_name, cluster_count, extent_count);
+
+	free(extents);
 }
 
-// Entrada caminho para arquivo da particao atual, retorna primeiro cluster de arquivo
-uint32_t write_file_from_outside_to_clusters(char* path, uint32_t* file_size, char* command_name) {
+// Arquivo da imagem visto como uma sequência de bytes, com uma cópia dos extents da cadeia
+// (a cópia não depende da cache de mapas, que pode descartar o mapa durante a cópia)
+typedef struct image_file {
+	fat32_t* volume;
+	chain_extent_t* extents;
+	uint32_t extent_count;
+	uint64_t cluster_size;
+} image_file_t;
+
+static void open_image_file(fat32_t* volume, image_file_t* file, uint32_t first_cluster) {
+	// O mapa pode sair da cache por causa de outra consulta assim que a trava for solta, então a cópia fica dentro dela
+	pthread_mutex_lock(&volume->cache_lock);
+	extent_map_t* map = extent_map_get(&volume->extent_maps, first_cluster);
+	file->volume = volume;
+	file->extent_count = map->extent_count;
+	file->extents = (chain_extent_t*) malloc((map->extent_count ? map->extent_count : 1) * sizeof(chain_extent_t));
+	memcpy(file->extents, map->extents, map->extent_count * sizeof(chain_extent_t));
+	pthread_mutex_unlock(&volume->cache_lock);
+	file->cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+}
 
-  FILE *f = fopen(path, "rb");
-  if(f == NULL) {
-    return FREE_CLUSTER;
-  }
+static void close_image_file(image_file_t* file) {
+	free(file->extents);
+}
 
+// Retorna o endereço na imagem do byte offset do arquivo e em contiguous quantos bytes seguem contíguos a partir dele
+// contiguous é 0 se offset passar do fim da cadeia
+static uint64_t image_file_locate(image_file_t* file, uint64_t offset, uint64_t* contiguous) {
+	uint64_t logical = offset / file->cluster_size;
+	*contiguous = 0;
+	if(file->extent_count == 0) return 0;
+
+	uint32_t low = 0, high = file->extent_count - 1;
+	while(low < high) {
+		uint32_t mid = (low + high + 1) / 2;
+		if(file->extents[mid].logical <= logical) low = mid;
+		else high = mid - 1;
+	}
+	chain_extent_t* extent = &file->extents[low];
+	uint64_t extent_start = (uint64_t)extent->logical * file->cluster_size;
+	uint64_t extent_end = extent_start + (uint64_t)extent->length * file->cluster_size;
+	if(offset >= extent_end) return 0;
 
-  fseek(f, 0, SEEK_END);
-  *file_size = ftell(f);
-  uint32_t cluster_size = bs.BPB_BytsPerSec * bs.BPB_SecPerClus;
-  uint32_t file_cluster_count = ceil(*file_size/(double)cluster_size);
-  fseek(f, 0, SEEK_SET);
-  // Aloca o espaco necessario para o arquivo no disco
-  uint32_t chain_start = allocate_clusters(file_cluster_count);
-  if(chain_start == FREE_CLUSTER) {
-	  printf("%s: Unable to alocate clusters, disk is full?\n", command_name);
-    return FREE_CLUSTER;
-  }
+	*contiguous = extent_end - offset;
+	return get_cluster_address(file->volume, extent->physical) + (offset - extent_start);
+}
 
-  uint8_t* buffer = (uint8_t*)malloc(cluster_size);
+// Lê ou escreve no arquivo da imagem, uma operação por extent
+static size_t image_file_io(image_file_t* file, uint8_t* buffer, size_t size, uint64_t offset, int write) {
+	size_t done = 0;
+	while(done < size) {
+		uint64_t contiguous;
+		uint64_t address = image_file_locate(file, offset + done, &contiguous);
+		if(contiguous == 0) break;
+		size_t part = size - done < contiguous ? size - done : contiguous;
+		size_t transferred = write ? block_cache_write_direct(&file->volume->block_cache, buffer + done, part, address) : bdev_read(file->volume->disk, buffer + done, part, address);
+		done += transferred;
+		if(transferred < part) break;
+	}
+	return done;
+}
 
-	uint32_t curr_cluster = chain_start;
-  for(uint32_t i = 0; i < file_cluster_count; i++) {
-    uint32_t read_size = (i+1) ==  file_cluster_count ? *file_size - i*cluster_size : cluster_size;
+static size_t image_file_read(void* context, void* buffer, size_t size, uint64_t offset) {
+	return image_file_io((image_file_t*) context, (uint8_t*) buffer, size, offset, 0);
+}
 
-    fread(buffer, read_size, 1, f);
+static size_t image_file_write(void* context, void* buffer, size_t size, uint64_t offset) {
+	return image_file_io((image_file_t*) context, (uint8_t*) buffer, size, offset, 1);
+}
 
-    uint64_t write_pos = get_cluster_offset(curr_cluster) * cluster_size;
-		fseek(disk, write_pos, SEEK_SET);
-		fwrite(buffer, read_size, 1, disk);
+// Copia size bytes entre um arquivo do computador (descritor, quando o image_file da ponta é NULL) e um arquivo da imagem,
+// ou entre dois arquivos da imagem
+// Usa copy_file_range por extent quando o kernel permite, senão a cópia com dois buffers e leitura em outra thread
+// Retorna 1 se copiou tudo
+static int copy_data(fat32_t* volume, int source_fd, image_file_t* source_image, int destination_fd, image_file_t* destination_image, uint64_t size) {
+	uint64_t done = 0;
+	while(done < size) {
+		uint64_t part = size - done;
+		uint64_t source_offset = done, destination_offset = done, contiguous;
+		if(source_image) {
+			source_offset = image_file_locate(source_image, done, &contiguous);
+			if(contiguous < part) part = contiguous;
+		}
+		if(destination_image) {
+			destination_offset = image_file_locate(destination_image, done, &contiguous);
+			if(contiguous < part) part = contiguous;
+		}
+		if(part == 0) return 0;
+
+		int64_t copied = copy_range(source_image ? volume->disk->fd : source_fd, source_offset, destination_image ? volume->disk->fd : destination_fd, destination_offset, part);
+		if(copied < 0 && done == 0) break;
+		if(copied <= 0) return 0;
+		// A escrita não passou pela cache de setores, então os setores pendentes no intervalo são atualizados
+		if(destination_image) block_cache_reload(&volume->block_cache, destination_offset, copied);
+		done += copied;
+		if(copied < part) return 0;
+	}
+	if(done == size) return 1;
 
-		curr_cluster = get_cluster_info(curr_cluster);
-  }
+	copy_io_t read_io = source_image ? image_file_read : copy_fd_read;
+	void* read_context = source_image ? (void*) source_image : (void*) &source_fd;
+	copy_io_t write_io = destination_image ? image_file_write : copy_fd_write;
+	void* write_context = destination_image ? (void*) destination_image : (void*) &destination_fd;
+	return copy_pipeline_run(read_io, read_context, write_io, write_context, size, DATA_IO_CHUNK) == size;
+}
 
-  free(buffer);
-  
-  return chain_start;
+// Retorna o nome da entrada em caminhos do tipo img/NOME (entradas do diretório atual da imagem), ou NULL se não for da imagem
+// Se for da imagem mas tiver subpastas retorna uma string vazia
+static char* image_entry_name(char* path) {
+	if(strncmp(path, "img/", 4)) return NULL;
+	if(strchr(path + 4, '/')) return "";
+	return path + 4;
 }
 
-void get_entry_name(char* entry_name) {
-	int i;
-	for(i = 4; i < strlen(entry_name); i++) {
-		if(entry_name[i] == '/') {
-			entry_name[0] = 0x00;
+// Procura o cluster do diretório de destino de um cp/mv dentro da imagem: ".." ou um subdiretório do atual
+// Retorna 1 se name for um desses diretórios
+static int find_destination_directory(fat32_t* volume, char* name, uint32_t* cluster) {
+	if(!strcmp(name, "..")) {
+		if(volume->directory_stack_count == 0) return 0;
+		*cluster = volume->directory_stack->previous->cluster;
+		return 1;
+	}
+	char formated_name[11];
+	int32_t position = find_named_in_current_dir(volume, name, formated_name);
+	if(position < 0 || (volume->directory_stack->entries[position].short_dir.DIR_Attr & ATTR_DIRECTORY) != ATTR_DIRECTORY) return 0;
+	*cluster = (volume->directory_stack->entries[position].short_dir.DIR_FstClusHI << 16) | volume->directory_stack->entries[position].short_dir.DIR_FstClusLO;
+	if(*cluster < FIRST_DATA_CLUSTER) *cluster = volume->bs.BPB_RootClus;
+	return 1;
+}
+
+// Coloca temporariamente o diretório do cluster no topo da pilha, para usar as funções que trabalham no diretório atual
+// Retorna o topo anterior, que precisa ser devolvido com leave_directory
+static directory_t* enter_directory(fat32_t* volume, uint32_t cluster) {
+	directory_t* current = volume->directory_stack;
+	directory_t* target = create_directory_struct(current, "");
+	target->cluster = cluster;
+	volume->directory_stack = target;
+	read_dir(volume);
+	return current;
+}
+
+static void leave_directory(fat32_t* volume, directory_t* current) {
+	free_directory_struct(volume, volume->directory_stack);
+	volume->directory_stack = current;
+	// O diretório pode estar também na pilha e ter crescido, então as entradas da pilha são atualizadas
+	for(directory_t* directory = volume->directory_stack; directory; directory = directory->previous) {
+		if(directory->cached == NULL) continue;
+		directory->entries = directory->cached->entries;
+		directory->quantity = directory->cached->quantity;
+	}
+}
+
+// Cria a entrada no diretório do cluster passado, sem trocar o diretório atual
+static int touch_in_directory(fat32_t* volume, uint32_t cluster, char* name, DirEntry* entry, char* command_name) {
+	directory_t* current = enter_directory(volume, cluster);
+	int created = touch_wrapper(volume, name, entry->short_dir.DIR_Attr, entry, command_name);
+	leave_directory(volume, current);
+	return created;
+}
+
+// Copia o arquivo do computador para uma entrada nova no diretório atual
+static int import_host_file(fat32_t* volume, char* host_path, char* name, char* command_name) {
+	DirEntry entry = { 0 };
+	create_formated_name(entry.short_dir.DIR_Name, name);
+	if(!entry.short_dir.DIR_Name[0]) {
+		command_error(volume, "%s: %s: Invalid name\n", command_name, name);
+		return 0;
+	}
+	if(find_in_current_dir(volume, entry.short_dir.DIR_Name) >= 0) {
+		command_error(volume, "%s: '%s': Already exists\n", command_name, name);
+		return 0;
+	}
+
+	FILE* host_file = fopen(host_path, "rb");
+	if(host_file == NULL) {
+		command_error(volume, "%s: %s: No such file\n", command_name, host_path);
+		return 0;
+	}
+	fseek(host_file, 0, SEEK_END);
+	int64_t size = ftell(host_file);
+	if(size < 0 || size > UINT32_MAX) {
+		command_error(volume, "%s: %s: File too large for FAT32\n", command_name, host_path);
+		fclose(host_file);
+		return 0;
+	}
+
+	uint32_t cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+	uint32_t cluster_count = (size + cluster_size - 1) / cluster_size;
+	if(cluster_count == 0) cluster_count = 1;
+	uint32_t extent_count;
+	extent_t* extents = allocate_extents(volume, cluster_count, &extent_count);
+	if(extents == NULL) {
+		command_error(volume, "%s: '%s': Unable to alocate clusters, disk is full?\n", command_name, name);
+		fclose(host_file);
+		return 0;
+	}
+	uint32_t first_cluster = extents[0].start;
+	free(extents);
+
+	image_file_t file;
+	open_image_file(volume, &file, first_cluster);
+	int copied = copy_data(volume, fileno(host_file), NULL, -1, &file, size);
+	close_image_file(&file);
+	fclose(host_file);
+
+	if(!copied) {
+		command_error(volume, "%s: %s: Copy failed\n", command_name, host_path);
+		free_chain(volume, first_cluster);
+		return 0;
+	}
+
+	fill_new_entry(&entry, first_cluster, size, ATTR_ARCHIVE);
+	if(!touch_wrapper(volume, name, ATTR_ARCHIVE, &entry, command_name)) {
+		free_chain(volume, first_cluster);
+		return 0;
+	}
+	return 1;
+}
+
+// Procura um arquivo (não diretório) no diretório atual, retorna a posição ou -1 com a mensagem de erro
+static int32_t find_file_entry(fat32_t* volume, char* name, char* command_name) {
+	char formated_name[11];
+	int32_t position = find_named_in_current_dir(volume, name, formated_name);
+	if(position < 0) {
+		command_error(volume, "%s: '%s': No such file\n", command_name, name);
+		return -1;
+	}
+	if(volume->directory_stack->entries[position].short_dir.DIR_Attr & (ATTR_DIRECTORY | ATTR_VOLUME_ID)) {
+		command_error(volume, "%s: '%s': Is a directory\n", command_name, name);
+		return -1;
+	}
+	return position;
+}
+
+// Copia o arquivo do diretório atual para o computador
+static int export_image_file(fat32_t* volume, char* name, char* host_path, char* command_name) {
+	int32_t position = find_file_entry(volume, name, command_name);
+	if(position < 0) return 0;
+	DirEntry entry = volume->directory_stack->entries[position];
+
+	FILE* host_file = fopen(host_path, "wb");
+	if(host_file == NULL) {
+		command_error(volume, "%s: %s: Unable to create file\n", command_name, host_path);
+		return 0;
+	}
+
+	int copied = 1;
+	uint32_t first_cluster = (entry.short_dir.DIR_FstClusHI << 16) | entry.short_dir.DIR_FstClusLO;
+	if(entry.short_dir.DIR_FileSize && first_cluster >= FIRST_DATA_CLUSTER) {
+		image_file_t file;
+		open_image_file(volume, &file, first_cluster);
+		copied = copy_data(volume, -1, &file, fileno(host_file), NULL, entry.short_dir.DIR_FileSize);
+		close_image_file(&file);
+	}
+	fclose(host_file);
+
+	if(!copied) command_error(volume, "%s: %s: Copy failed\n", command_name, host_path);
+	return copied;
+}
+
+// Copia o arquivo para outro nome no diretório atual, ou com o mesmo nome para um subdiretório ou para ".."
+static void copy_inside_image(fat32_t* volume, char* name, char* destination) {
+	int32_t position = find_file_entry(volume, name, "cp");
+	if(position < 0) return;
+	DirEntry entry = volume->directory_stack->entries[position];
+
+	uint32_t directory_cluster;
+	int to_directory = find_destination_directory(volume, destination, &directory_cluster);
+	char* new_name = to_directory ? name : destination;
+	create_formated_name(entry.short_dir.DIR_Name, new_name);
+	if(!entry.short_dir.DIR_Name[0]) {
+		command_error(volume, "cp: %s: Invalid name\n", new_name);
+		return;
+	}
+
+	uint32_t cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+	uint32_t size = entry.short_dir.DIR_FileSize;
+	uint32_t cluster_count = (size + (uint64_t)cluster_size - 1) / cluster_size;
+	if(cluster_count == 0) cluster_count = 1;
+	uint32_t extent_count;
+	extent_t* extents = allocate_extents(volume, cluster_count, &extent_count);
+	if(extents == NULL) {
+		command_error(volume, "cp: '%s': Unable to alocate clusters, disk is full?\n", new_name);
+		return;
+	}
+	uint32_t first_cluster = extents[0].start;
+	free(extents);
+
+	uint32_t source_cluster = (entry.short_dir.DIR_FstClusHI << 16) | entry.short_dir.DIR_FstClusLO;
+	if(size && source_cluster >= FIRST_DATA_CLUSTER) {
+		image_file_t source, copy;
+		open_image_file(volume, &source, source_cluster);
+		open_image_file(volume, &copy, first_cluster);
+		int copied = copy_data(volume, -1, &source, -1, &copy, size);
+		close_image_file(&source);
+		close_image_file(&copy);
+		if(!copied) {
+			command_error(volume, "cp: %s: Copy failed\n", name);
+			free_chain(volume, first_cluster);
 			return;
 		}
-		entry_name[i - 4] = entry_name[i];
 	}
-	entry_name[i - 4] = '\0';
+
+	fill_new_entry(&entry, first_cluster, size, entry.short_dir.DIR_Attr);
+	int created = to_directory ? touch_in_directory(volume, directory_cluster, new_name, &entry, "cp") : touch_wrapper(volume, new_name, entry.short_dir.DIR_Attr, &entry, "cp");
+	if(!created) free_chain(volume, first_cluster);
+}
+
+// Move o arquivo para um subdiretório ou para "..", ou renomeia se o destino não for um diretório
+static void move_inside_image(fat32_t* volume, char* name, char* destination) {
+	uint32_t directory_cluster;
+	if(!find_destination_directory(volume, destination, &directory_cluster)) {
+		rename_dir_entry(volume, name, destination);
+		return;
+	}
+
+	int32_t position = find_file_entry(volume, name, "mv");
+	if(position < 0) return;
+
+	// A entrada vai inteira para o outro diretório (mesma cadeia), e a antiga é liberada sem liberar os clusters
+	DirEntry entry = volume->directory_stack->entries[position];
+	if(!touch_in_directory(volume, directory_cluster, name, &entry, "mv")) return;
+	remove_dir_entry(volume, position, 0);
 }
 
-// Função que move arquivo do path atual para um novo lugar
-void mv(char* entry_path, char* entry_new_path) {
-	// Flag se esta movendo de uma pasta da particao ou de dentro da imagem
-	int in_image = 0; // 0 DISCO 1 IMAGEM
-	if(!memcmp(entry_path, "img/", 4)) in_image = 1;
+// Caminhos começando com img/ são entradas do diretório atual da imagem, os outros são arquivos do computador
+// Com remove_source o arquivo de origem é apagado depois da cópia (mv)
+static void copy_or_move(fat32_t* volume, char* source, char* destination, int remove_source, char* command_name) {
+	char* source_name = image_entry_name(source);
+	char* destination_name = image_entry_name(destination);
 
-	// Flag se esta movendo para a particao ou para dentro da imagem
-	int out_image = 0; // 0 DISCO 1 IMAGEM
-	if(!memcmp(entry_new_path, "img/", 4)) out_image = 1;
-	if(!in_image && !out_image) {
-		printf("mv: you can't move a file from partion to partition, you can either move from partition to image or from image to partition!\n");
+	if(!source_name && !destination_name) {
+		command_error(volume, "%s: one of the paths must be in the image (img/NAME)\n", command_name);
+		return;
+	}
+	if((source_name && !source_name[0]) || (destination_name && !destination_name[0])) {
+		command_error(volume, "%s: Image files must be in the current directory (img/NAME)\n", command_name);
 		return;
 	}
 
-	char currPath[11];
-	memcpy(currPath, directory_stack->name, 11);
+	if(!source_name) {
+		if(import_host_file(volume, source, destination_name, command_name) && remove_source) remove(source);
+	} else if(!destination_name) {
+		int32_t position;
+		if(export_image_file(volume, source_name, destination, command_name) && remove_source && (position = find_file_entry(volume, source_name, command_name)) >= 0)
+			remove_dir_entry(volume, position, 1);
+	} else {
+		if(remove_source) move_inside_image(volume, source_name, destination_name);
+		else copy_inside_image(volume, source_name, destination_name);
+	}
+}
 
-	printf("%d %d %s %s %s\n", in_image, out_image, entry_path, entry_new_path, currPath);
+// Copia arquivos entre o computador e a imagem, ou dentro da imagem
+void cp(fat32_t* volume, char* source, char* destination) {
+	copy_or_move(volume, source, destination, 0, "cp");
+}
 
-	if(!in_image && out_image) {
-		get_entry_name(entry_new_path);
-		if(entry_new_path[0] == 0) {
-			printf("mv: '%s': File must be in current directory!\n", entry_new_path);
-			return;
+// Move arquivos entre o computador e a imagem, ou dentro da imagem
+void mv(fat32_t* volume, char* source, char* destination) {
+	copy_or_move(volume, source, destination, 1, "mv");
+}
+
+
+// -------------------- Importação e extração de árvores -------------------- //
+
+// Buffer de cada thread quando copy_file_range não puder ser usado
+#define WORKER_BUFFER_SIZE (1024 * 1024)
+
+// Copia size bytes entre o arquivo do computador (a partir de file_offset) e a imagem (a partir de address),
+// direto pelo kernel ou com leituras/escritas posicionais pelo buffer da thread; to_image diz a direção
+// É chamada pelas threads, então só usa o dispositivo e nunca as caches
+static int copy_extent(fat32_t* volume, int host_fd, uint64_t file_offset, uint64_t address, uint64_t size, int to_image, uint8_t** buffer) {
+	int64_t copied = to_image ? copy_range(host_fd, file_offset, volume->disk->fd, address, size) : copy_range(volume->disk->fd, address, host_fd, file_offset, size);
+	if(copied >= 0) return (uint64_t) copied == size;
+
+	if(*buffer == NULL) *buffer = (uint8_t*) malloc(WORKER_BUFFER_SIZE);
+	for(uint64_t done = 0; done < size;) {
+		size_t chunk = size - done < WORKER_BUFFER_SIZE ? size - done : WORKER_BUFFER_SIZE;
+		if(to_image) {
+			if(copy_fd_read(&host_fd, *buffer, chunk, file_offset + done) != chunk) return 0;
+			if(bdev_write(volume->disk, *buffer, chunk, address + done) != chunk) return 0;
+		} else {
+			if(bdev_read(volume->disk, *buffer, chunk, address + done) != chunk) return 0;
+			if(copy_fd_write(&host_fd, *buffer, chunk, file_offset + done) != chunk) return 0;
 		}
-		char formated_entry_path[11];
-		create_formated_name(formated_entry_path, entry_new_path);
+		done += chunk;
+	}
+	return 1;
+}
 
-		if(formated_entry_path[0] == 0) {
-			printf("mv: '%s': Invalid entry name, can't move folder!\n", entry_new_path);
-			return;
+// Plano de um nó da árvore do computador
+typedef struct import_node {
+	// Diretório onde a entrada do nó fica e a posição dela nele (a raiz usa root_entry)
+	uint32_t position;
+	// Sequências de clusters do nó em import_plan_t.extents
+	uint32_t first_extent;
+	uint32_t extent_count;
+	// Nós ignorados (nome inválido, repetido, grande demais) não vão para a imagem
+	int skip;
+	// Diretórios: entradas montadas em memória e quantas estão em uso (contando . e ..)
+	DirEntry* entries;
+	uint32_t used;
+	dir_index_t index;
+} import_node_t;
+
+// Arquivo com dados para copiar
+typedef struct import_job {
+	uint64_t size;
+	uint32_t node;
+	int failed;
+} import_job_t;
+
+// Tudo que é decidido antes da cópia: nomes, clusters e conteúdo dos diretórios
+typedef struct import_plan {
+	fat32_t* volume;
+	host_tree_t tree;
+	import_node_t* nodes;
+	DirEntry root_entry;
+	extent_t* extents;
+	uint32_t extent_count;
+	import_job_t* jobs;
+	uint32_t job_count;
+	// Buffer de cada thread, alocado só se a thread precisar
+	uint8_t** buffers;
+} import_plan_t;
+
+// Ordena os arquivos do maior para o menor, assim os grandes começam primeiro e as threads terminam juntas
+static int compare_jobs(const void* a, const void* b) {
+	uint64_t first = ((import_job_t*)a)->size;
+	uint64_t second = ((import_job_t*)b)->size;
+	return first < second ? 1 : first > second ? -1 : 0;
+}
+
+// Decide o nome de cada nó dentro do diretório pai, ignorando os inválidos ou repetidos
+static void plan_names(import_plan_t* plan) {
+	host_tree_t* tree = &plan->tree;
+
+	// Os diretórios são montados com espaço para todos os filhos mais . e ..
+	uint32_t* child_count = (uint32_t*) calloc(tree->count, sizeof(uint32_t));
+	for(uint32_t i = 1; i < tree->count; i++) child_count[tree->nodes[i].parent]++;
+	for(uint32_t i = 0; i < tree->count; i++) {
+		if(!tree->nodes[i].is_directory) continue;
+		plan->nodes[i].entries = (DirEntry*) calloc(child_count[i] + 2, sizeof(DirEntry));
+		memcpy(plan->nodes[i].entries[0].short_dir.DIR_Name, ".          ", 11);
+		memcpy(plan->nodes[i].entries[1].short_dir.DIR_Name, "..         ", 11);
+		plan->nodes[i].used = 2;
+		dir_index_build(&plan->nodes[i].index, plan->nodes[i].entries, child_count[i] + 2);
+	}
+	free(child_count);
+
+	for(uint32_t i = 1; i < tree->count; i++) {
+		host_node_t* host = &tree->nodes[i];
+		import_node_t* parent = &plan->nodes[host->parent];
+		import_node_t* node = &plan->nodes[i];
+		// Filhos de diretórios ignorados também são ignorados, sem mensagem
+		if(parent->skip) {
+			node->skip = 1;
+			continue;
 		}
 
-		uint32_t file_size;
-		uint32_t file_cluster_chain_start = write_file_from_outside_to_clusters(entry_path, &file_size, "mv");
-		if(file_cluster_chain_start == FREE_CLUSTER) return;
-
-		touch(formated_entry_path);
-		// Procura entrada com mesmo nome no diretório
-		for(int entry_pos = 0; entry_pos < directory_stack->quantity; entry_pos++) {
-			uint8_t status_byte = directory_stack->entries[entry_pos].short_dir.DIR_Name[0];
-			// Se status_byte == E5 significa que o espaço está livre
-			if(status_byte == 0xE5) continue;
-			// Se for dir de long name ignora
-			if((directory_stack->entries[entry_pos].short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) continue;
-			
-			// Se não possui mais entradas no diretório, retorna com erro
-			if(status_byte == 0x00) {
-				printf("mv: '%s': No such file\n", entry_path);
-				return;
-			};
-
-			// Se achou o arquivo e 
-			if(!memcmp(formated_entry_path, directory_stack->entries[entry_pos].short_dir.DIR_Name, 11)) {
-				uint32_t curr_cluster = (directory_stack->entries[entry_pos].short_dir.DIR_FstClusHI<<16) | directory_stack->entries[entry_pos].short_dir.DIR_FstClusLO;				
-				write_in_fat(curr_cluster, &FREE_CLUSTER_POINTER);
-
-				// Seta os atributos
-				directory_stack->entries[entry_pos].short_dir.DIR_FstClusLO = file_cluster_chain_start & 0x0000FFFF;
-				directory_stack->entries[entry_pos].short_dir.DIR_FstClusHI = (file_cluster_chain_start & 0xFFFF0000) >> 16;
-				directory_stack->entries[entry_pos].short_dir.DIR_FileSize = file_size;
-
-				// Copia para a memória
-				fseek(disk, get_entry_disk_position(directory_stack->cluster, entry_pos), SEEK_SET);
-				fwrite(&directory_stack->entries[entry_pos], sizeof(DirEntry), 1, disk);
-				return;
-			};
+		char name[11];
+		create_formated_name(name, host->name);
+		if(!name[0]) printf("import: %s: Invalid name, skipped\n", host->path);
+		else if(dir_index_find(&parent->index, parent->entries, name) >= 0) printf("import: %s: Name already used, skipped\n", host->path);
+		else if(host->size > UINT32_MAX) printf("import: %s: File too large for FAT32, skipped\n", host->path);
+		else {
+			node->position = parent->used++;
+			memcpy(parent->entries[node->position].short_dir.DIR_Name, name, 11);
+			dir_index_add(&parent->index, parent->entries, node->position);
+			continue;
 		}
+		node->skip = 1;
 	}
-	if(in_image && !out_image) {
-		get_entry_name(entry_path);
-		if(entry_path[0] == 0) {
-			printf("mv: '%s': File must be in current directory!\n", entry_path);
-			return;
+}
+
+// Quantidade de clusters do nó: diretórios pelo número de entradas, arquivos pelo tamanho (vazios usam um cluster)
+static uint32_t node_cluster_count(fat32_t* volume, import_plan_t* plan, uint32_t node) {
+	uint64_t cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+	uint64_t bytes = plan->tree.nodes[node].is_directory ? (uint64_t)plan->nodes[node].used * sizeof(DirEntry) : plan->tree.nodes[node].size;
+	uint32_t count = (bytes + cluster_size - 1) / cluster_size;
+	return count ? count : 1;
+}
+
+// Reserva de uma vez os clusters de todos os nós e divide as sequências entre eles, na ordem dos nós
+// Nada vai para a FAT ainda; retorna 0 se não houver espaço
+static int plan_clusters(fat32_t* volume, import_plan_t* plan) {
+	uint64_t total = 0;
+	for(uint32_t i = 0; i < plan->tree.count; i++)
+		if(!plan->nodes[i].skip) total += node_cluster_count(volume, plan, i);
+	build_free_bitmap(volume);
+	if(total > volume->allocator.free_count) {
+		command_error(volume, "import: Not enough free space (%llu clusters needed, %u free)\n", (unsigned long long) total, volume->allocator.free_count);
+		return 0;
+	}
+
+	uint32_t region_count;
+	extent_t* regions = reserve_extents(volume, total, &region_count);
+	if(regions == NULL) return 0;
+
+	// Cada nó ganha pelo menos uma sequência, e cada fim de região pode partir um nó em mais uma
+	plan->extents = (extent_t*) malloc((plan->tree.count + region_count) * sizeof(extent_t));
+	uint32_t region = 0, region_used = 0;
+	for(uint32_t i = 0; i < plan->tree.count; i++) {
+		if(plan->nodes[i].skip) continue;
+		plan->nodes[i].first_extent = plan->extent_count;
+		uint32_t remaining = node_cluster_count(volume, plan, i);
+		while(remaining) {
+			uint32_t available = regions[region].length - region_used;
+			uint32_t length = remaining < available ? remaining : available;
+			plan->extents[plan->extent_count].start = regions[region].start + region_used;
+			plan->extents[plan->extent_count].length = length;
+			plan->extent_count++;
+			plan->nodes[i].extent_count++;
+			remaining -= length;
+			region_used += length;
+			if(region_used == regions[region].length) {
+				region++;
+				region_used = 0;
+			}
 		}
-		char formated_entry_path[11];
-		create_formated_name(formated_entry_path, entry_path);
-
-		DirEntry aux;
-		uint32_t previous_position_disk;
-		// Procura entrada com mesmo nome no diretório
-		for(int entry_pos = 0; entry_pos < directory_stack->quantity; entry_pos++) {
-			uint8_t status_byte = directory_stack->entries[entry_pos].short_dir.DIR_Name[0];
-			// Se status_byte == E5 significa que o espaço está livre
-			if(status_byte == 0xE5) continue;
-			// Se for dir de long name ignora
-			if((directory_stack->entries[entry_pos].short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) continue;
-			
-			// Se não possui mais entradas no diretório, retorna com erro
-			if(status_byte == 0x00) {
-				printf("mv: '%s': No such file\n", entry_path);
-				return;
-			};
-
-			// Se achou o arquivo e 
-			if(!memcmp(formated_entry_path, directory_stack->entries[entry_pos].short_dir.DIR_Name, 11)) {
-				// Se não existir flag de pasta retorna com erro
-				if((directory_stack->entries[entry_pos].short_dir.DIR_Attr & ATTR_DIRECTORY) == ATTR_DIRECTORY) {
-					printf("mv: '%s': Can't move a folder\n", entry_path);
-					return;
-				};
-				
-				// Copia para o auxiliar
-				memcpy(&aux, &directory_stack->entries[entry_pos], sizeof(DirEntry));
-
-				// Procura a posição da dir_entry para atualização na imagem
-				previous_position_disk = get_entry_disk_position(directory_stack->cluster, entry_pos);
-				break;
-			};
+	}
+	free(regions);
+	return 1;
+}
+
+// Tarefa de uma thread: copia um arquivo inteiro para os seus clusters
+// Só usa o plano (somente leitura) e o dispositivo, nenhuma cache é tocada fora da thread principal
+static void import_copy_task(void* context, uint32_t index, uint32_t worker) {
+	import_plan_t* plan = (import_plan_t*) context;
+	fat32_t* volume = plan->volume;
+	import_job_t* job = &plan->jobs[index];
+	import_node_t* node = &plan->nodes[job->node];
+
+	FILE* host_file = fopen(plan->tree.nodes[job->node].path, "rb");
+	if(host_file == NULL) {
+		job->failed = 1;
+		return;
+	}
+
+	uint64_t cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+	uint64_t file_offset = 0;
+	for(uint32_t i = 0; i < node->extent_count && file_offset < job->size; i++) {
+		extent_t* extent = &plan->extents[node->first_extent + i];
+		uint64_t part = (uint64_t)extent->length * cluster_size;
+		if(part > job->size - file_offset) part = job->size - file_offset;
+		if(!copy_extent(volume, fileno(host_file), file_offset, get_cluster_address(volume, extent->start), part, 1, &plan->buffers[worker])) {
+			job->failed = 1;
+			break;
 		}
+		file_offset += part;
+	}
+	fclose(host_file);
+}
 
-		FILE* outfile = fopen(entry_new_path, "wb+");
+// Encadeia na FAT os clusters de cada nó e preenche as entradas de diretório com eles
+static void plan_commit_entries(fat32_t* volume, import_plan_t* plan) {
+	uint32_t parent_cluster = volume->directory_stack->cluster;
+	for(uint32_t i = 0; i < plan->tree.count; i++) {
+		import_node_t* node = &plan->nodes[i];
+		if(node->skip) continue;
+		host_node_t* host = &plan->tree.nodes[i];
+		uint32_t first_cluster = plan->extents[node->first_extent].start;
+		link_extents(volume, &plan->extents[node->first_extent], node->extent_count);
+
+		DirEntry* entry = i ? &plan->nodes[host->parent].entries[node->position] : &plan->root_entry;
+		fill_new_entry(entry, first_cluster, host->size, host->is_directory ? ATTR_DIRECTORY : ATTR_ARCHIVE);
+
+		if(host->is_directory) {
+			fill_new_entry(&node->entries[0], first_cluster, 0, ATTR_DIRECTORY);
+			fill_new_entry(&node->entries[1], i ? plan->extents[plan->nodes[host->parent].first_extent].start : parent_cluster, 0, ATTR_DIRECTORY);
+		}
+	}
+}
 
-		uint32_t curr_cluster = aux.short_dir.DIR_FstClusHI << 16 | aux.short_dir.DIR_FstClusLO;
+// Grava o conteúdo dos diretórios nos seus clusters (pela cache de setores), completando o último cluster com zeros
+static void plan_write_directories(fat32_t* volume, import_plan_t* plan) {
+	uint64_t cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+	for(uint32_t i = 0; i < plan->tree.count; i++) {
+		import_node_t* node = &plan->nodes[i];
+		if(node->skip || !plan->tree.nodes[i].is_directory) continue;
+
+		uint64_t bytes = (uint64_t)node_cluster_count(volume, plan, i) * cluster_size;
+		uint8_t* data = (uint8_t*) calloc(1, bytes);
+		memcpy(data, node->entries, (uint64_t)node->used * sizeof(DirEntry));
+		uint64_t done = 0;
+		for(uint32_t j = 0; j < node->extent_count; j++) {
+			extent_t* extent = &plan->extents[node->first_extent + j];
+			block_cache_write(&volume->block_cache, data + done, (uint64_t)extent->length * cluster_size, get_cluster_address(volume, extent->start));
+			done += (uint64_t)extent->length * cluster_size;
+		}
+		free(data);
+	}
+}
 
-		uint32_t cluster_size = bs.BPB_BytsPerSec * bs.BPB_SecPerClus;
-		uint32_t file_size = aux.short_dir.DIR_FileSize;
-		uint32_t file_cluster_count = ceil(file_size/(double)cluster_size);
+// Devolve todos os clusters reservados pelo plano (nada foi escrito na FAT ainda)
+static void plan_release_clusters(fat32_t* volume, import_plan_t* plan) {
+	for(uint32_t i = 0; i < plan->extent_count; i++)
+		for(uint32_t j = 0; j < plan->extents[i].length; j++)
+			allocator_mark_free(&volume->allocator, plan->extents[i].start + j);
+}
 
-		uint8_t* buffer = (uint8_t*)malloc(cluster_size);
+static void plan_destroy(fat32_t* volume, import_plan_t* plan) {
+	for(uint32_t i = 0; i < plan->tree.count; i++) {
+		free(plan->nodes[i].entries);
+		dir_index_destroy(&plan->nodes[i].index);
+	}
+	if(plan->buffers)
+		for(uint32_t i = 0; i < volume->worker_count; i++) free(plan->buffers[i]);
+	free(plan->buffers);
+	free(plan->nodes);
+	free(plan->extents);
+	free(plan->jobs);
+	host_tree_destroy(&plan->tree);
+}
 
-		for(uint32_t i = 0; i < file_cluster_count; i++) {
-			uint32_t read_size = (i+1) ==  file_cluster_count ? file_size - i*cluster_size : cluster_size;
+// Importa a árvore do diretório host_directory do computador como um novo diretório no diretório atual
+// O nome do novo diretório é name, ou o nome do diretório do computador se name for NULL
+// Nomes, clusters e diretórios são planejados antes, os arquivos são copiados em paralelo para clusters
+// disjuntos e a FAT e os diretórios são gravados juntos no fim (ou nada é gravado se alguma cópia falhar)
+void import(fat32_t* volume, char* host_directory, char* name) {
+	import_plan_t plan = { 0 };
+	plan.volume = volume;
+	if(!host_tree_scan(&plan.tree, host_directory)) {
+		command_error(volume, "import: %s: Not a directory\n", host_directory);
+		return;
+	}
+	if(name == NULL) name = plan.tree.nodes[0].name;
 
-			fseek(disk, get_cluster_offset(curr_cluster) * cluster_size, SEEK_SET);
-			fread(buffer, read_size, 1, disk);
-			fwrite(buffer, read_size, 1, outfile);
-			
-			curr_cluster = get_cluster_info(curr_cluster);
-  	}
+	create_formated_name(plan.root_entry.short_dir.DIR_Name, name);
+	if(!plan.root_entry.short_dir.DIR_Name[0]) {
+		command_error(volume, "import: %s: Invalid name\n", name);
+		host_tree_destroy(&plan.tree);
+		return;
+	}
+	if(find_in_current_dir(volume, plan.root_entry.short_dir.DIR_Name) >= 0) {
+		command_error(volume, "import: '%s': Already exists\n", name);
+		host_tree_destroy(&plan.tree);
+		return;
+	}
 
-		fseek(disk, previous_position_disk, SEEK_SET);
-		fwrite(&AVAILABLE_ENTRY_POINTER, 1, 1, disk);
-		fclose(outfile);
+	// Alterações pendentes de comandos anteriores vão antes, assim nenhum setor sujo da cache cai nos clusters copiados
+	flush_disk(volume);
 
-		read_dir();
+	plan.nodes = (import_node_t*) calloc(plan.tree.count, sizeof(import_node_t));
+	plan_names(&plan);
+	if(!plan_clusters(volume, &plan)) {
+		plan_destroy(volume, &plan);
+		return;
 	}
-	if(in_image && out_image) {
-		get_entry_name(entry_path);
-		if(entry_path[0] == 0) {
-			printf("mv: '%s': File must be in current directory!\n", entry_path);
-			return;
+
+	plan.jobs = (import_job_t*) malloc(plan.tree.count * sizeof(import_job_t));
+	uint32_t file_count = 0, directory_count = 0;
+	uint64_t byte_count = 0;
+	for(uint32_t i = 0; i < plan.tree.count; i++) {
+		if(plan.nodes[i].skip) continue;
+		if(plan.tree.nodes[i].is_directory) {
+			directory_count++;
+			continue;
 		}
-		char formated_entry_path[11];
-		create_formated_name(formated_entry_path, entry_path);
+		file_count++;
+		byte_count += plan.tree.nodes[i].size;
+		if(plan.tree.nodes[i].size == 0) continue;
+		plan.jobs[plan.job_count].size = plan.tree.nodes[i].size;
+		plan.jobs[plan.job_count].node = i;
+		plan.jobs[plan.job_count].failed = 0;
+		plan.job_count++;
+	}
+	qsort(plan.jobs, plan.job_count, sizeof(import_job_t), compare_jobs);
 
-		if(formated_entry_path[0] == 0) {
-			printf("mv: '%s': Invalid entry name, can't move folder!\n", entry_path);
-			return;
+	plan.buffers = (uint8_t**) calloc(volume->worker_count, sizeof(uint8_t*));
+	thread_pool_run(volume->worker_count, plan.job_count, import_copy_task, &plan);
+
+	int failed = 0;
+	for(uint32_t i = 0; i < plan.job_count; i++) {
+		if(!plan.jobs[i].failed) continue;
+		command_error(volume, "import: %s: Copy failed\n", plan.tree.nodes[plan.jobs[i].node].path);
+		failed = 1;
+	}
+	if(failed) {
+		command_error(volume, "import: '%s': Nothing imported\n", name);
+		plan_release_clusters(volume, &plan);
+		plan_destroy(volume, &plan);
+		return;
+	}
+
+	plan_commit_entries(volume, &plan);
+	plan_write_directories(volume, &plan);
+	if(!touch_wrapper(volume, name, ATTR_DIRECTORY, &plan.root_entry, "import")) {
+		free_chain(volume, plan.extents[0].start);
+		for(uint32_t i = 1; i < plan.tree.count; i++)
+			if(!plan.nodes[i].skip) free_chain(volume, plan.extents[plan.nodes[i].first_extent].start);
+		plan_destroy(volume, &plan);
+		return;
+	}
+	// Uma única gravação (uma transação, se o journal estiver em uso) com a FAT e os diretórios
+	flush_disk(volume);
+
+	printf("import: '%s': %u files, %u directories, %llu bytes", name, file_count, directory_count, (unsigned long long) byte_count);
+	if(plan.tree.skipped) printf(", %u host entries skipped", plan.tree.skipped);
+	printf("\n");
+	plan_destroy(volume, &plan);
+}
+
+// Arquivo da imagem para copiar para o computador
+typedef struct extract_job {
+	char* host_path;
+	uint32_t size;
+	// Sequências de clusters do arquivo em extract_plan_t.extents
+	uint32_t first_extent;
+	uint32_t extent_count;
+	int failed;
+} extract_job_t;
+
+// Arquivos encontrados no percurso da árvore, com cópias dos extents (as threads não usam a cache de mapas)
+typedef struct extract_plan {
+	fat32_t* volume;
+	extract_job_t* jobs;
+	uint32_t job_count;
+	uint32_t job_capacity;
+	chain_extent_t* extents;
+	uint32_t extent_count;
+	uint32_t extent_capacity;
+	uint8_t** buffers;
+} extract_plan_t;
+
+// Diretório ainda não percorrido
+typedef struct extract_directory {
+	uint32_t cluster;
+	char* host_path;
+} extract_directory_t;
+
+// Acrescenta um arquivo ao plano, copiando só os extents que cobrem o tamanho dele
+static void plan_extract_file(fat32_t* volume, extract_plan_t* plan, DirEntry* entry, char* host_path) {
+	if(plan->job_count == plan->job_capacity) {
+		plan->job_capacity = plan->job_capacity ? plan->job_capacity * 2 : 64;
+		plan->jobs = (extract_job_t*) realloc(plan->jobs, plan->job_capacity * sizeof(extract_job_t));
+	}
+	extract_job_t* job = &plan->jobs[plan->job_count++];
+	job->host_path = host_path;
+	job->size = entry->short_dir.DIR_FileSize;
+	job->first_extent = plan->extent_count;
+	job->extent_count = 0;
+	job->failed = 0;
+
+	uint32_t first_cluster = (entry->short_dir.DIR_FstClusHI << 16) | entry->short_dir.DIR_FstClusLO;
+	if(job->size == 0 || first_cluster < FIRST_DATA_CLUSTER) return;
+
+	uint64_t cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+	uint64_t clusters = (job->size + cluster_size - 1) / cluster_size;
+	extent_map_t* map = extent_map_get(&volume->extent_maps, first_cluster);
+	for(uint32_t i = 0; i < map->extent_count && map->extents[i].logical < clusters; i++) {
+		if(plan->extent_count == plan->extent_capacity) {
+			plan->extent_capacity = plan->extent_capacity ? plan->extent_capacity * 2 : 64;
+			plan->extents = (chain_extent_t*) realloc(plan->extents, plan->extent_capacity * sizeof(chain_extent_t));
 		}
-		
-		get_entry_name(entry_new_path);
-		if(entry_path[0] == 0) {
-			printf("mv: '%s': New directory must be in the current directory!\n", entry_path);
+		plan->extents[plan->extent_count++] = map->extents[i];
+		job->extent_count++;
+	}
+}
+
+// Tarefa de uma thread: cria o arquivo no computador e copia os extents dele da imagem
+static void extract_copy_task(void* context, uint32_t index, uint32_t worker) {
+	extract_plan_t* plan = (extract_plan_t*) context;
+	fat32_t* volume = plan->volume;
+	extract_job_t* job = &plan->jobs[index];
+
+	FILE* host_file = fopen(job->host_path, "wb");
+	if(host_file == NULL) {
+		job->failed = 1;
+		return;
+	}
+
+	uint64_t cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+	uint64_t file_offset = 0;
+	for(uint32_t i = 0; i < job->extent_count && file_offset < job->size; i++) {
+		chain_extent_t* extent = &plan->extents[job->first_extent + i];
+		uint64_t part = (uint64_t)extent->length * cluster_size;
+		if(part > job->size - file_offset) part = job->size - file_offset;
+		if(!copy_extent(volume, fileno(host_file), file_offset, get_cluster_address(volume, extent->physical), part, 0, &plan->buffers[worker])) break;
+		file_offset += part;
+	}
+	// Cadeia menor que o tamanho também é falha, o arquivo ficaria diferente da imagem
+	if(file_offset < job->size) job->failed = 1;
+	if(fclose(host_file) != 0) job->failed = 1;
+}
+
+// Procura o caminho na imagem, relativo ao diretório atual ou absoluto (começando com /)
+// Retorna 1 e a entrada encontrada em found e o cluster dela em cluster (a raiz não tem entrada, found vira um diretório)
+// Se name não for NULL, recebe o nome longo ou 8.3 da entrada (FAT32_NAME_MAX bytes, vazio na raiz, '.' e '..')
+static int resolve_image_path(fat32_t* volume, char* path, DirEntry* found, uint32_t* cluster, char* name) {
+	// O índice só tem os nomes longos das entradas que têm um, então um caminho que ele não conhece
+	// (um nome 8.3 dessas entradas) ainda é procurado nos diretórios
+	if(path_index_usable(volume) && resolve_indexed_path(volume, path, found, cluster, name)) return 1;
+
+	*cluster = path[0] == '/' ? volume->bs.BPB_RootClus : volume->directory_stack->cluster;
+	memset(found, 0, sizeof(DirEntry));
+	found->short_dir.DIR_Attr = ATTR_DIRECTORY;
+	if(name) name[0] = '\0';
+
+	char* copy = strdup(path);
+	char* save;
+	int resolved = 1;
+	for(char* component = strtok_r(copy, "/", &save); component && resolved; component = strtok_r(NULL, "/", &save)) {
+		if(!(found->short_dir.DIR_Attr & ATTR_DIRECTORY)) resolved = 0;
+		else if(!strcmp(component, ".") || (!strcmp(component, "..") && *cluster == volume->bs.BPB_RootClus)) {
+			// A raiz não tem entrada '..', e o pai dela é ela mesma
+			if(name) name[0] = '\0';
+		}
+		else resolved = lookup_in_directory(volume, component, found, cluster, name);
+	}
+	free(copy);
+	return resolved;
+}
+
+// Percorre a árvore a partir do diretório do cluster, criando os diretórios no computador e planejando a cópia dos arquivos
+// Só a thread principal usa as caches, então o percurso inteiro acontece antes das cópias
+static uint32_t plan_extract_tree(fat32_t* volume, extract_plan_t* plan, uint32_t cluster, char* host_directory) {
+	// Clusters de diretórios já visitados, para uma imagem corrompida com ciclos não gerar um percurso infinito
+	uint8_t* visited = (uint8_t*) calloc(volume->allocator.max_cluster / 8 + 1, 1);
+	uint32_t directory_count = 0;
+
+	uint32_t stack_count = 1, stack_capacity = 64;
+	extract_directory_t* stack = (extract_directory_t*) malloc(stack_capacity * sizeof(extract_directory_t));
+	stack[0].cluster = cluster;
+	stack[0].host_path = strdup(host_directory);
+
+	while(stack_count) {
+		extract_directory_t current = stack[--stack_count];
+		if(current.cluster > volume->allocator.max_cluster || (visited[current.cluster / 8] & (1 << (current.cluster % 8)))) {
+			free(current.host_path);
+			continue;
+		}
+		visited[current.cluster / 8] |= 1 << (current.cluster % 8);
+
+		if(!host_make_directory(current.host_path)) {
+			command_error(volume, "extract: %s: Unable to create directory\n", current.host_path);
+			free(current.host_path);
+			continue;
+		}
+		directory_count++;
+
+		dir_cache_entry_t* directory = dir_cache_get(&volume->dir_cache, current.cluster);
+		for(uint32_t i = 0; i < directory->quantity; i++) {
+			DirEntry* entry = &directory->entries[i];
+			uint8_t status_byte = entry->short_dir.DIR_Name[0];
+			if(status_byte == 0x00) break;
+			if(status_byte == 0xE5 || status_byte == '.') continue;
+			if((entry->short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME || (entry->short_dir.DIR_Attr & ATTR_VOLUME_ID)) continue;
+
+			// O arquivo no computador fica com o nome longo, se a entrada tiver um
+			char host_name[FAT32_NAME_MAX];
+			entry_extract_name(host_name, entry, dir_index_long_name(&directory->index, i));
+			char* host_path = (char*) malloc(strlen(current.host_path) + strlen(host_name) + 2);
+			sprintf(host_path, "%s/%s", current.host_path, host_name);
+
+			if(!(entry->short_dir.DIR_Attr & ATTR_DIRECTORY)) {
+				plan_extract_file(volume, plan, entry, host_path);
+				continue;
+			}
+			if(stack_count == stack_capacity) {
+				stack_capacity *= 2;
+				stack = (extract_directory_t*) realloc(stack, stack_capacity * sizeof(extract_directory_t));
+			}
+			stack[stack_count].cluster = (entry->short_dir.DIR_FstClusHI << 16) | entry->short_dir.DIR_FstClusLO;
+			stack[stack_count].host_path = host_path;
+			stack_count++;
+		}
+		dir_cache_release(&volume->dir_cache, directory);
+		free(current.host_path);
+	}
+
+	free(stack);
+	free(visited);
+	return directory_count;
+}
+
+// Copia o arquivo ou a árvore do caminho image_path da imagem para host_directory no computador
+// O conteúdo de um diretório vai para dentro de host_directory, que é criado se não existir
+// O percurso e os mapas de clusters são feitos antes, depois as threads copiam os arquivos
+void extract(fat32_t* volume, char* image_path, char* host_directory) {
+	DirEntry entry;
+	uint32_t cluster;
+	char host_name[FAT32_NAME_MAX];
+	if(!resolve_image_path(volume, image_path, &entry, &cluster, host_name)) {
+		command_error(volume, "extract: %s: No such file or directory\n", image_path);
+		return;
+	}
+
+	extract_plan_t plan = { 0 };
+	plan.volume = volume;
+	uint32_t directory_count = 0;
+	if(entry.short_dir.DIR_Attr & ATTR_DIRECTORY) directory_count = plan_extract_tree(volume, &plan, cluster, host_directory);
+	else if(!host_make_directory(host_directory)) command_error(volume, "extract: %s: Unable to create directory\n", host_directory);
+	else {
+		// Como no entry_extract_name, um nome longo que não cabe no computador vira o 8.3
+		if(strlen(host_name) > NAME_MAX) entry_host_name(host_name, &entry);
+		char* host_path = (char*) malloc(strlen(host_directory) + strlen(host_name) + 2);
+		sprintf(host_path, "%s/%s", host_directory, host_name);
+		plan_extract_file(volume, &plan, &entry, host_path);
+	}
+
+	plan.buffers = (uint8_t**) calloc(volume->worker_count, sizeof(uint8_t*));
+	thread_pool_run(volume->worker_count, plan.job_count, extract_copy_task, &plan);
+
+	uint32_t failed = 0;
+	uint64_t byte_count = 0;
+	for(uint32_t i = 0; i < plan.job_count; i++) {
+		if(plan.jobs[i].failed) {
+			command_error(volume, "extract: %s: Copy failed\n", plan.jobs[i].host_path);
+			failed++;
+		} else byte_count += plan.jobs[i].size;
+		free(plan.jobs[i].host_path);
+	}
+	printf("extract: '%s': %u files, %u directories, %llu bytes", image_path, plan.job_count - failed, directory_count, (unsigned long long) byte_count);
+	if(failed) printf(", %u failed", failed);
+	printf("\n");
+
+	for(uint32_t i = 0; i < volume->worker_count; i++) free(plan.buffers[i]);
+	free(plan.buffers);
+	free(plan.jobs);
+	free(plan.extents);
+}
+
+// ------------------------------- Percurso paralelo ------------------------------- //
+
+// Subdiretório encontrado por uma thread, que a thread principal coloca no próximo nível
+typedef struct walk_child {
+	uint32_t cluster;
+	// Nome longo ou 8.3 (liberado pela thread principal depois de montar o caminho)
+	char* name;
+} walk_child_t;
+
+// Estado compartilhado pelas threads durante o percurso de um nível
+typedef struct walk_state {
+	fat32_t* volume;
+	walk_t* walk;
+	// Cópia da FAT1, as threads seguem as cadeias por ela sem passar pela cache
+	uint32_t* fat;
+	uint32_t max_cluster;
+	uint32_t cluster_size;
+	int flags;
+	walk_filter_t filter;
+	void* filter_context;
+	// Primeiro diretório do nível e os subdiretórios que cada diretório do nível tem
+	uint32_t level_start;
+	walk_child_t** children;
+	uint32_t* child_counts;
+} walk_state_t;
+
+// Quantidade de clusters da cadeia, parando em valores inválidos ou depois de max_cluster passos (ciclos)
+static uint32_t walk_chain_length(walk_state_t* state, uint32_t cluster) {
+	uint32_t length = 0;
+	while(cluster >= FIRST_DATA_CLUSTER && cluster <= state->max_cluster && length <= state->max_cluster) {
+		length++;
+		cluster = state->fat[cluster] & FAT_ENTRY_MASK;
+	}
+	return length;
+}
+
+// Tarefa de uma thread: lê um diretório do nível direto do disco e soma o uso dos arquivos dele
+static void walk_directory_task(void* context, uint32_t index, uint32_t worker) {
+	walk_state_t* state = (walk_state_t*) context;
+	fat32_t* volume = state->volume;
+	walk_directory_t* directory = &state->walk->directories[state->level_start + index];
+	uint32_t cluster_count = walk_chain_length(state, directory->cluster);
+	DirEntry* entries = (DirEntry*) malloc((uint64_t)cluster_count * state->cluster_size);
+
+	// Clusters contíguos da cadeia são lidos de uma vez
+	uint32_t cluster = directory->cluster;
+	for(uint32_t read = 0; read < cluster_count;) {
+		uint32_t run = 1;
+		while(read + run < cluster_count && (state->fat[cluster + run - 1] & FAT_ENTRY_MASK) == cluster + run) run++;
+		bdev_read(volume->disk, (uint8_t*) entries + (uint64_t)read * state->cluster_size, (uint64_t)run * state->cluster_size, get_cluster_address(volume, cluster));
+		cluster = state->fat[cluster + run - 1] & FAT_ENTRY_MASK;
+		read += run;
+	}
+	directory->clusters = cluster_count;
+
+	walk_child_t* children = NULL;
+	uint32_t child_count = 0, child_capacity = 0, kept = 0;
+	int keep_names = (state->flags & WALK_KEEP_ENTRIES) || state->filter;
+	char** names = NULL;
+	if(keep_names) names = (char**) malloc(cluster_count * (state->cluster_size / sizeof(DirEntry)) * sizeof(char*));
+	// Os nomes longos vêm nas entradas antes da entrada curta
+	lfn_decoder_t decoder;
+	lfn_reset(&decoder);
+	char name[FAT32_NAME_MAX];
+	uint32_t entry_count = cluster_count * (state->cluster_size / sizeof(DirEntry));
+	for(uint32_t i = 0; i < entry_count; i++) {
+		DirEntry* entry = &entries[i];
+		uint8_t status_byte = entry->short_dir.DIR_Name[0];
+		if(status_byte == 0x00) break;
+		if(status_byte == 0xE5) {
+			lfn_reset(&decoder);
+			continue;
+		}
+		if((entry->short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) {
+			lfn_push(&decoder, &entry->long_dir);
+			continue;
+		}
+		decoded_display_name(name, entry, &decoder);
+		if(status_byte == '.' || (entry->short_dir.DIR_Attr & ATTR_VOLUME_ID)) continue;
+
+		uint32_t first_cluster = (entry->short_dir.DIR_FstClusHI << 16) | entry->short_dir.DIR_FstClusLO;
+		if(entry->short_dir.DIR_Attr & ATTR_DIRECTORY) {
+			if(first_cluster >= FIRST_DATA_CLUSTER && first_cluster <= state->max_cluster) {
+				if(child_count == child_capacity) {
+					child_capacity = child_capacity ? child_capacity * 2 : 8;
+					children = (walk_child_t*) realloc(children, child_capacity * sizeof(walk_child_t));
+				}
+				children[child_count].cluster = first_cluster;
+				children[child_count++].name = strdup(name);
+			}
+		} else {
+			directory->files++;
+			directory->bytes += entry->short_dir.DIR_FileSize;
+			directory->clusters += walk_chain_length(state, first_cluster);
+		}
+		// As entradas guardadas são compactadas no começo do próprio buffer
+		if((state->flags & WALK_KEEP_ENTRIES) || (state->filter && state->filter(state->filter_context, entry, name))) {
+			names[kept] = strdup(name);
+			entries[kept++] = *entry;
+		}
+	}
+
+	if(keep_names) {
+		directory->entries = (DirEntry*) realloc(entries, (kept ? kept : 1) * sizeof(DirEntry));
+		directory->names = (char**) realloc(names, (kept ? kept : 1) * sizeof(char*));
+		directory->entry_count = kept;
+	} else free(entries);
+	state->children[index] = children;
+	state->child_counts[index] = child_count;
+}
+
+// Coloca um diretório no fim do vetor do percurso e retorna o índice dele
+static uint32_t walk_add_directory(walk_t* walk, uint32_t cluster, char* path, uint32_t depth, uint32_t parent) {
+	if(walk->count == walk->capacity) {
+		walk->capacity = walk->capacity ? walk->capacity * 2 : 64;
+		walk->directories = (walk_directory_t*) realloc(walk->directories, walk->capacity * sizeof(walk_directory_t));
+	}
+	walk_directory_t* directory = &walk->directories[walk->count];
+	memset(directory, 0, sizeof(walk_directory_t));
+	directory->path = path;
+	directory->cluster = cluster;
+	directory->depth = depth;
+	directory->parent = parent;
+	return walk->count++;
+}
+
+// Junta o caminho do pai com o nome do filho
+static char* walk_join_path(const char* parent, const char* name) {
+	size_t length = strlen(parent);
+	char* path = (char*) malloc(length + strlen(name) + 2);
+	sprintf(path, length && parent[length - 1] == '/' ? "%s%s" : "%s/%s", parent, name);
+	return path;
+}
+
+// Percorre a árvore a partir do diretório do cluster, um nível por vez, com os diretórios de cada nível divididos
+// entre as threads; a thread principal só junta os subdiretórios encontrados no próximo nível
+// path é o caminho do diretório inicial, os dos outros diretórios são montados a partir dele
+// Diretórios mais fundos que max_depth não são visitados, e ciclos de imagens corrompidas são ignorados
+// Com filter, as entradas aceitas por ele são guardadas (o filtro roda nas threads, junto com a leitura)
+// Retorna a quantidade de diretórios visitados (liberar walk com walk_destroy)
+int walk_tree(fat32_t* volume, walk_t* walk, uint32_t cluster, const char* path, uint32_t max_depth, int flags, walk_filter_t filter, void* context) {
+	// As threads leem direto do disco, então tudo que está pendente vai antes
+	flush_disk(volume);
+
+	walk_state_t state = { 0 };
+	state.volume = volume;
+	state.walk = walk;
+	state.flags = flags;
+	state.filter = filter;
+	state.filter_context = context;
+	state.max_cluster = volume->allocator.max_cluster;
+	state.cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+	state.fat = (uint32_t*) malloc(((uint64_t)state.max_cluster + 1) * sizeof(uint32_t));
+	bdev_read(volume->disk, state.fat, ((uint64_t)state.max_cluster + 1) * sizeof(uint32_t), get_fat_address(volume, 0));
+	uint64_t* visited = (uint64_t*) calloc(state.max_cluster / 64 + 1, sizeof(uint64_t));
+
+	memset(walk, 0, sizeof(walk_t));
+	walk_add_directory(walk, cluster, strdup(path), 0, UINT32_MAX);
+	if(cluster <= state.max_cluster) visited[cluster / 64] |= 1ULL << (cluster % 64);
+
+	for(uint32_t level_start = 0; level_start < walk->count;) {
+		uint32_t level_count = walk->count - level_start;
+		state.level_start = level_start;
+		state.children = (walk_child_t**) calloc(level_count, sizeof(walk_child_t*));
+		state.child_counts = (uint32_t*) calloc(level_count, sizeof(uint32_t));
+		thread_pool_run(volume->worker_count, level_count, walk_directory_task, &state);
+
+		for(uint32_t i = 0; i < level_count; i++) {
+			uint32_t parent = level_start + i;
+			walk->directories[parent].first_child = walk->count;
+			// Os filhos mais fundos que max_depth ou já visitados (ciclos) só têm o nome liberado
+			for(uint32_t j = 0; j < state.child_counts[i]; j++) {
+				walk_child_t* child = &state.children[i][j];
+				if(walk->directories[parent].depth < max_depth && !(visited[child->cluster / 64] & (1ULL << (child->cluster % 64)))) {
+					visited[child->cluster / 64] |= 1ULL << (child->cluster % 64);
+					walk_add_directory(walk, child->cluster, walk_join_path(walk->directories[parent].path, child->name), walk->directories[parent].depth + 1, parent);
+					walk->directories[parent].child_count++;
+				}
+				free(child->name);
+			}
+			free(state.children[i]);
+		}
+		free(state.children);
+		free(state.child_counts);
+		level_start += level_count;
+	}
+
+	// Os filhos vêm depois dos pais, então de trás para frente cada diretório já tem o total dos filhos
+	for(uint32_t i = walk->count; i-- > 0;) {
+		walk_directory_t* directory = &walk->directories[i];
+		directory->total_files += directory->files;
+		directory->total_bytes += directory->bytes;
+		directory->total_clusters += directory->clusters;
+		if(directory->parent == UINT32_MAX) continue;
+		walk_directory_t* parent = &walk->directories[directory->parent];
+		parent->total_directories += directory->total_directories + 1;
+		parent->total_files += directory->total_files;
+		parent->total_bytes += directory->total_bytes;
+		parent->total_clusters += directory->total_clusters;
+	}
+
+	free(visited);
+	free(state.fat);
+	return walk->count;
+}
+
+void walk_destroy(walk_t* walk) {
+	for(uint32_t i = 0; i < walk->count; i++) {
+		for(uint32_t j = 0; j < walk->directories[i].entry_count; j++) free(walk->directories[i].names[j]);
+		free(walk->directories[i].path);
+		free(walk->directories[i].entries);
+		free(walk->directories[i].names);
+	}
+	free(walk->directories);
+	memset(walk, 0, sizeof(walk_t));
+}
+
+// Resolve o caminho de um comando que percorre uma árvore (o diretório atual se for NULL)
+// Retorna o cluster do diretório ou 0 se o caminho não for um diretório (o erro já foi impresso)
+static uint32_t walk_resolve_directory(fat32_t* volume, char* image_path, const char* command) {
+	DirEntry entry;
+	uint32_t cluster;
+	if(!resolve_image_path(volume, image_path, &entry, &cluster, NULL)) {
+		command_error(volume, "%s: %s: No such file or directory\n", command, image_path);
+		return 0;
+	}
+	if(!(entry.short_dir.DIR_Attr & ATTR_DIRECTORY)) {
+		command_error(volume, "%s: %s: Not a directory\n", command, image_path);
+		return 0;
+	}
+	return cluster;
+}
+
+// Mostra o uso de cada diretório da árvore de image_path (ou do diretório atual), somado com o dos subdiretórios
+// Os subdiretórios aparecem antes do pai, como no du do Linux, e a última linha é o total
+void du(fat32_t* volume, char* image_path) {
+	if(image_path == NULL) image_path = ".";
+	uint32_t cluster = walk_resolve_directory(volume, image_path, "du");
+	if(!cluster) return;
+
+	walk_t walk;
+	walk_tree(volume, &walk, cluster, image_path, WALK_UNLIMITED_DEPTH, 0, NULL, NULL);
+
+	printf("%10s %16s %12s  %s\n", "FILES", "BYTES", "CLUSTERS", "PATH");
+	// Pós-ordem com pilha explícita, cursor guarda o próximo filho de cada diretório da pilha
+	uint32_t* stack = (uint32_t*) malloc(walk.count * sizeof(uint32_t));
+	uint32_t* cursor = (uint32_t*) calloc(walk.count, sizeof(uint32_t));
+	uint32_t top = 0;
+	stack[top++] = 0;
+	while(top) {
+		walk_directory_t* directory = &walk.directories[stack[top - 1]];
+		if(cursor[stack[top - 1]] < directory->child_count) {
+			uint32_t child = directory->first_child + cursor[stack[top - 1]]++;
+			stack[top++] = child;
+			continue;
+		}
+		printf("%10u %16lu %12lu  %s\n", directory->total_files, directory->total_bytes, directory->total_clusters, directory->path);
+		top--;
+	}
+	free(stack);
+	free(cursor);
+	walk_destroy(&walk);
+}
+
+// Diretório sendo impresso pelo tree, com a próxima entrada e o próximo subdiretório visitado
+typedef struct tree_frame {
+	uint32_t directory;
+	uint32_t entry;
+	uint32_t child;
+} tree_frame_t;
+
+// Imprime a árvore de image_path (ou do diretório atual) com o tamanho dos arquivos e o uso de cada diretório
+void tree(fat32_t* volume, char* image_path) {
+	if(image_path == NULL) image_path = ".";
+	uint32_t cluster = walk_resolve_directory(volume, image_path, "tree");
+	if(!cluster) return;
+
+	walk_t walk;
+	walk_tree(volume, &walk, cluster, image_path, WALK_UNLIMITED_DEPTH, WALK_KEEP_ENTRIES, NULL, NULL);
+	walk_directory_t* root = &walk.directories[0];
+	printf("%s (%u files, %lu bytes, %lu clusters)\n", image_path, root->total_files, root->total_bytes, root->total_clusters);
+
+	// O último nível tem a maior profundidade, e cada nível do prefixo ocupa 4 caracteres
+	uint32_t max_depth = walk.directories[walk.count - 1].depth;
+	char* prefix = (char*) malloc((max_depth + 1) * 4);
+	tree_frame_t* frames = (tree_frame_t*) malloc((max_depth + 1) * sizeof(tree_frame_t));
+	uint32_t top = 0;
+	frames[top++] = (tree_frame_t){ 0, 0, 0 };
+	while(top) {
+		tree_frame_t* frame = &frames[top - 1];
+		walk_directory_t* directory = &walk.directories[frame->directory];
+		if(frame->entry == directory->entry_count) {
+			top--;
+			continue;
+		}
+		char* name = directory->names[frame->entry];
+		DirEntry* entry = &directory->entries[frame->entry++];
+		int last = frame->entry == directory->entry_count;
+		printf("%.*s%s%s", (top - 1) * 4, prefix, last ? "`-- " : "|-- ", name);
+		if(!(entry->short_dir.DIR_Attr & ATTR_DIRECTORY)) {
+			printf(" (%u bytes)\n", entry->short_dir.DIR_FileSize);
+			continue;
+		}
+
+		// Os subdiretórios visitados estão na ordem das entradas; os outros (ciclos, clusters inválidos) ficam sem conteúdo
+		uint32_t first_cluster = (entry->short_dir.DIR_FstClusHI << 16) | entry->short_dir.DIR_FstClusLO;
+		uint32_t child = directory->first_child + frame->child;
+		if(frame->child < directory->child_count && walk.directories[child].cluster == first_cluster) {
+			frame->child++;
+			walk_directory_t* subdirectory = &walk.directories[child];
+			printf("/ (%u files, %lu bytes, %lu clusters)\n", subdirectory->total_files, subdirectory->total_bytes, subdirectory->total_clusters);
+			memcpy(prefix + (top - 1) * 4, last ? "    " : "|   ", 4);
+			frames[top++] = (tree_frame_t){ child, 0, 0 };
+		} else printf("/\n");
+	}
+	printf("\n%u directories, %u files\n", root->total_directories, root->total_files);
+
+	free(prefix);
+	free(frames);
+	walk_destroy(&walk);
+}
+
+// Predicados do find, compilados uma vez e avaliados pelas threads direto nas entradas de 32 bytes
+typedef struct find_predicates {
+	// FIND_NAME_EXACT compara o nome 8.3 já formatado, FIND_NAME_GLOB usa o padrão em maiúsculas
+	// Nos dois, o nome longo também vale, sem diferenciar maiúsculas
+	int name_mode;
+	char name[11];
+	char* pattern;
+	// Sinal do -size: 1 maior, -1 menor, 0 igual
+	int has_size;
+	int size_sign;
+	uint64_t size;
+	// Data mínima de escrita no formato da FAT
+	int has_date;
+	uint16_t date;
+	// Atributos que precisam estar todos ligados
+	uint8_t attributes;
+} find_predicates_t;
+
+#define FIND_NAME_ANY 0
+#define FIND_NAME_EXACT 1
+#define FIND_NAME_GLOB 2
+
+// Filtro do percurso: as comparações mais baratas vêm antes do nome
+// name é o nome longo da entrada, ou o 8.3 se ela não tiver
+static int find_filter(void* context, DirEntry* entry, const char* name) {
+	find_predicates_t* predicates = (find_predicates_t*) context;
+	struct ShortDirEntry* short_dir = &entry->short_dir;
+	if((short_dir->DIR_Attr & predicates->attributes) != predicates->attributes) return 0;
+	if(predicates->has_size) {
+		if(predicates->size_sign > 0 && short_dir->DIR_FileSize <= predicates->size) return 0;
+		if(predicates->size_sign < 0 && short_dir->DIR_FileSize >= predicates->size) return 0;
+		if(predicates->size_sign == 0 && short_dir->DIR_FileSize != predicates->size) return 0;
+	}
+	// As datas da FAT (ano, mês, dia do bit mais alto para o mais baixo) comparam como números
+	if(predicates->has_date && short_dir->DIR_WrtDate < predicates->date) return 0;
+	if(predicates->name_mode == FIND_NAME_ANY) return 1;
+
+	// O padrão está em maiúsculas, então o nome longo é comparado em maiúsculas também
+	char upper_name[FAT32_NAME_MAX];
+	size_t length = 0;
+	for(; name[length] && length < sizeof(upper_name) - 1; length++) upper_name[length] = toupper((unsigned char) name[length]);
+	upper_name[length] = '\0';
+	if(predicates->name_mode == FIND_NAME_EXACT) return !memcmp(short_dir->DIR_Name, predicates->name, 11) || !strcmp(upper_name, predicates->pattern);
+	if(!fnmatch(predicates->pattern, upper_name, 0)) return 1;
+	char host_name[13];
+	entry_host_name(host_name, entry);
+	return strcmp(host_name, upper_name) && !fnmatch(predicates->pattern, host_name, 0);
+}
+
+// Lê o tamanho do -size: [+|-]N com sufixo opcional k, M ou G
+// Retorna 0 se o valor for inválido
+static int find_parse_size(find_predicates_t* predicates, char* value) {
+	predicates->size_sign = *value == '+' ? 1 : *value == '-' ? -1 : 0;
+	if(predicates->size_sign) value++;
+	if(!isdigit((unsigned char) *value)) return 0;
+	char* end;
+	predicates->size = strtoull(value, &end, 10);
+	if(*end == 'k') predicates->size <<= 10;
+	else if(*end == 'M') predicates->size <<= 20;
+	else if(*end == 'G') predicates->size <<= 30;
+	else if(*end) return 0;
+	if(*end && end[1]) return 0;
+	predicates->has_size = 1;
+	return 1;
+}
+
+// Lê a data do -newer: DD/MM/AAAA, como o ls mostra, ou today
+// Retorna 0 se a data for inválida
+static int find_parse_date(find_predicates_t* predicates, char* value) {
+	if(!strcmp(value, "today")) {
+		uint16_t time_value;
+		get_current_date_time(&predicates->date, &time_value);
+	} else {
+		unsigned day, month, year;
+		char extra;
+		if(sscanf(value, "%u/%u/%u%c", &day, &month, &year, &extra) != 3) return 0;
+		if(day < 1 || day > 31 || month < 1 || month > 12 || year < 1980 || year > 2107) return 0;
+		predicates->date = ((year - 1980) << 9) | (month << 5) | day;
+	}
+	predicates->has_date = 1;
+	return 1;
+}
+
+// Lê as letras do -attr: H (oculto), S (sistema), R (somente leitura), D (diretório) e A (arquivo)
+// Retorna 0 se alguma letra for inválida
+static int find_parse_attributes(find_predicates_t* predicates, char* value) {
+	for(; *value; value++) {
+		switch(toupper((unsigned char) *value)) {
+			case 'H': predicates->attributes |= ATTR_HIDDEN; break;
+			case 'S': predicates->attributes |= ATTR_SYSTEM; break;
+			case 'R': predicates->attributes |= ATTR_READ_ONLY; break;
+			case 'D': predicates->attributes |= ATTR_DIRECTORY; break;
+			case 'A': predicates->attributes |= ATTR_ARCHIVE; break;
+			default: return 0;
+		}
+	}
+	return 1;
+}
+
+// Um nome sem curingas vira o nome 8.3 formatado e é comparado direto; os outros usam fnmatch em maiúsculas
+static void find_compile_name(find_predicates_t* predicates, char* value) {
+	predicates->pattern = strdup(value);
+	for(char* c = predicates->pattern; *c; c++) *c = toupper((unsigned char) *c);
+	if(!strpbrk(predicates->pattern, "*?[")) {
+		create_formated_name(predicates->name, predicates->pattern);
+		if(predicates->name[0]) {
+			predicates->name_mode = FIND_NAME_EXACT;
 			return;
 		}
-		if(!strcmp(currPath, ".")) return;
-		if(directory_stack_count == 0 && !strcmp(entry_new_path, "..")) return;
-
-		DirEntry aux;
-		uint32_t previous_position_disk;
-		// Procura entrada com mesmo nome no diretório
-		for(int entry_pos = 0; entry_pos < directory_stack->quantity; entry_pos++) {
-			uint8_t status_byte = directory_stack->entries[entry_pos].short_dir.DIR_Name[0];
-			// Se status_byte == E5 significa que o espaço está livre
-			if(status_byte == 0xE5) continue;
-			// Se for dir de long name ignora
-			if((directory_stack->entries[entry_pos].short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) continue;
-			
-			// Se não possui mais entradas no diretório, retorna com erro
-			if(status_byte == 0x00) {
-				printf("mv: '%s': No such file\n", entry_path);
-				return;
-			};
-
-			// Se achou o arquivo e 
-			if(!memcmp(formated_entry_path, directory_stack->entries[entry_pos].short_dir.DIR_Name, 11)) {
-				// Se não existir flag de pasta retorna com erro
-				if((directory_stack->entries[entry_pos].short_dir.DIR_Attr & ATTR_DIRECTORY) == ATTR_DIRECTORY) {
-					printf("mv: '%s': Can't move a folder\n", entry_path);
-					return;
-				};
-				
-				// Copia para o auxiliar
-				memcpy(&aux, &directory_stack->entries[entry_pos], sizeof(DirEntry));
-				
-				// Procura a posição da dir_entry para atualização na imagem
-				previous_position_disk = get_entry_disk_position(directory_stack->cluster, entry_pos);
-				break;
-			};
+	}
+	predicates->name_mode = FIND_NAME_GLOB;
+}
+
+// Gera o índice de caminhos da imagem inteira com um percurso paralelo e grava em <imagem>.idx
+// Os registros ficam na ordem do percurso, então os de cada diretório ficam juntos
+// Os caminhos usam o nome longo das entradas que têm um (o 8.3 delas é resolvido pelos diretórios)
+// Retorna a quantidade de caminhos ou 0 se não conseguir gravar
+uint32_t build_path_index(fat32_t* volume) {
+	walk_t walk;
+	walk_tree(volume, &walk, volume->bs.BPB_RootClus, "/", WALK_UNLIMITED_DEPTH, WALK_KEEP_ENTRIES, NULL, NULL);
+
+	// A raiz não tem entrada, então ganha uma montada com o cluster dela
+	DirEntry root;
+	memset(&root, 0, sizeof(DirEntry));
+	memset(root.short_dir.DIR_Name, ' ', 11);
+	root.short_dir.DIR_Name[0] = '/';
+	root.short_dir.DIR_Attr = ATTR_DIRECTORY;
+	root.short_dir.DIR_FstClusHI = volume->bs.BPB_RootClus >> 16;
+	root.short_dir.DIR_FstClusLO = volume->bs.BPB_RootClus & 0xFFFF;
+
+	path_index_builder_t builder = { 0 };
+	// Registro de cada diretório do percurso
+	uint32_t* records = (uint32_t*) malloc(walk.count * sizeof(uint32_t));
+	records[0] = path_index_add(&builder, (uint8_t*) &root, 0, 0, "/");
+	for(uint32_t d = 0; d < walk.count; d++) {
+		walk_directory_t* directory = &walk.directories[d];
+		uint32_t child = directory->first_child;
+		for(uint32_t e = 0; e < directory->entry_count; e++) {
+			DirEntry* entry = &directory->entries[e];
+			char* path = walk_join_path(directory->path, directory->names[e]);
+			uint32_t record = path_index_add(&builder, (uint8_t*) entry, records[d], directory->depth + 1, path);
+			free(path);
+
+			// Os subdiretórios visitados estão na ordem das entradas
+			uint32_t first_cluster = (entry->short_dir.DIR_FstClusHI << 16) | entry->short_dir.DIR_FstClusLO;
+			if((entry->short_dir.DIR_Attr & ATTR_DIRECTORY) && child < directory->first_child + directory->child_count &&
+				walk.directories[child].cluster == first_cluster) records[child++] = record;
+		}
+	}
+	free(records);
+	walk_destroy(&walk);
+
+	// O carimbo é tirado depois do percurso, que grava o que estava pendente
+	path_index_stamp_t stamp;
+	uint32_t count = builder.record_count;
+	if(!path_index_stamp(volume->image_name, volume->bs.BS_VolID, &stamp) || !path_index_write(&builder, volume->image_name, &stamp)) count = 0;
+	path_index_builder_destroy(&builder);
+	return count;
+}
+
+// find pelo índice de caminhos: os registros da subárvore são filtrados sem ler nenhum diretório
+// Os registros estão na ordem do percurso, então a saída é a mesma do find sem índice
+// Retorna 0 sem imprimir nada se o caminho não estiver no índice (um nome 8.3 de uma entrada com nome longo)
+static int find_indexed(fat32_t* volume, char* image_path, uint32_t max_depth, find_predicates_t* predicates) {
+	char* absolute = absolute_image_path(volume, image_path);
+	uint32_t start = path_index_lookup(volume->path_index, absolute);
+	if(start == PATH_INDEX_NONE) {
+		free(absolute);
+		return 0;
+	}
+	if(!(((DirEntry*) volume->path_index->records[start].entry)->short_dir.DIR_Attr & ATTR_DIRECTORY)) {
+		command_error(volume, "find: %s: Not a directory\n", image_path);
+		free(absolute);
+		return 1;
+	}
+
+	size_t prefix_length = strcmp(absolute, "/") ? strlen(absolute) : 0;
+	uint32_t start_depth = volume->path_index->records[start].depth;
+	for(uint32_t i = 0; i < volume->path_index->record_count; i++) {
+		path_index_record_t* record = &volume->path_index->records[i];
+		if(record->depth <= start_depth || record->depth - start_depth - 1 > max_depth) continue;
+		const char* path = path_index_path(volume->path_index, i);
+		// O caminho pedido está em maiúsculas e os do índice estão como nas entradas
+		if(strncasecmp(path, absolute, prefix_length) || path[prefix_length] != '/') continue;
+		if(!find_filter(predicates, (DirEntry*) record->entry, strrchr(path, '/') + 1)) continue;
+		char* output = walk_join_path(image_path, path + prefix_length + 1);
+		printf("%s\n", output);
+		free(output);
+	}
+	free(absolute);
+	return 1;
+}
+
+// Comando find [caminho] [-name glob] [-size [+|-]N[k|M|G]] [-newer DD/MM/AAAA|today] [-attr HSRDA] [-maxdepth N]
+// argv[0] é o caminho (o diretório atual se for omitido); todos os predicados precisam ser verdadeiros
+// Os predicados são avaliados pelas threads do percurso, que só guardam as entradas aceitas,
+// e -maxdepth corta o percurso antes de ler os diretórios mais fundos
+void find(fat32_t* volume, int argc, char** argv) {
+	char* image_path = ".";
+	int i = 0;
+	if(argc && argv[0][0] != '-') image_path = argv[i++];
+
+	find_predicates_t predicates = { 0 };
+	uint32_t max_depth = WALK_UNLIMITED_DEPTH;
+	int valid = 1;
+	for(; i < argc && valid; i += 2) {
+		char* option = argv[i];
+		char* value = i + 1 < argc ? argv[i + 1] : NULL;
+		if(value == NULL) valid = 0;
+		else if(!strcmp(option, "-name") && predicates.name_mode == FIND_NAME_ANY) find_compile_name(&predicates, value);
+		else if(!strcmp(option, "-size")) valid = find_parse_size(&predicates, value);
+		else if(!strcmp(option, "-newer")) valid = find_parse_date(&predicates, value);
+		else if(!strcmp(option, "-attr")) valid = find_parse_attributes(&predicates, value);
+		else if(!strcmp(option, "-maxdepth")) {
+			char* end;
+			unsigned long depth = strtoul(value, &end, 10);
+			// Os diretórios visitados ficam um nível acima das entradas mostradas
+			valid = isdigit((unsigned char) *value) && !*end && depth >= 1;
+			max_depth = depth - 1;
+		} else valid = 0;
+	}
+	if(!valid) {
+		command_error(volume, "find: Usage: find [path] [-name glob] [-size [+|-]N[k|M|G]] [-newer DD/MM/YYYY|today] [-attr HSRDA] [-maxdepth N]\n");
+		free(predicates.pattern);
+		return;
+	}
+
+	// Um caminho que não está no índice ainda pode passar por nomes 8.3, que são procurados nos diretórios
+	int indexed = path_index_usable(volume) && find_indexed(volume, image_path, max_depth, &predicates);
+	uint32_t cluster = indexed ? 0 : walk_resolve_directory(volume, image_path, "find");
+	if(cluster) {
+		walk_t walk;
+		walk_tree(volume, &walk, cluster, image_path, max_depth, 0, find_filter, &predicates);
+		// Os resultados saem na ordem do percurso, nível por nível
+		for(uint32_t d = 0; d < walk.count; d++) {
+			walk_directory_t* directory = &walk.directories[d];
+			for(uint32_t e = 0; e < directory->entry_count; e++) {
+				char* path = walk_join_path(directory->path, directory->names[e]);
+				printf("%s\n", path);
+				free(path);
+			}
+		}
+		walk_destroy(&walk);
+	}
+	free(predicates.pattern);
+}
+
+// ------------------------------- Verificação ------------------------------- //
+
+// Quantidade de entradas da FAT em cada fatia lida por uma thread
+#define FSCK_SLICE_ENTRIES (1024 * 1024)
+#define BAD_CLUSTER 0x0FFFFFF7
+
+// Diretório a ser verificado, com os clusters já marcados pela entrada do diretório pai
+typedef struct fsck_directory {
+	uint32_t cluster;
+	uint32_t cluster_count;
+	char* path;
+} fsck_directory_t;
+
+// Correção de uma cadeia: vira fim de cadeia no cluster e os free_after clusters seguintes são liberados
+typedef struct fsck_repair {
+	uint32_t chain_start;
+	uint32_t cluster;
+	uint32_t free_after;
+} fsck_repair_t;
+
+// Resultado de uma tarefa (uma fatia da FAT ou um diretório), juntado pela thread principal na ordem das tarefas
+typedef struct fsck_result {
+	char* messages;
+	size_t length;
+	size_t capacity;
+	uint32_t problems;
+	uint32_t files;
+	fsck_directory_t* children;
+	uint32_t child_count;
+	uint32_t child_capacity;
+	fsck_repair_t* repairs;
+	uint32_t repair_count;
+	uint32_t repair_capacity;
+	// Fatias da FAT
+	uint32_t mismatches;
+	uint32_t first_mismatch;
+	uint32_t lost_clusters;
+	uint32_t lost_chains;
+} fsck_result_t;
+
+// Estado compartilhado pelas threads
+typedef struct fsck_state {
+	fat32_t* volume;
+	// Cópia da FAT1 inteira, lida em paralelo
+	uint32_t* fat;
+	uint32_t max_cluster;
+	uint32_t slice_count;
+	// Bit 1 para clusters que pertencem a algum arquivo ou diretório (marcados atomicamente)
+	uint64_t* owned;
+	// Bit 1 para clusters perdidos apontados por outro cluster perdido (não são começo de cadeia)
+	uint64_t* pointed;
+	fsck_directory_t* level;
+	fsck_result_t* results;
+	uint8_t** buffers;
+	uint64_t cluster_size;
+} fsck_state_t;
+
+// Resultado do percurso de uma cadeia
+typedef struct fsck_chain {
+	uint32_t clusters;
+	// Último cluster marcado e o cluster na posição keep - 1 (onde a cadeia seria cortada)
+	uint32_t last;
+	uint32_t cut;
+	// Cadeia encontrou um cluster de outra cadeia
+	int cross_linked;
+	// Cadeia termina em um valor inválido (cluster livre, ruim ou fora da imagem), guardado em invalid
+	int broken;
+	uint32_t invalid;
+} fsck_chain_t;
+
+// Acrescenta uma mensagem ao resultado (as threads não imprimem direto para a saída não misturar)
+static void fsck_report(fsck_result_t* result, const char* format, ...) {
+	va_list arguments;
+	va_start(arguments, format);
+	int length = vsnprintf(NULL, 0, format, arguments);
+	va_end(arguments);
+
+	if(result->length + length + 1 > result->capacity) {
+		result->capacity = (result->length + length + 1) * 2;
+		result->messages = (char*) realloc(result->messages, result->capacity);
+	}
+	va_start(arguments, format);
+	vsnprintf(result->messages + result->length, length + 1, format, arguments);
+	va_end(arguments);
+	result->length += length;
+	result->problems++;
+}
+
+static void fsck_add_repair(fsck_result_t* result, uint32_t chain_start, uint32_t cluster, uint32_t free_after) {
+	if(result->repair_count == result->repair_capacity) {
+		result->repair_capacity = result->repair_capacity ? result->repair_capacity * 2 : 8;
+		result->repairs = (fsck_repair_t*) realloc(result->repairs, result->repair_capacity * sizeof(fsck_repair_t));
+	}
+	result->repairs[result->repair_count].chain_start = chain_start;
+	result->repairs[result->repair_count].cluster = cluster;
+	result->repairs[result->repair_count].free_after = free_after;
+	result->repair_count++;
+}
+
+static void fsck_add_child(fsck_result_t* result, uint32_t cluster, uint32_t cluster_count, char* path) {
+	if(result->child_count == result->child_capacity) {
+		result->child_capacity = result->child_capacity ? result->child_capacity * 2 : 8;
+		result->children = (fsck_directory_t*) realloc(result->children, result->child_capacity * sizeof(fsck_directory_t));
+	}
+	result->children[result->child_count].cluster = cluster;
+	result->children[result->child_count].cluster_count = cluster_count;
+	result->children[result->child_count].path = path;
+	result->child_count++;
+}
+
+static int fsck_bit(uint64_t* bitmap, uint32_t cluster) {
+	return (__atomic_load_n(&bitmap[cluster / 64], __ATOMIC_RELAXED) >> (cluster % 64)) & 1;
+}
+
+// Marca o bit atomicamente, retorna 1 se ele já estava marcado
+static int fsck_set_bit(uint64_t* bitmap, uint32_t cluster) {
+	uint64_t mask = 1ULL << (cluster % 64);
+	return (__atomic_fetch_or(&bitmap[cluster / 64], mask, __ATOMIC_RELAXED) & mask) != 0;
+}
+
+// Segue a cadeia na cópia da FAT marcando os clusters como usados por ela
+// keep é a quantidade de clusters que o tamanho do arquivo precisa (para achar o ponto de corte)
+static fsck_chain_t fsck_claim_chain(fsck_state_t* state, uint32_t first_cluster, uint32_t keep) {
+	fsck_chain_t chain = { 0 };
+	uint32_t cluster = first_cluster;
+	while(1) {
+		if(cluster < FIRST_DATA_CLUSTER || cluster > state->max_cluster) {
+			chain.broken = 1;
+			chain.invalid = cluster;
+			break;
+		}
+		if(fsck_set_bit(state->owned, cluster)) {
+			chain.cross_linked = 1;
+			break;
+		}
+		chain.clusters++;
+		chain.last = cluster;
+		if(chain.clusters == keep) chain.cut = cluster;
+
+		uint32_t next = state->fat[cluster] & FAT_ENTRY_MASK;
+		if(next >= END_OF_CHAIN) break;
+		if(next == FREE_CLUSTER || next == BAD_CLUSTER) {
+			chain.broken = 1;
+			chain.invalid = next;
+			break;
 		}
+		cluster = next;
+	}
+	return chain;
+}
+
+// Tarefa de uma thread: lê uma fatia da FAT1 para a cópia e compara com as outras FATs
+static void fsck_fat_task(void* context, uint32_t index, uint32_t worker) {
+	fsck_state_t* state = (fsck_state_t*) context;
+	fat32_t* volume = state->volume;
+	fsck_result_t* result = &state->results[index];
+	uint32_t first = index * FSCK_SLICE_ENTRIES;
+	uint32_t count = state->max_cluster + 1 - first < FSCK_SLICE_ENTRIES ? state->max_cluster + 1 - first : FSCK_SLICE_ENTRIES;
+	uint64_t fat_size = (uint64_t)volume->bs.BPB_FATSz32 * volume->bs.BPB_BytsPerSec;
+
+	bdev_read(volume->disk, state->fat + first, count * sizeof(uint32_t), get_fat_address(volume, 0) + (uint64_t)first * sizeof(uint32_t));
+
+	if(state->buffers[worker] == NULL) state->buffers[worker] = (uint8_t*) malloc(FSCK_SLICE_ENTRIES * sizeof(uint32_t));
+	uint32_t* copy = (uint32_t*) state->buffers[worker];
+	for(uint32_t fat = 1; fat < volume->bs.BPB_NumFATs; fat++) {
+		bdev_read(volume->disk, copy, count * sizeof(uint32_t), get_fat_address(volume, 0) + fat * fat_size + (uint64_t)first * sizeof(uint32_t));
+		size_t first_mismatch;
+		size_t mismatches = fat_kernels()->compare(state->fat + first, copy, count, &first_mismatch);
+		if(mismatches && result->mismatches == 0) result->first_mismatch = first + first_mismatch;
+		result->mismatches += mismatches;
+	}
+}
+
+// Verifica uma entrada de arquivo ou subdiretório, marcando a cadeia dela (name é o nome longo ou 8.3 dela)
+static void fsck_check_entry(fsck_state_t* state, fsck_result_t* result, char* parent_path, DirEntry* entry, const char* name) {
+	char* path = (char*) malloc(strlen(parent_path) + strlen(name) + 2);
+	sprintf(path, "%s/%s", parent_path, name);
+
+	int is_directory = (entry->short_dir.DIR_Attr & ATTR_DIRECTORY) != 0;
+	uint32_t first_cluster = (entry->short_dir.DIR_FstClusHI << 16) | entry->short_dir.DIR_FstClusLO;
+	uint32_t size = entry->short_dir.DIR_FileSize;
+	if(first_cluster == FREE_CLUSTER) {
+		if(is_directory) fsck_report(result, "fsck: %s: Directory without clusters\n", path);
+		else if(size) fsck_report(result, "fsck: %s: Size %u but no clusters\n", path, size);
+		if(!is_directory) result->files++;
+		free(path);
+		return;
+	}
+
+	// Arquivos vazios criados pela shell ficam com um cluster, então um cluster nunca é demais
+	uint32_t needed = is_directory ? 0 : (uint32_t)((size + state->cluster_size - 1) / state->cluster_size);
+	uint32_t keep = needed ? needed : 1;
+	fsck_chain_t chain = fsck_claim_chain(state, first_cluster, keep);
+
+	if(chain.cross_linked) fsck_report(result, "fsck: %s: Cross-linked after %u clusters\n", path, chain.clusters);
+	// A cadeia passa a terminar no último cluster válido
+	if(chain.broken) {
+		fsck_report(result, "fsck: %s: Invalid value 0x%08X in chain after %u clusters\n", path, chain.invalid, chain.clusters);
+		if(chain.clusters) fsck_add_repair(result, first_cluster, chain.last, 0);
+	}
+	if(!is_directory && chain.clusters > keep) {
+		fsck_report(result, "fsck: %s: Chain has %u clusters, size needs %u\n", path, chain.clusters, needed);
+		// Com cross-link o resto da cadeia também é de outro arquivo e não pode ser liberado
+		if(!chain.cross_linked) fsck_add_repair(result, first_cluster, chain.cut, chain.clusters - keep);
+	}
+	if(!is_directory && chain.clusters < needed && !chain.cross_linked && !chain.broken)
+		fsck_report(result, "fsck: %s: Chain has %u clusters, size needs %u\n", path, chain.clusters, needed);
+
+	if(is_directory && chain.clusters) fsck_add_child(result, first_cluster, chain.clusters, path);
+	else {
+		if(!is_directory) result->files++;
+		free(path);
+	}
+}
+
+// Tarefa de uma thread: lê um diretório pelos clusters (sem passar pelas caches) e verifica as entradas
+static void fsck_directory_task(void* context, uint32_t index, uint32_t worker) {
+	fsck_state_t* state = (fsck_state_t*) context;
+	fat32_t* volume = state->volume;
+	fsck_directory_t* directory = &state->level[index];
+	fsck_result_t* result = &state->results[index];
+
+	if(state->buffers[worker] == NULL) state->buffers[worker] = (uint8_t*) malloc(FSCK_SLICE_ENTRIES * sizeof(uint32_t));
+	DirEntry* entries = (DirEntry*) state->buffers[worker];
+	uint32_t per_cluster = state->cluster_size / sizeof(DirEntry);
+
+	// Um nome longo pode começar no cluster anterior ao da entrada curta
+	lfn_decoder_t decoder;
+	lfn_reset(&decoder);
+	char name[FAT32_NAME_MAX];
+	uint32_t cluster = directory->cluster;
+	for(uint32_t n = 0; n < directory->cluster_count; n++) {
+		bdev_read(volume->disk, entries, state->cluster_size, get_cluster_address(volume, cluster));
+		for(uint32_t i = 0; i < per_cluster; i++) {
+			uint8_t status_byte = entries[i].short_dir.DIR_Name[0];
+			if(status_byte == 0x00) return;
+			if(status_byte == 0xE5) {
+				lfn_reset(&decoder);
+				continue;
+			}
+			if((entries[i].short_dir.DIR_Attr & ATTR_LONG_NAME_MASK) == ATTR_LONG_NAME) {
+				lfn_push(&decoder, &entries[i].long_dir);
+				continue;
+			}
+			decoded_display_name(name, &entries[i], &decoder);
+			if(status_byte == '.' || (entries[i].short_dir.DIR_Attr & ATTR_VOLUME_ID)) continue;
+			fsck_check_entry(state, result, directory->path, &entries[i], name);
+		}
+		cluster = state->fat[cluster] & FAT_ENTRY_MASK;
+	}
+}
+
+// Tarefas de uma thread para as cadeias perdidas (clusters usados na FAT que não são de ninguém)
+// Primeiro marca quem é apontado por outro cluster perdido, depois conta os clusters e os começos de cadeia
+static void fsck_pointed_task(void* context, uint32_t index, uint32_t worker) {
+	fsck_state_t* state = (fsck_state_t*) context;
+	uint32_t first = index * FSCK_SLICE_ENTRIES;
+	uint32_t last = state->max_cluster + 1 - first < FSCK_SLICE_ENTRIES ? state->max_cluster : first + FSCK_SLICE_ENTRIES - 1;
+	for(uint32_t cluster = first < FIRST_DATA_CLUSTER ? FIRST_DATA_CLUSTER : first; cluster <= last; cluster++) {
+		uint32_t next = state->fat[cluster] & FAT_ENTRY_MASK;
+		if(next == FREE_CLUSTER || next == BAD_CLUSTER || fsck_bit(state->owned, cluster)) continue;
+		if(next >= FIRST_DATA_CLUSTER && next <= state->max_cluster && !fsck_bit(state->owned, next)) fsck_set_bit(state->pointed, next);
+	}
+}
 
+static void fsck_lost_task(void* context, uint32_t index, uint32_t worker) {
+	fsck_state_t* state = (fsck_state_t*) context;
+	fsck_result_t* result = &state->results[index];
+	uint32_t first = index * FSCK_SLICE_ENTRIES;
+	uint32_t last = state->max_cluster + 1 - first < FSCK_SLICE_ENTRIES ? state->max_cluster : first + FSCK_SLICE_ENTRIES - 1;
+	for(uint32_t cluster = first < FIRST_DATA_CLUSTER ? FIRST_DATA_CLUSTER : first; cluster <= last; cluster++) {
+		uint32_t next = state->fat[cluster] & FAT_ENTRY_MASK;
+		if(next == FREE_CLUSTER || next == BAD_CLUSTER || fsck_bit(state->owned, cluster)) continue;
+		result->lost_clusters++;
+		if(!fsck_bit(state->pointed, cluster)) result->lost_chains++;
+	}
+}
 
-		if(!cd_wrapper(entry_new_path, "mv")) return;
+// Copia para as outras FATs os setores da FAT1 que estão diferentes nelas
+static void fsck_repair_fat_copies(fat32_t* volume, fsck_state_t* state, uint32_t slice) {
+	uint32_t first = slice * FSCK_SLICE_ENTRIES;
+	uint32_t count = state->max_cluster + 1 - first < FSCK_SLICE_ENTRIES ? state->max_cluster + 1 - first : FSCK_SLICE_ENTRIES;
+	uint64_t fat_size = (uint64_t)volume->bs.BPB_FATSz32 * volume->bs.BPB_BytsPerSec;
+	uint64_t slice_bytes = (uint64_t)count * sizeof(uint32_t);
+	uint8_t* copy = state->buffers[0];
+
+	for(uint32_t fat = 1; fat < volume->bs.BPB_NumFATs; fat++) {
+		uint64_t copy_offset = get_fat_address(volume, 0) + fat * fat_size + (uint64_t)first * sizeof(uint32_t);
+		bdev_read(volume->disk, copy, slice_bytes, copy_offset);
+		for(uint64_t offset = 0; offset < slice_bytes; offset += volume->bs.BPB_BytsPerSec) {
+			uint64_t length = slice_bytes - offset < volume->bs.BPB_BytsPerSec ? slice_bytes - offset : volume->bs.BPB_BytsPerSec;
+			uint8_t* original = (uint8_t*)(state->fat + first) + offset;
+			if(memcmp(copy + offset, original, length)) block_cache_write(&volume->block_cache, original, length, copy_offset + offset);
+		}
+	}
+}
 
-		if(!touch_wrapper(entry_path, aux.short_dir.DIR_Attr, &aux)) return;
+// Junta o resultado de uma tarefa: imprime as mensagens e guarda as correções
+static void fsck_merge(fsck_result_t* result, fsck_repair_t** repairs, uint32_t* repair_count, uint32_t* problems) {
+	if(result->length) fwrite(result->messages, 1, result->length, stdout);
+	*problems += result->problems;
+	if(result->repair_count) {
+		*repairs = (fsck_repair_t*) realloc(*repairs, (*repair_count + result->repair_count) * sizeof(fsck_repair_t));
+		memcpy(*repairs + *repair_count, result->repairs, result->repair_count * sizeof(fsck_repair_t));
+		*repair_count += result->repair_count;
+	}
+	free(result->messages);
+	free(result->repairs);
+}
 
-		if(!strcmp(entry_new_path, "..")) cd_wrapper(currPath, "mv");
-		else cd_wrapper("..", "mv");
+// Verifica a consistência da imagem: FATs diferentes entre si, cadeias perdidas, cross-links, cadeias inválidas
+// e cadeias maiores que o tamanho do arquivo
+// A FAT é lida em fatias paralelas e o percurso é feito por nível, com os diretórios de cada nível em paralelo
+// Com repair, corrige o que dá para corrigir sem perder dados de arquivos (cross-links só são informados)
+void fsck(fat32_t* volume, int repair) {
+	// A verificação lê direto do disco, então tudo que está pendente vai antes
+	flush_disk(volume);
+
+	fsck_state_t state = { 0 };
+	state.volume = volume;
+	state.max_cluster = volume->allocator.max_cluster;
+	state.cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+	state.slice_count = (state.max_cluster + FSCK_SLICE_ENTRIES) / FSCK_SLICE_ENTRIES;
+	state.fat = (uint32_t*) malloc(((uint64_t)state.max_cluster + 1) * sizeof(uint32_t));
+	state.owned = (uint64_t*) calloc(state.max_cluster / 64 + 1, sizeof(uint64_t));
+	state.pointed = (uint64_t*) calloc(state.max_cluster / 64 + 1, sizeof(uint64_t));
+	state.buffers = (uint8_t**) calloc(volume->worker_count, sizeof(uint8_t*));
+
+	uint32_t problems = 0, file_count = 0, directory_count = 0, repair_count = 0;
+	fsck_repair_t* repairs = NULL;
+
+	// FAT1 para a memória e comparação com as outras FATs
+	state.results = (fsck_result_t*) calloc(state.slice_count, sizeof(fsck_result_t));
+	thread_pool_run(volume->worker_count, state.slice_count, fsck_fat_task, &state);
+	uint32_t mismatches = 0, first_mismatch = 0;
+	for(uint32_t i = 0; i < state.slice_count; i++) {
+		if(state.results[i].mismatches && mismatches == 0) first_mismatch = state.results[i].first_mismatch;
+		mismatches += state.results[i].mismatches;
+	}
+	if(mismatches) {
+		printf("fsck: FAT copies differ from FAT1 in %u entries (first: cluster %u)\n", mismatches, first_mismatch);
+		problems++;
+	}
 
-		fseek(disk, previous_position_disk, SEEK_SET);
-		fwrite(&AVAILABLE_ENTRY_POINTER, 1, 1, disk);
+	// Percurso por nível a partir da raiz
+	fsck_chain_t root = fsck_claim_chain(&state, volume->bs.BPB_RootClus, 1);
+	if(root.cross_linked || root.broken) {
+		command_error(volume, "fsck: /: Invalid root directory chain\n");
+		problems++;
+	}
+	uint32_t level_count = root.clusters ? 1 : 0;
+	state.level = (fsck_directory_t*) malloc(sizeof(fsck_directory_t));
+	state.level[0].cluster = volume->bs.BPB_RootClus;
+	state.level[0].cluster_count = root.clusters;
+	state.level[0].path = strdup("");
+
+	while(level_count) {
+		directory_count += level_count;
+		free(state.results);
+		state.results = (fsck_result_t*) calloc(level_count, sizeof(fsck_result_t));
+		thread_pool_run(volume->worker_count, level_count, fsck_directory_task, &state);
+
+		uint32_t next_count = 0;
+		for(uint32_t i = 0; i < level_count; i++) next_count += state.results[i].child_count;
+		fsck_directory_t* next_level = (fsck_directory_t*) malloc((next_count ? next_count : 1) * sizeof(fsck_directory_t));
+		next_count = 0;
+		for(uint32_t i = 0; i < level_count; i++) {
+			fsck_result_t* result = &state.results[i];
+			fsck_merge(result, &repairs, &repair_count, &problems);
+			file_count += result->files;
+			memcpy(next_level + next_count, result->children, result->child_count * sizeof(fsck_directory_t));
+			next_count += result->child_count;
+			free(result->children);
+			free(state.level[i].path);
+		}
+		free(state.level);
+		state.level = next_level;
+		level_count = next_count;
+	}
+	free(state.level);
+
+	// Clusters usados na FAT que nenhum arquivo ou diretório alcança
+	free(state.results);
+	state.results = (fsck_result_t*) calloc(state.slice_count, sizeof(fsck_result_t));
+	thread_pool_run(volume->worker_count, state.slice_count, fsck_pointed_task, &state);
+	thread_pool_run(volume->worker_count, state.slice_count, fsck_lost_task, &state);
+	uint32_t lost_clusters = 0, lost_chains = 0;
+	for(uint32_t i = 0; i < state.slice_count; i++) {
+		lost_clusters += state.results[i].lost_clusters;
+		lost_chains += state.results[i].lost_chains;
+	}
+	// Cadeias perdidas em ciclo não têm começo, mas ainda contam como uma cadeia
+	if(lost_clusters && lost_chains == 0) lost_chains = 1;
+	if(lost_clusters) {
+		printf("fsck: %u lost chains (%u clusters)\n", lost_chains, lost_clusters);
+		problems++;
+	}
+
+	// O df confia na contagem de livres da FSINFO, então ela precisa bater com a FAT
+	uint32_t fat_free = fat_kernels()->count_free(state.fat + FIRST_DATA_CLUSTER, state.max_cluster + 1 - FIRST_DATA_CLUSTER);
+	// 0xFFFFFFFF é a contagem desconhecida da especificação, que o df trata percorrendo a FAT, então não é problema
+	int fsinfo_stale = fsinfo_is_valid(volume) && volume->fs.FSI_Free_Count != 0xFFFFFFFF && volume->fs.FSI_Free_Count != fat_free;
+	if(fsinfo_stale) {
+		uint32_t data_clusters = state.max_cluster + 1 - FIRST_DATA_CLUSTER;
+		if(!fsinfo_free_count_is_valid(volume))
+			printf("fsck: FSInfo free count is %u, larger than the %u data clusters (FAT has %u free)\n", volume->fs.FSI_Free_Count, data_clusters, fat_free);
+		else printf("fsck: FSInfo free count is %u, FAT has %u free clusters\n", volume->fs.FSI_Free_Count, fat_free);
+		problems++;
+	}
 
-		read_dir();
+	if(repair && problems) {
+		uint32_t repaired = 0;
+		if(mismatches) {
+			if(state.buffers[0] == NULL) state.buffers[0] = (uint8_t*) malloc(FSCK_SLICE_ENTRIES * sizeof(uint32_t));
+			for(uint32_t i = 0; i < state.slice_count; i++)
+				if(state.results[i].mismatches) fsck_repair_fat_copies(volume, &state, i);
+			repaired++;
+		}
+		// As cadeias são cortadas seguindo a cópia da FAT, que é como estavam quando foram verificadas
+		uint32_t end_of_chain = END_OF_CHAIN;
+		for(uint32_t i = 0; i < repair_count; i++) {
+			// Um diretório cortado não pode continuar na cache com as entradas antigas
+			dir_cache_drop(&volume->dir_cache, repairs[i].chain_start);
+			uint32_t cluster = state.fat[repairs[i].cluster] & FAT_ENTRY_MASK;
+			write_in_fat(volume, repairs[i].cluster, &end_of_chain);
+			for(uint32_t j = 0; j < repairs[i].free_after; j++) {
+				uint32_t next = state.fat[cluster] & FAT_ENTRY_MASK;
+				write_in_fat(volume, cluster, &FREE_CLUSTER_POINTER);
+				cluster = next;
+			}
+			repaired++;
+		}
+		if(lost_clusters) {
+			for(uint32_t cluster = FIRST_DATA_CLUSTER; cluster <= state.max_cluster; cluster++) {
+				uint32_t value = state.fat[cluster] & FAT_ENTRY_MASK;
+				if(value != FREE_CLUSTER && value != BAD_CLUSTER && !fsck_bit(state.owned, cluster)) write_in_fat(volume, cluster, &FREE_CLUSTER_POINTER);
+			}
+			repaired++;
+		}
+		// Com o bitmap montado, o flush grava a FSINFO com a contagem correta
+		if(fsinfo_stale) {
+			build_free_bitmap(volume);
+			repaired++;
+		}
+		// O flush grava as duas FATs e a FSINFO com a contagem de livres do bitmap
+		flush_disk(volume);
+		printf("fsck: %u problems repaired\n", repaired);
 	}
+
+	printf("fsck: %u files, %u directories, %u problems\n", file_count, directory_count, problems);
+	// Sem -r, qualquer problema encontrado é uma falha do comando
+	if(problems && !repair) volume->command_failed = 1;
+
+	for(uint32_t i = 0; i < volume->worker_count; i++) free(state.buffers[i]);
+	free(state.buffers);
+	free(state.results);
+	free(repairs);
+	free(state.fat);
+	free(state.owned);
+	free(state.pointed);
+}
+
+// Grava no disco as alterações pendentes da FAT, da FSINFO e dos setores de metadados
+// Retorna 0 se o journal não confirmou a transação (as alterações foram gravadas sem ele)
+int flush_disk(fat32_t* volume) {
+	fat_cache_flush(&volume->fat_cache);
+
+	// Sem o bitmap montado nada foi alocado ou liberado, então a FSINFO continua como estava
+	// e ela também só é regravada se os valores mudaram desde a última vez
+	if(volume->free_bitmap_loaded && fsinfo_is_valid(volume) &&
+	   (volume->fs.FSI_Free_Count != volume->allocator.free_count || volume->fs.FSI_Nxt_Free != volume->allocator.next_free)) {
+		volume->fs.FSI_Free_Count = volume->allocator.free_count;
+		volume->fs.FSI_Nxt_Free = volume->allocator.next_free;
+		block_cache_write(&volume->block_cache, &volume->fs, sizeof(struct FSInfo), volume->fsinfo_offset);
+		volume->fsinfo_writes++;
+	}
+	if(!block_cache_flush(&volume->block_cache)) {
+		command_error(volume, "journal: Commit failed, changes written to the image without it\n");
+		return 0;
+	}
+	return 1;
+}
+
+// Grava as alterações pendentes se a cache de setores passou do limite, chamado entre comandos
+void flush_disk_if_needed(fat32_t* volume) {
+	if(block_cache_over_threshold(&volume->block_cache)) flush_disk(volume);
+}
+
+// Comando sync: grava tudo que está pendente e espera o disco confirmar
+void sync_disk(fat32_t* volume) {
+	flush_disk(volume);
+	bdev_sync(volume->disk);
 }
-*/
 
 // Fecha o disco/imagem
-void close_disk() {
-	fclose(disk);
+// Retorna 0 se as alterações pendentes não puderam passar pelo journal
+int close_disk(fat32_t* volume) {
+	int flushed = flush_disk(volume);
+	// Um índice que ficou desatualizado pelas alterações da sessão é gerado de novo para a próxima abertura
+	if(volume->path_index && !path_index_usable(volume) && !build_path_index(volume)) printf("index: %s.idx: Unable to write index\n", volume->image_name);
+	path_index_close(volume->path_index);
+	volume->path_index = NULL;
+	while(volume->directory_stack) {
+		directory_t* previous = volume->directory_stack->previous;
+		free_directory_struct(volume, volume->directory_stack);
+		volume->directory_stack = previous;
+	}
+	dir_cache_destroy(&volume->dir_cache);
+	block_cache_destroy(&volume->block_cache);
+	fat_cache_destroy(&volume->fat_cache);
+	allocator_destroy(&volume->allocator);
+	extent_map_cache_destroy(&volume->extent_maps);
+	journal_close(volume->journal);
+	bdev_close(volume->disk);
+	free(volume->image_name);
+	free(volume->region_sequence);
+	pthread_rwlock_destroy(&volume->metadata_lock);
+	pthread_mutex_destroy(&volume->cache_lock);
+	pthread_mutex_destroy(&volume->writer_lock);
+	free(volume);
+	return flushed;
+}
+
+// ------------------------------- API ------------------------------- //
+
+const char* fat32_strerror(int error) {
+	switch(error) {
+		case FAT32_OK: return "Success";
+		case FAT32_ENOENT: return "No such file or directory";
+		case FAT32_EINVAL: return "Invalid name";
+		case FAT32_EEXIST: return "Already exists";
+		case FAT32_ENOTDIR: return "Not a directory";
+		case FAT32_EISDIR: return "Is a directory";
+		case FAT32_ENOSPC: return "No space left on image";
+		case FAT32_ENOTEMPTY: return "Directory not empty";
+		case FAT32_EBUSY: return "Directory in use";
+		case FAT32_EFBIG: return "File too large";
+		default: return "Unknown error";
+	}
+}
+
+// Separa o último nome do caminho (em name, com FAT32_NAME_MAX bytes) e resolve o diretório pai dele
+// '.', '..' e a raiz não têm um nome que possa ser criado ou removido no pai (FAT32_EINVAL)
+static int resolve_parent(fat32_t* volume, const char* path, uint32_t* parent, char* name) {
+	char* copy = strdup(path);
+	// Barras no fim não fazem parte do nome
+	size_t length = strlen(copy);
+	while(length > 1 && copy[length - 1] == '/') copy[--length] = '\0';
+	char* slash = strrchr(copy, '/');
+	char* leaf = slash ? slash + 1 : copy;
+
+	int result = FAT32_OK;
+	if(!leaf[0] || !strcmp(leaf, ".") || !strcmp(leaf, "..") || strlen(leaf) >= FAT32_NAME_MAX) result = FAT32_EINVAL;
+	else {
+		strcpy(name, leaf);
+		// O pai de /NOME é a raiz e o de NOME é o diretório atual
+		if(slash == copy) slash[1] = '\0';
+		else if(slash) *slash = '\0';
+		else strcpy(copy, ".");
+
+		DirEntry found;
+		if(!resolve_image_path(volume, copy, &found, parent, NULL)) result = FAT32_ENOENT;
+		else if(!(found.short_dir.DIR_Attr & ATTR_DIRECTORY)) result = FAT32_ENOTDIR;
+	}
+	free(copy);
+	return result;
+}
+
+// Chamadas pelas threads da API: as consultas compartilham metadata_lock, as alterações a pegam sozinhas
+// e as leituras e escritas dos dados ficam fora dela
+
+int fat32_list(fat32_t* volume, const char* path, fat32_list_callback_t callback, void* context) {
+	DirEntry found;
+	uint32_t cluster;
+	pthread_rwlock_rdlock(&volume->metadata_lock);
+	int resolved = resolve_image_path(volume, (char*) path, &found, &cluster, NULL);
+	dir_cache_entry_t* directory = NULL;
+	if(resolved && (found.short_dir.DIR_Attr & ATTR_DIRECTORY)) directory = get_shared_directory(volume, cluster);
+	pthread_rwlock_unlock(&volume->metadata_lock);
+	if(!resolved) return FAT32_ENOENT;
+	if(directory == NULL) return FAT32_ENOTDIR;
+
+	// Os callbacks rodam só com a trava do diretório, então outras consultas continuam enquanto a listagem anda
+	pthread_rwlock_rdlock(&directory->lock);
+	int count = list_entries(volume, directory, callback, context);
+	pthread_rwlock_unlock(&directory->lock);
+
+	pthread_rwlock_rdlock(&volume->metadata_lock);
+	release_shared_directory(volume, directory);
+	pthread_rwlock_unlock(&volume->metadata_lock);
+	return count;
+}
+
+// fat32_stat sem as travas
+static int stat_path(fat32_t* volume, const char* path, fat32_stat_t* status) {
+	uint32_t parent;
+	char name[FAT32_NAME_MAX];
+	int result = resolve_parent(volume, path, &parent, name);
+	if(result == FAT32_OK) {
+		// Procura no pai para ter também o nome longo
+		char formated[11];
+		dir_cache_entry_t* directory = get_shared_directory(volume, parent);
+		int32_t position = find_entry_by_name(&directory->index, directory->entries, name, formated);
+		if(position >= 0) fill_stat(volume, status, &directory->entries[position], dir_index_long_name(&directory->index, position));
+		release_shared_directory(volume, directory);
+		return position >= 0 ? FAT32_OK : FAT32_ENOENT;
+	}
+	if(result != FAT32_EINVAL) return result;
+
+	// A raiz, '.' e '..' são resolvidos pelo caminho inteiro
+	DirEntry found;
+	uint32_t cluster;
+	if(!resolve_image_path(volume, (char*) path, &found, &cluster, NULL)) return FAT32_ENOENT;
+	fill_stat(volume, status, &found, NULL);
+	status->first_cluster = cluster;
+	const char* leaf = strrchr(path, '/');
+	snprintf(status->name, sizeof(status->name), "%s", leaf && leaf[1] ? leaf + 1 : (leaf ? "/" : path));
+	return FAT32_OK;
+}
+
+int fat32_stat(fat32_t* volume, const char* path, fat32_stat_t* status) {
+	pthread_rwlock_rdlock(&volume->metadata_lock);
+	int result = stat_path(volume, path, status);
+	pthread_rwlock_unlock(&volume->metadata_lock);
+	return result;
+}
+
+// Soma dos contadores de liberação das regiões da FAT que os extents do arquivo ocupam
+// Só aumenta, então qualquer cluster do arquivo liberado depois muda a soma
+static uint64_t region_sequence_sum(fat32_t* volume, image_file_t* file) {
+	uint64_t sum = 0;
+	for(uint32_t i = 0; i < file->extent_count; i++) {
+		uint32_t first = file->extents[i].physical >> FAT_REGION_SHIFT;
+		uint32_t last = (file->extents[i].physical + file->extents[i].length - 1) >> FAT_REGION_SHIFT;
+		for(uint32_t region = first; region <= last; region++) sum += __atomic_load_n(&volume->region_sequence[region], __ATOMIC_SEQ_CST);
+	}
+	return sum;
+}
+
+// Retorna os bytes lidos (0 a partir do fim do arquivo) ou o código do erro
+int64_t fat32_read(fat32_t* volume, const char* path, uint64_t offset, void* buffer, uint64_t size) {
+	while(1) {
+		fat32_stat_t status;
+		pthread_rwlock_rdlock(&volume->metadata_lock);
+		int result = stat_path(volume, path, &status);
+		if(result == FAT32_OK && (status.attributes & ATTR_DIRECTORY)) result = FAT32_EISDIR;
+		if(result != FAT32_OK || offset >= status.size || status.first_cluster < FIRST_DATA_CLUSTER) {
+			pthread_rwlock_unlock(&volume->metadata_lock);
+			return result;
+		}
+		uint64_t length = size < status.size - offset ? size : status.size - offset;
+
+		// A cópia dos extents deixa ler sem a trava; se algum cluster deles for liberado nesse meio tempo, lê de novo
+		image_file_t file;
+		open_image_file(volume, &file, status.first_cluster);
+		uint64_t sequence = region_sequence_sum(volume, &file);
+		pthread_rwlock_unlock(&volume->metadata_lock);
+
+		size_t done = image_file_io(&file, (uint8_t*) buffer, length, offset, 0);
+		int changed = region_sequence_sum(volume, &file) != sequence;
+		close_image_file(&file);
+		if(!changed) return done;
+	}
+}
+
+// Diretório pai travado por uma alteração da API
+typedef struct parent_lock {
+	dir_cache_entry_t* directory;
+} parent_lock_t;
+
+// Resolve o pai de path e pega as travas das alterações
+// Se der certo, name recebe o último nome e o chamador termina com unlock_parent (ainda dentro de metadata_lock)
+static int lock_parent(fat32_t* volume, const char* path, char* name, parent_lock_t* lock) {
+	uint32_t parent;
+	pthread_mutex_lock(&volume->writer_lock);
+	// Com writer_lock preso nada muda os metadados, então a resolução pode rodar junto com as consultas
+	pthread_rwlock_rdlock(&volume->metadata_lock);
+	int result = resolve_parent(volume, path, &parent, name);
+	if(result == FAT32_OK) lock->directory = get_shared_directory(volume, parent);
+	pthread_rwlock_unlock(&volume->metadata_lock);
+	if(result != FAT32_OK) {
+		pthread_mutex_unlock(&volume->writer_lock);
+		return result;
+	}
+
+	// Espera as listagens do diretório terminarem; com writer_lock preso, nenhuma outra alteração muda o pai enquanto isso
+	pthread_rwlock_wrlock(&lock->directory->lock);
+	pthread_rwlock_wrlock(&volume->metadata_lock);
+	return FAT32_OK;
+}
+
+static void unlock_parent(fat32_t* volume, parent_lock_t* lock) {
+	pthread_rwlock_unlock(&lock->directory->lock);
+	dir_cache_release(&volume->dir_cache, lock->directory);
+	// Grava as alterações pendentes se já houver muitas acumuladas, como a shell faz depois de cada comando
+	flush_disk_if_needed(volume);
+	pthread_rwlock_unlock(&volume->metadata_lock);
+	pthread_mutex_unlock(&volume->writer_lock);
+}
+
+// Escreve no arquivo name do pai travado, aumentando a cadeia e o tamanho se a escrita passar do fim
+// O trecho entre o fim antigo e offset é zerado; retorna os bytes escritos ou o código do erro
+// A cadeia e a entrada mudam dentro de metadata_lock, mas os dados são escritos com ela solta: writer_lock e a trava
+// do diretório já impedem outra alteração, e as consultas só veem o tamanho novo depois que a entrada é atualizada
+static int64_t write_entry_data(fat32_t* volume, parent_lock_t* lock, char* name, uint64_t offset, const void* buffer, uint64_t size) {
+	dir_cache_entry_t* directory = lock->directory;
+	char formated[11];
+	int32_t position = find_entry_by_name(&directory->index, directory->entries, name, formated);
+	if(position < 0) return formated[0] ? FAT32_ENOENT : FAT32_EINVAL;
+	DirEntry* entry = &directory->entries[position];
+	if(entry->short_dir.DIR_Attr & (ATTR_DIRECTORY | ATTR_VOLUME_ID)) return FAT32_EISDIR;
+
+	uint32_t old_size = entry->short_dir.DIR_FileSize;
+	uint64_t end = offset + size;
+	uint32_t cluster_size = volume->bs.BPB_BytsPerSec * volume->bs.BPB_SecPerClus;
+	uint32_t first_cluster = (entry->short_dir.DIR_FstClusHI << 16) | entry->short_dir.DIR_FstClusLO;
+	uint32_t chain_length = first_cluster >= FIRST_DATA_CLUSTER ? extent_map_get(&volume->extent_maps, first_cluster)->cluster_count : 0;
+
+	if(size == 0) return 0;
+
+	// Aumenta a cadeia com os clusters que faltam para o fim da escrita
+	uint32_t needed = (end + cluster_size - 1) / cluster_size;
+	if(needed > chain_length) {
+		uint32_t extra = allocate_clusters(volume, needed - chain_length);
+		if(extra == FREE_CLUSTER) return FAT32_ENOSPC;
+		if(chain_length == 0) first_cluster = extra;
+		else write_in_fat(volume, get_last_cluster_in_chain(volume, first_cluster), &extra);
+	}
+
+	image_file_t file;
+	open_image_file(volume, &file, first_cluster);
+	pthread_rwlock_unlock(&volume->metadata_lock);
+
+	// Os clusters novos e o resto do último cluster podem ter dados antigos
+	if(offset > old_size) {
+		uint64_t gap = offset - old_size;
+		uint8_t* zeros = (uint8_t*) calloc(1, gap < DATA_IO_CHUNK ? gap : DATA_IO_CHUNK);
+		for(uint64_t done = 0; done < gap;) {
+			size_t part = gap - done < DATA_IO_CHUNK ? gap - done : DATA_IO_CHUNK;
+			image_file_io(&file, zeros, part, old_size + done, 1);
+			done += part;
+		}
+		free(zeros);
+	}
+	size_t written = image_file_io(&file, (uint8_t*) buffer, size, offset, 1);
+	close_image_file(&file);
+
+	pthread_rwlock_wrlock(&volume->metadata_lock);
+	uint16_t date, time;
+	get_current_date_time(&date, &time);
+	entry->short_dir.DIR_FstClusLO = first_cluster & 0x0000FFFF;
+	entry->short_dir.DIR_FstClusHI = (first_cluster & 0xFFFF0000) >> 16;
+	if(offset + written > old_size) entry->short_dir.DIR_FileSize = offset + written;
+	entry->short_dir.DIR_WrtDate = date;
+	entry->short_dir.DIR_WrtTime = time;
+	entry->short_dir.DIR_LstAccDate = date;
+	block_cache_write(&volume->block_cache, entry, sizeof(DirEntry), get_entry_disk_position(volume, directory->cluster, position));
+	return written;
+}
+
+int64_t fat32_write(fat32_t* volume, const char* path, uint64_t offset, const void* buffer, uint64_t size) {
+	if(offset + size > UINT32_MAX) return FAT32_EFBIG;
+	char name[FAT32_NAME_MAX];
+	parent_lock_t lock;
+	int result = lock_parent(volume, path, name, &lock);
+	if(result != FAT32_OK) return result;
+
+	int64_t written = write_entry_data(volume, &lock, name, offset, buffer, size);
+	unlock_parent(volume, &lock);
+	return written;
+}
+
+// create_entry e remove_entry trabalham no diretório atual, então o pai fica no topo da pilha só enquanto
+// metadata_lock está presa (as consultas com caminho relativo usam a pilha)
+int fat32_create(fat32_t* volume, const char* path, int directory) {
+	char name[FAT32_NAME_MAX];
+	parent_lock_t lock;
+	int result = lock_parent(volume, path, name, &lock);
+	if(result != FAT32_OK) return result;
+
+	directory_t* previous = enter_directory(volume, lock.directory->cluster);
+	result = create_entry(volume, name, directory ? ATTR_DIRECTORY : ATTR_ARCHIVE, NULL);
+	leave_directory(volume, previous);
+	unlock_parent(volume, &lock);
+	return result;
+}
+
+// Remove um arquivo ou um diretório vazio
+int fat32_remove(fat32_t* volume, const char* path) {
+	char name[FAT32_NAME_MAX];
+	parent_lock_t lock;
+	int result = lock_parent(volume, path, name, &lock);
+	if(result != FAT32_OK) return result;
+
+	directory_t* previous = enter_directory(volume, lock.directory->cluster);
+	result = remove_entry(volume, name, REMOVE_FILE | REMOVE_DIRECTORY);
+	leave_directory(volume, previous);
+	unlock_parent(volume, &lock);
+	return result;
 }
\ No newline at end of file
@@ -3,7 +3,12 @@
  *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
  *    Creation Date: 30 / 06 / 2022
  * */
+#ifndef FAT32_H
+#define FAT32_H
+
 #include <stdint.h>
+#include "fat_cache.h"
+#include "allocator.h"
 
 // FLAGS
 #define ATTR_READ_ONLY 0x01
@@ -98,46 +103,183 @@ typedef union {
 	struct LongDirEntry long_dir;
 } DirEntry;
 
+// Maior nome em UTF-8 com o '\0' (um nome longo tem no máximo 260 caracteres UTF-16, cada um com até 3 bytes)
+#define FAT32_NAME_MAX (260 * 3 + 1)
+
 // Struct de diretório para guardar informações
 typedef struct directory {
 	DirEntry* entries;
 	uint32_t quantity;
 	struct directory* previous;
-	char name[260];
+	// Nome do diretório no caminho (o nome longo pode ter até FAT32_NAME_MAX bytes)
+	char name[FAT32_NAME_MAX];
 	uint32_t cluster;
+	// Entrada da cache de diretórios que guarda as entries
+	struct dir_cache_entry* cached;
 } directory_t;
 
-// Pilha de diretórios
-extern directory_t* directory_stack;
-// Contador da pilha
-extern uint32_t directory_stack_count;
+// Flags do percurso paralelo (walk_tree)
+// Guarda as entradas válidas de cada diretório em walk_directory_t.entries
+#define WALK_KEEP_ENTRIES 0x1
+// Sem limite de profundidade
+#define WALK_UNLIMITED_DEPTH UINT32_MAX
+
+// Diretório visitado pelo percurso paralelo
+typedef struct walk_directory {
+	// Caminho montado a partir do caminho inicial passado para walk_tree
+	char* path;
+	uint32_t cluster;
+	// Profundidade a partir do diretório inicial (0)
+	uint32_t depth;
+	// Índice do pai em walk_t.directories (UINT32_MAX no diretório inicial)
+	uint32_t parent;
+	// Os subdiretórios visitados ficam juntos no vetor, na ordem das entradas
+	uint32_t first_child;
+	uint32_t child_count;
+	// Uso do próprio diretório: arquivos, tamanho lógico e clusters alocados (os do diretório inclusos)
+	uint32_t files;
+	uint64_t bytes;
+	uint64_t clusters;
+	// Uso somado com o de todos os subdiretórios visitados
+	uint32_t total_directories;
+	uint32_t total_files;
+	uint64_t total_bytes;
+	uint64_t total_clusters;
+	// Entradas de arquivos e subdiretórios (sem '.', '..', apagadas e nomes longos) guardadas com WALK_KEEP_ENTRIES
+	// ou aceitas pelo filtro, e o nome de cada uma (o nome longo, se tiver, senão o 8.3)
+	DirEntry* entries;
+	char** names;
+	uint32_t entry_count;
+} walk_directory_t;
+
+// Filtro chamado pelas threads do percurso para cada entrada de arquivo ou subdiretório, com o nome longo ou 8.3 dela
+// Retorna diferente de 0 para guardar a entrada em walk_directory_t.entries; não pode alterar estado compartilhado
+typedef int (*walk_filter_t)(void* context, DirEntry* entry, const char* name);
+
+// Resultado do percurso, os pais sempre vêm antes dos filhos e cada nível vem inteiro antes do próximo
+typedef struct walk {
+	walk_directory_t* directories;
+	uint32_t count;
+	uint32_t capacity;
+} walk_t;
+
+// Opções de montagem da imagem
+typedef struct mount_options {
+	// Orçamento de memória da cache da FAT em bytes
+	uint64_t fat_cache_size;
+	// Backend de acesso à imagem (BDEV_PREAD ou BDEV_MMAP)
+	int backend;
+	// Orçamento de memória da cache de diretórios em bytes
+	uint64_t dir_cache_size;
+	// Se 1, os metadados passam pelo journal <imagem>.journal
+	int journal;
+	// Quantidade de threads das cópias paralelas (0 usa uma por processador)
+	uint32_t threads;
+	// Se 1, usa o índice de caminhos <imagem>.idx (gerado de novo se estiver desatualizado)
+	int path_index;
+} mount_options_t;
+
+// Imagem montada, criada por read_disk e liberada por close_disk
+// Os campos ficam em fat32.c; cada imagem tem as próprias caches e o próprio diretório atual
+typedef struct fat32 fat32_t;
+
+// Códigos de erro das funções da API (fat32_list, fat32_stat, ...), sempre negativos
+#define FAT32_OK 0
+#define FAT32_ENOENT -1
+#define FAT32_EINVAL -2
+#define FAT32_EEXIST -3
+#define FAT32_ENOTDIR -4
+#define FAT32_EISDIR -5
+#define FAT32_ENOSPC -6
+#define FAT32_ENOTEMPTY -7
+#define FAT32_EBUSY -8
+#define FAT32_EFBIG -9
+
+// Entrada de diretório vista pela API
+typedef struct fat32_stat {
+	// Nome longo, se a entrada tiver um, senão o nome 8.3 (NOME.EXT)
+	char name[FAT32_NAME_MAX];
+	DirEntry entry;
+	// Primeiro cluster (a raiz no lugar de 0 para os diretórios)
+	uint32_t first_cluster;
+	uint32_t size;
+	uint8_t attributes;
+} fat32_stat_t;
+
+// Chamada por fat32_list para cada entrada, retorna diferente de 0 para parar a listagem
+// Não pode alterar a imagem
+typedef int (*fat32_list_callback_t)(void* context, const fat32_stat_t* status);
 
 directory_t* create_directory_struct(directory_t* previous, char* name);
 
-void read_disk(const char *disk_name);
-void close_disk();
-
-uint32_t get_fat_address(uint32_t sector);
-uint64_t get_cluster_offset(uint64_t sector);
-uint32_t get_cluster_info(uint64_t sector);
-uint32_t get_entry_disk_position(uint32_t cluster, int entry_pos);
-uint32_t allocate_clusters(uint32_t cluster_count);
-uint32_t get_last_cluster_in_chain(uint32_t chain_start);
-
-void write_in_fat(uint32_t cluster, uint32_t* value);
-
-void info();
-void read_dir();
-void ls();
-void cluster(int i);
-void cd(char* folder);
-void pwd();
-void attr(char* entry_name);
-void rename_dir_entry(char* entry_name, char* new_name);
-void rm(char* entry_name);
-void touch(char* file_name);
-void mkdir(char* entry_name);
-void rmdir(char* entry_name);
+fat32_t* read_disk(const char *disk_name, mount_options_t* options);
+int close_disk(fat32_t* volume);
+int flush_disk(fat32_t* volume);
+void sync_disk(fat32_t* volume);
+void flush_disk_if_needed(fat32_t* volume);
+void command_error(fat32_t* volume, const char* format, ...);
+int take_command_failure(fat32_t* volume);
+const char* current_directory_name(fat32_t* volume);
+
+uint32_t get_fat_address(fat32_t* volume, uint32_t sector);
+uint64_t get_cluster_offset(fat32_t* volume, uint64_t sector);
+uint64_t get_cluster_address(fat32_t* volume, uint32_t cluster);
+uint32_t get_cluster_info(fat32_t* volume, uint64_t sector);
+uint32_t get_chain_cluster(fat32_t* volume, uint32_t chain_start, uint32_t index);
+uint64_t get_entry_disk_position(fat32_t* volume, uint32_t cluster, int entry_pos);
+uint32_t allocate_clusters(fat32_t* volume, uint32_t cluster_count);
+extent_t* reserve_extents(fat32_t* volume, uint32_t cluster_count, uint32_t* extent_count);
+extent_t* allocate_extents(fat32_t* volume, uint32_t cluster_count, uint32_t* extent_count);
+void free_chain(fat32_t* volume, uint32_t chain_start);
+uint32_t get_last_cluster_in_chain(fat32_t* volume, uint32_t chain_start);
+
+void write_in_fat(fat32_t* volume, uint32_t cluster, uint32_t* value);
+
+void info(fat32_t* volume);
+void cache_info(fat32_t* volume);
+void df(fat32_t* volume);
+DirEntry* load_dir_entries(void* context, uint32_t cluster, uint32_t* quantity);
+void read_dir(fat32_t* volume);
+int32_t find_in_current_dir(fat32_t* volume, char* name);
+void ls(fat32_t* volume);
+void cluster(fat32_t* volume, int i);
+void cat(fat32_t* volume, char* file_name);
+void cd(fat32_t* volume, char* folder);
+void cd_path(fat32_t* volume, char* path);
+void pwd(fat32_t* volume);
+void attr(fat32_t* volume, char* entry_name);
+void rename_dir_entry(fat32_t* volume, char* entry_name, char* new_name);
+void remove_dir_entry(fat32_t* volume, int32_t entry_pos, int free_clusters);
+void rm(fat32_t* volume, char* entry_name);
+void touch(fat32_t* volume, char* file_name);
+void mkdir(fat32_t* volume, char* entry_name);
+void prealloc(fat32_t* volume, char* file_name, char* size_str);
+void fill_new_entry(DirEntry* entry, uint32_t first_cluster, uint32_t size, uint8_t attr);
+void cp(fat32_t* volume, char* source, char* destination);
+void mv(fat32_t* volume, char* source, char* destination);
+void import(fat32_t* volume, char* host_directory, char* name);
+void extract(fat32_t* volume, char* image_path, char* host_directory);
+int walk_tree(fat32_t* volume, walk_t* walk, uint32_t cluster, const char* path, uint32_t max_depth, int flags, walk_filter_t filter, void* context);
+void walk_destroy(walk_t* walk);
+void du(fat32_t* volume, char* image_path);
+void tree(fat32_t* volume, char* image_path);
+void find(fat32_t* volume, int argc, char** argv);
+uint32_t build_path_index(fat32_t* volume);
+int path_index_usable(fat32_t* volume);
+char* absolute_image_path(fat32_t* volume, char* path);
+void fsck(fat32_t* volume, int repair);
+void rmdir(fat32_t* volume, char* entry_name);
 
 void create_formated_name(char* name, char* unformatted_name);
-void print_name(char* name);
\ No newline at end of file
+void print_name(char* name);
+
+// API: caminhos relativos ao diretório atual ou absolutos, retornos negativos são os códigos FAT32_E*
+const char* fat32_strerror(int error);
+int fat32_list(fat32_t* volume, const char* path, fat32_list_callback_t callback, void* context);
+int fat32_stat(fat32_t* volume, const char* path, fat32_stat_t* status);
+int64_t fat32_read(fat32_t* volume, const char* path, uint64_t offset, void* buffer, uint64_t size);
+int64_t fat32_write(fat32_t* volume, const char* path, uint64_t offset, const void* buffer, uint64_t size);
+int fat32_create(fat32_t* volume, const char* path, int directory);
+int fat32_remove(fat32_t* volume, const char* path);
+
+#endif
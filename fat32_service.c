@@ -0,0 +1,81 @@
+/**
+ *    Descrição: Tradução das requisições do servidor (-S) para as funções da API da FAT32
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <stdlib.h>
+#include <string.h>
+#include "fat32_service.h"
+
+// Acrescenta a mensagem do erro como dados da resposta e retorna o próprio código
+static int32_t service_error(server_buffer_t* payload, int32_t error) {
+	const char* message = error == SERVER_EPROTO ? "Bad request" : fat32_strerror(error);
+	server_buffer_append(payload, message, strlen(message));
+	return error;
+}
+
+// Acrescenta a entrada no formato do protocolo (callback de fat32_list, context é o buffer da resposta)
+static int append_entry(void* context, const fat32_stat_t* status) {
+	server_buffer_t* payload = (server_buffer_t*) context;
+	server_entry_t entry;
+	entry.size = status->size;
+	entry.first_cluster = status->first_cluster;
+	entry.write_date = status->entry.short_dir.DIR_WrtDate;
+	entry.write_time = status->entry.short_dir.DIR_WrtTime;
+	entry.attributes = status->attributes;
+	entry.name_length = strlen(status->name);
+	server_buffer_append(payload, &entry, sizeof(entry));
+	server_buffer_append(payload, status->name, entry.name_length);
+	return 0;
+}
+
+int32_t fat32_service_handle(void* context, const uint8_t* request, uint32_t size, server_buffer_t* payload) {
+	fat32_t* volume = (fat32_t*) context;
+	server_request_t header;
+	memcpy(&header, request, sizeof(header));
+
+	// O quadro tem que ter exatamente o cabeçalho, o caminho e os dados da escrita
+	uint64_t data_size = header.opcode == SERVER_WRITE ? header.size : 0;
+	if(header.path_length == 0 || sizeof(header) + header.path_length + data_size != size || header.size > SERVER_MAX_DATA)
+		return service_error(payload, SERVER_EPROTO);
+
+	char* path = (char*) malloc(header.path_length + 1);
+	memcpy(path, request + sizeof(header), header.path_length);
+	path[header.path_length] = '\0';
+	const uint8_t* data = request + sizeof(header) + header.path_length;
+
+	int64_t result;
+	switch(header.opcode) {
+		case SERVER_LIST:
+			result = fat32_list(volume, path, append_entry, payload);
+			break;
+		case SERVER_STAT: {
+			fat32_stat_t status;
+			result = fat32_stat(volume, path, &status);
+			if(result == FAT32_OK) append_entry(payload, &status);
+			break;
+		}
+		case SERVER_READ: {
+			// Lê direto no buffer da resposta e devolve o que sobrar do espaço reservado
+			void* buffer = server_buffer_reserve(payload, header.size);
+			result = fat32_read(volume, path, header.offset, buffer, header.size);
+			payload->size -= header.size - (result > 0 ? result : 0);
+			break;
+		}
+		case SERVER_WRITE:
+			result = fat32_write(volume, path, header.offset, data, header.size);
+			break;
+		case SERVER_CREATE:
+			result = fat32_create(volume, path, header.flags & SERVER_CREATE_DIRECTORY);
+			break;
+		case SERVER_DELETE:
+			result = fat32_remove(volume, path);
+			break;
+		default:
+			result = SERVER_EPROTO;
+	}
+	free(path);
+
+	if(result < 0) return service_error(payload, result);
+	return result;
+}
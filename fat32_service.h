@@ -0,0 +1,16 @@
+/**
+ *    Descrição: Tradução das requisições do servidor (-S) para as funções da API da FAT32
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#ifndef FAT32_SERVICE_H
+#define FAT32_SERVICE_H
+
+#include <stdint.h>
+#include "fat32.h"
+#include "server.h"
+
+// server_handler_t com o fat32_t* da imagem montada como contexto
+int32_t fat32_service_handle(void* context, const uint8_t* request, uint32_t size, server_buffer_t* payload);
+
+#endif
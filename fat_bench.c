@@ -0,0 +1,106 @@
+/**
+ *    Descrição: Microbenchmark dos kernels da FAT (make bench), compara cada conjunto de instruções com o escalar
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fat_simd.h"
+
+// FAT sintética de 64 MiB (a FAT de uma imagem de 64 GiB com clusters de 4 KiB)
+#define BENCH_ENTRIES (16 * 1024 * 1024)
+#define BENCH_REPEAT 5
+// Sequência livre procurada, só existe uma perto do fim da FAT
+#define BENCH_RUN 4096
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Cadeias usadas entremeadas com buracos livres pequenos, alguns com os 4 bits de cima ligados (continuam livres)
+static void fill_fat(uint32_t* fat, uint32_t* copy) {
+	srand(42);
+	size_t i = 0;
+	while(i < BENCH_ENTRIES) {
+		size_t used = 1 + rand() % 200, holes = 1 + rand() % 16;
+		for(size_t j = 0; j < used && i < BENCH_ENTRIES; j++, i++) fat[i] = i + 1 < BENCH_ENTRIES ? i + 1 : 0x0FFFFFFF;
+		for(size_t j = 0; j < holes && i < BENCH_ENTRIES; j++, i++) fat[i] = rand() % 8 ? 0 : 0xF0000000;
+	}
+	size_t run_start = BENCH_ENTRIES - 2 * BENCH_RUN;
+	for(i = run_start; i < run_start + BENCH_RUN; i++) fat[i] = 0;
+
+	memcpy(copy, fat, BENCH_ENTRIES * sizeof(uint32_t));
+	for(i = 0; i < 64; i++) copy[BENCH_ENTRIES / 2 + i * 9973] ^= 1;
+}
+
+// Melhor tempo de BENCH_REPEAT execuções, em segundos
+#define TIME_BEST(best, call) do { \
+	best = 1e9; \
+	for(int r = 0; r < BENCH_REPEAT; r++) { \
+		double start = now(); \
+		call; \
+		double elapsed = now() - start; \
+		if(elapsed < best) best = elapsed; \
+	} \
+} while(0)
+
+int main() {
+	uint32_t* fat = (uint32_t*) malloc(BENCH_ENTRIES * sizeof(uint32_t));
+	uint32_t* copy = (uint32_t*) malloc(BENCH_ENTRIES * sizeof(uint32_t));
+	uint64_t* bitmap = (uint64_t*) malloc(BENCH_ENTRIES / 64 * sizeof(uint64_t));
+	uint64_t* reference_bitmap = (uint64_t*) calloc(BENCH_ENTRIES / 64, sizeof(uint64_t));
+	fill_fat(fat, copy);
+
+	const fat_kernels_t* scalar = fat_kernels_by_name("scalar");
+	uint32_t reference_free = scalar->count_free(fat, BENCH_ENTRIES);
+	size_t reference_run = scalar->find_free_run(fat, BENCH_ENTRIES, BENCH_RUN);
+	size_t reference_first, reference_mismatches = scalar->compare(fat, copy, BENCH_ENTRIES, &reference_first);
+	scalar->mark_used(fat, BENCH_ENTRIES, reference_bitmap);
+
+	printf("%d entries (%d MiB), best of %d, selected kernels: %s\n\n", BENCH_ENTRIES, BENCH_ENTRIES / (256 * 1024), BENCH_REPEAT, fat_kernels()->name);
+	printf("%-8s %-14s %10s %10s %8s\n", "kernels", "operation", "ms", "GiB/s", "speedup");
+
+	double scalar_times[4] = { 0 };
+	const char* operations[4] = { "count_free", "mark_used", "find_free_run", "compare" };
+	// Do pior para o melhor, assim o escalar é medido primeiro
+	int kernel_count = 0;
+	while(fat_kernels_name(kernel_count)) kernel_count++;
+	for(int k = kernel_count - 1; k >= 0; k--) {
+		const fat_kernels_t* kernels = fat_kernels_by_name(fat_kernels_name(k));
+		if(kernels == NULL) {
+			printf("%-8s not supported by this processor\n", fat_kernels_name(k));
+			continue;
+		}
+
+		double times[4];
+		uint32_t free_count = 0;
+		size_t run = 0, first = 0, mismatches = 0;
+		TIME_BEST(times[0], free_count = kernels->count_free(fat, BENCH_ENTRIES));
+		TIME_BEST(times[1], memset(bitmap, 0, BENCH_ENTRIES / 8); kernels->mark_used(fat, BENCH_ENTRIES, bitmap));
+		TIME_BEST(times[2], run = kernels->find_free_run(fat, BENCH_ENTRIES, BENCH_RUN));
+		TIME_BEST(times[3], mismatches = kernels->compare(fat, copy, BENCH_ENTRIES, &first));
+
+		// Todos os conjuntos têm que dar o mesmo resultado do escalar
+		int correct = free_count == reference_free && run == reference_run && mismatches == reference_mismatches
+			&& first == reference_first && !memcmp(bitmap, reference_bitmap, BENCH_ENTRIES / 8);
+		if(kernels == scalar) memcpy(scalar_times, times, sizeof(times));
+
+		for(int op = 0; op < 4; op++) {
+			double bytes = (double) BENCH_ENTRIES * sizeof(uint32_t) * (op == 3 ? 2 : 1);
+			printf("%-8s %-14s %10.2f %10.2f", kernels->name, operations[op], times[op] * 1e3, bytes / times[op] / (1 << 30));
+			if(kernels == scalar || scalar_times[0] == 0) printf("%8s\n", "-");
+			else printf("%7.1fx\n", scalar_times[op] / times[op]);
+		}
+		if(!correct) printf("%-8s RESULTS DIFFER FROM SCALAR\n", kernels->name);
+	}
+
+	free(fat);
+	free(copy);
+	free(bitmap);
+	free(reference_bitmap);
+	return 0;
+}
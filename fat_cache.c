@@ -0,0 +1,170 @@
+/**
+ *    Descrição: Cache paginada (LRU, write-back) das entradas da FAT
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <stdlib.h>
+#include <string.h>
+#include "fat_cache.h"
+
+// Quantidade mínima de páginas mantidas em memória, independente do orçamento
+#define FAT_CACHE_MIN_PAGES 4
+// Quantidade máxima de páginas juntadas em uma escrita do flush
+#define FAT_CACHE_FLUSH_RUN 64
+
+// Tamanho em bytes de uma página (a última página pode ser parcial)
+static uint32_t page_bytes(fat_cache_t* cache, uint32_t page) {
+	uint64_t start = (uint64_t)page * FAT_CACHE_PAGE_SIZE;
+	uint64_t remaining = cache->fat_size - start;
+	return remaining < FAT_CACHE_PAGE_SIZE ? remaining : FAT_CACHE_PAGE_SIZE;
+}
+
+// Remove a página da lista do LRU
+static void lru_unlink(fat_cache_t* cache, fat_cache_page_t* page) {
+	if(page->prev) page->prev->next = page->next;
+	else cache->lru_head = page->next;
+	if(page->next) page->next->prev = page->prev;
+	else cache->lru_tail = page->prev;
+	page->prev = page->next = NULL;
+}
+
+// Coloca a página na cabeça do LRU (mais recente)
+static void lru_push_front(fat_cache_t* cache, fat_cache_page_t* page) {
+	page->prev = NULL;
+	page->next = cache->lru_head;
+	if(cache->lru_head) cache->lru_head->prev = page;
+	cache->lru_head = page;
+	if(!cache->lru_tail) cache->lru_tail = page;
+}
+
+// Escreve uma página em todas as cópias da FAT
+static void write_page(fat_cache_t* cache, fat_cache_page_t* page) {
+	uint32_t size = page_bytes(cache, page->page);
+	for(int i = 0; i < cache->fat_count; i++) {
+		uint64_t address = cache->fat_offset + i * cache->fat_size + (uint64_t)page->page * FAT_CACHE_PAGE_SIZE;
+		bdev_write(cache->disk, page->entries, size, address);
+	}
+	page->dirty = 0;
+	cache->writebacks++;
+}
+
+// Inicializa a cache com o orçamento de memória em bytes
+void fat_cache_init(fat_cache_t* cache, block_device_t* disk, uint64_t fat_offset, uint64_t fat_size, uint8_t fat_count, uint64_t budget) {
+	memset(cache, 0, sizeof(fat_cache_t));
+	cache->disk = disk;
+	cache->fat_offset = fat_offset;
+	cache->fat_size = fat_size;
+	cache->fat_count = fat_count;
+	cache->page_count = (fat_size + FAT_CACHE_PAGE_SIZE - 1) / FAT_CACHE_PAGE_SIZE;
+
+	cache->max_pages = budget / FAT_CACHE_PAGE_SIZE;
+	if(cache->max_pages < FAT_CACHE_MIN_PAGES) cache->max_pages = FAT_CACHE_MIN_PAGES;
+
+	cache->lookup = (fat_cache_page_t**) calloc(cache->page_count, sizeof(fat_cache_page_t*));
+}
+
+// Libera toda a memória da cache (as páginas sujas devem ser gravadas antes com fat_cache_flush)
+void fat_cache_destroy(fat_cache_t* cache) {
+	fat_cache_page_t* page = cache->lru_head;
+	while(page) {
+		fat_cache_page_t* next = page->next;
+		free(page->entries);
+		free(page);
+		page = next;
+	}
+	free(cache->lookup);
+	memset(cache, 0, sizeof(fat_cache_t));
+}
+
+// Retorna a página que contém o cluster, carregando do disco se necessário
+static fat_cache_page_t* get_page(fat_cache_t* cache, uint32_t cluster) {
+	uint32_t page_number = cluster / (FAT_CACHE_PAGE_SIZE / sizeof(uint32_t));
+	fat_cache_page_t* page = cache->lookup[page_number];
+
+	if(page) {
+		cache->hits++;
+		if(cache->lru_head != page) {
+			lru_unlink(cache, page);
+			lru_push_front(cache, page);
+		}
+		return page;
+	}
+
+	cache->misses++;
+
+	// Se a cache está cheia reaproveita a página menos usada, gravando antes se estiver suja
+	if(cache->loaded_pages >= cache->max_pages) {
+		page = cache->lru_tail;
+		lru_unlink(cache, page);
+		if(page->dirty) write_page(cache, page);
+		cache->lookup[page->page] = NULL;
+		cache->evictions++;
+	} else {
+		page = (fat_cache_page_t*) calloc(1, sizeof(fat_cache_page_t));
+		page->entries = (uint32_t*) malloc(FAT_CACHE_PAGE_SIZE);
+		cache->loaded_pages++;
+	}
+
+	page->page = page_number;
+	page->dirty = 0;
+	bdev_read(cache->disk, page->entries, page_bytes(cache, page_number), cache->fat_offset + (uint64_t)page_number * FAT_CACHE_PAGE_SIZE);
+
+	cache->lookup[page_number] = page;
+	lru_push_front(cache, page);
+	return page;
+}
+
+// Verifica se o cluster possui entrada dentro da FAT
+static int in_fat(fat_cache_t* cache, uint32_t cluster) {
+	return (uint64_t)cluster * sizeof(uint32_t) < cache->fat_size;
+}
+
+// Lê a entrada da FAT do cluster, clusters fora da FAT são tratados como fim de cadeia
+uint32_t fat_cache_get(fat_cache_t* cache, uint32_t cluster) {
+	if(!in_fat(cache, cluster)) return 0xFFFFFFFF;
+	fat_cache_page_t* page = get_page(cache, cluster);
+	return page->entries[cluster % (FAT_CACHE_PAGE_SIZE / sizeof(uint32_t))];
+}
+
+// Escreve a entrada da FAT do cluster, a gravação no disco só acontece no flush ou quando a página sai da cache
+void fat_cache_set(fat_cache_t* cache, uint32_t cluster, uint32_t value) {
+	if(!in_fat(cache, cluster)) return;
+	fat_cache_page_t* page = get_page(cache, cluster);
+	page->entries[cluster % (FAT_CACHE_PAGE_SIZE / sizeof(uint32_t))] = value;
+	page->dirty = 1;
+}
+
+// Grava todas as páginas sujas em ordem crescente, juntando páginas vizinhas em uma única escrita
+void fat_cache_flush(fat_cache_t* cache) {
+	uint8_t* run = (uint8_t*) malloc(FAT_CACHE_FLUSH_RUN * FAT_CACHE_PAGE_SIZE);
+
+	uint32_t page_number = 0;
+	while(page_number < cache->page_count) {
+		fat_cache_page_t* page = cache->lookup[page_number];
+		if(!page || !page->dirty) {
+			page_number++;
+			continue;
+		}
+
+		// Junta as páginas sujas consecutivas em um buffer contíguo
+		uint32_t run_start = page_number;
+		uint64_t run_size = 0;
+		while(page_number < cache->page_count && page_number - run_start < FAT_CACHE_FLUSH_RUN) {
+			page = cache->lookup[page_number];
+			if(!page || !page->dirty) break;
+			uint32_t size = page_bytes(cache, page_number);
+			memcpy(run + run_size, page->entries, size);
+			run_size += size;
+			page->dirty = 0;
+			cache->writebacks++;
+			page_number++;
+		}
+
+		for(int i = 0; i < cache->fat_count; i++) {
+			uint64_t address = cache->fat_offset + i * cache->fat_size + (uint64_t)run_start * FAT_CACHE_PAGE_SIZE;
+			bdev_write(cache->disk, run, run_size, address);
+		}
+	}
+
+	free(run);
+}
@@ -0,0 +1,57 @@
+/**
+ *    Descrição: Cache paginada (LRU, write-back) das entradas da FAT
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#ifndef FAT_CACHE_H
+#define FAT_CACHE_H
+
+#include <stdint.h>
+#include "block_device.h"
+
+// Tamanho de cada página da cache em bytes (1024 entradas da FAT)
+#define FAT_CACHE_PAGE_SIZE 4096
+// Orçamento de memória padrão da cache
+#define FAT_CACHE_DEFAULT_BUDGET (4 * 1024 * 1024)
+
+// Página da FAT carregada em memória
+typedef struct fat_cache_page {
+	uint32_t page;
+	uint8_t dirty;
+	uint32_t* entries;
+	// Lista duplamente encadeada do LRU (mais recente na cabeça)
+	struct fat_cache_page* prev;
+	struct fat_cache_page* next;
+} fat_cache_page_t;
+
+// Estado da cache da FAT
+typedef struct fat_cache {
+	block_device_t* disk;
+	// Offset em bytes da FAT1, tamanho de cada cópia e quantidade de cópias
+	uint64_t fat_offset;
+	uint64_t fat_size;
+	uint8_t fat_count;
+
+	uint32_t page_count;
+	uint32_t max_pages;
+	uint32_t loaded_pages;
+	// Tabela página -> página carregada (NULL se não estiver em memória)
+	fat_cache_page_t** lookup;
+	fat_cache_page_t* lru_head;
+	fat_cache_page_t* lru_tail;
+
+	// Contadores
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	uint64_t writebacks;
+} fat_cache_t;
+
+void fat_cache_init(fat_cache_t* cache, block_device_t* disk, uint64_t fat_offset, uint64_t fat_size, uint8_t fat_count, uint64_t budget);
+void fat_cache_destroy(fat_cache_t* cache);
+
+uint32_t fat_cache_get(fat_cache_t* cache, uint32_t cluster);
+void fat_cache_set(fat_cache_t* cache, uint32_t cluster, uint32_t value);
+void fat_cache_flush(fat_cache_t* cache);
+
+#endif
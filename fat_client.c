@@ -0,0 +1,383 @@
+/**
+ *    Descrição: Cliente do modo servidor (./main -S) e gerador de carga que mede requisições por segundo e latências
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+
+// Atributos de diretório e de volume (iguais aos de fat32.h, que não é incluído aqui)
+#define CLIENT_ATTR_DIRECTORY 0x10
+#define CLIENT_ATTR_VOLUME_ID 0x08
+
+// Código de "arquivo já existe" (FAT32_EEXIST)
+#define CLIENT_EEXIST -3
+// Retorno de call quando a conexão caiu (diferente de todos os status do servidor)
+#define CLIENT_CLOSED INT32_MIN
+
+// Bytes por requisição do cat e do put
+#define CLIENT_CHUNK (1024 * 1024)
+
+static void usage(char* program) {
+	printf("Usage: %s -S socket ls|stat|cat|rm|touch|mkdir PATH\n", program);
+	printf("       %s -S socket read PATH OFFSET SIZE\n", program);
+	printf("       %s -S socket put HOST_FILE PATH\n", program);
+	printf("       %s -S socket load [-c connections] [-n requests] [-s read_size] [-w stat_percent] PATH...\n", program);
+}
+
+static int connect_server(const char* socket_path) {
+	struct sockaddr_un address = { 0 };
+	address.sun_family = AF_UNIX;
+	if(strlen(socket_path) >= sizeof(address.sun_path)) {
+		printf("%s: Socket path too long\n", socket_path);
+		return -1;
+	}
+	strcpy(address.sun_path, socket_path);
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(fd < 0 || connect(fd, (struct sockaddr*) &address, sizeof(address)) < 0) {
+		printf("%s: %s\n", socket_path, strerror(errno));
+		if(fd >= 0) close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int send_all(int fd, const void* data, size_t size) {
+	const uint8_t* bytes = (const uint8_t*) data;
+	while(size > 0) {
+		ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+		if(sent < 0 && errno == EINTR) continue;
+		if(sent <= 0) return -1;
+		bytes += sent;
+		size -= sent;
+	}
+	return 0;
+}
+
+static int recv_all(int fd, void* data, size_t size) {
+	uint8_t* bytes = (uint8_t*) data;
+	while(size > 0) {
+		ssize_t received = recv(fd, bytes, size, 0);
+		if(received < 0 && errno == EINTR) continue;
+		if(received <= 0) return -1;
+		bytes += received;
+		size -= received;
+	}
+	return 0;
+}
+
+// Faz uma requisição e espera a resposta; os dados dela ficam em payload (reaproveitado entre as chamadas)
+// Retorna o status da resposta, ou CLIENT_CLOSED se a conexão falhou
+static int32_t call(int fd, uint8_t opcode, uint8_t flags, const char* path, uint64_t offset, uint32_t size, const void* data, server_buffer_t* payload) {
+	size_t path_length = strlen(path);
+	uint32_t data_size = opcode == SERVER_WRITE ? size : 0;
+	payload->size = 0;
+	server_request_t header;
+	header.length = sizeof(header) - sizeof(header.length) + path_length + data_size;
+	header.opcode = opcode;
+	header.flags = flags;
+	header.path_length = path_length;
+	header.offset = offset;
+	header.size = size;
+	if(send_all(fd, &header, sizeof(header)) < 0 || send_all(fd, path, path_length) < 0 || send_all(fd, data, data_size) < 0) {
+		printf("Connection closed by server\n");
+		return CLIENT_CLOSED;
+	}
+
+	server_response_t response;
+	if(recv_all(fd, &response, sizeof(response)) < 0 || response.length < sizeof(response.status) || response.length > SERVER_MAX_FRAME) {
+		printf("Connection closed by server\n");
+		return CLIENT_CLOSED;
+	}
+	size_t payload_size = response.length - sizeof(response.status);
+	if(recv_all(fd, server_buffer_reserve(payload, payload_size), payload_size) < 0) {
+		printf("Connection closed by server\n");
+		return CLIENT_CLOSED;
+	}
+	return response.status;
+}
+
+// Imprime "cmd: path: mensagem" com a mensagem de erro que veio nos dados da resposta
+static void print_error(const char* cmd, const char* path, server_buffer_t* payload) {
+	if(payload->size == 0) return;
+	printf("%s: %s: %.*s\n", cmd, path, (int) payload->size, (char*) payload->data);
+}
+
+// Imprime as entradas de uma resposta do SERVER_LIST ou SERVER_STAT no formato do ls da shell
+static void print_entries(server_buffer_t* payload, int32_t count) {
+	size_t position = 0;
+	for(int32_t i = 0; i < count && position + sizeof(server_entry_t) <= payload->size; i++) {
+		server_entry_t entry;
+		memcpy(&entry, payload->data + position, sizeof(entry));
+		position += sizeof(entry);
+		const char* name = (const char*) payload->data + position;
+		position += entry.name_length;
+		if(entry.attributes & CLIENT_ATTR_VOLUME_ID) continue;
+
+		printf("%02u/%02u/%04u %02u:%02u  ", entry.write_date & 0x1F, (entry.write_date >> 5) & 0x0F,
+			1980 + (entry.write_date >> 9), entry.write_time >> 11, (entry.write_time >> 5) & 0x3F);
+		if(entry.attributes & CLIENT_ATTR_DIRECTORY) printf("%-10s ", "<DIR>");
+		else printf("%10u ", entry.size);
+		printf("%.*s\n", (int) entry.name_length, name);
+	}
+}
+
+// Copia o arquivo da imagem para a saída padrão em pedaços de CLIENT_CHUNK
+static int cat_file(int fd, const char* path, server_buffer_t* payload) {
+	for(uint64_t offset = 0;; ) {
+		int32_t status = call(fd, SERVER_READ, 0, path, offset, CLIENT_CHUNK, NULL, payload);
+		if(status < 0) {
+			print_error("cat", path, payload);
+			return 1;
+		}
+		fwrite(payload->data, 1, status, stdout);
+		offset += status;
+		if(status < CLIENT_CHUNK) return 0;
+	}
+}
+
+// Cria o arquivo na imagem (se ainda não existir) e escreve nele o arquivo do computador
+static int put_file(int fd, const char* host_path, const char* path, server_buffer_t* payload) {
+	FILE* file = fopen(host_path, "rb");
+	if(file == NULL) {
+		printf("put: %s: %s\n", host_path, strerror(errno));
+		return 1;
+	}
+	int32_t status = call(fd, SERVER_CREATE, 0, path, 0, 0, NULL, payload);
+	if(status < 0 && status != CLIENT_EEXIST) {
+		print_error("put", path, payload);
+		fclose(file);
+		return 1;
+	}
+	uint8_t* chunk = (uint8_t*) malloc(CLIENT_CHUNK);
+	uint64_t offset = 0;
+	int failed = 0;
+	size_t read_size;
+	while(!failed && (read_size = fread(chunk, 1, CLIENT_CHUNK, file)) > 0) {
+		status = call(fd, SERVER_WRITE, 0, path, offset, read_size, chunk, payload);
+		if(status < 0) {
+			print_error("put", path, payload);
+			failed = 1;
+		}
+		offset += read_size;
+	}
+	free(chunk);
+	fclose(file);
+	return failed;
+}
+
+// Parâmetros e resultados de uma conexão do gerador de carga
+typedef struct load_worker {
+	const char* socket_path;
+	char** paths;
+	uint32_t* sizes;
+	uint32_t path_count;
+	uint32_t requests;
+	uint32_t read_size;
+	uint32_t stat_percent;
+	uint32_t seed;
+	// Latência de cada requisição em microssegundos
+	double* latencies;
+	uint32_t completed;
+	uint32_t errors;
+} load_worker_t;
+
+static double elapsed_us(struct timespec* start, struct timespec* end) {
+	return (end->tv_sec - start->tv_sec) * 1e6 + (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+// Uma conexão fazendo uma requisição por vez: stat_percent% de stat e o resto leituras em posições aleatórias
+static void* load_worker(void* argument) {
+	load_worker_t* worker = (load_worker_t*) argument;
+	int fd = connect_server(worker->socket_path);
+	if(fd < 0) return NULL;
+	server_buffer_t payload = { 0 };
+	for(uint32_t i = 0; i < worker->requests; i++) {
+		uint32_t index = rand_r(&worker->seed) % worker->path_count;
+		int is_stat = (uint32_t) (rand_r(&worker->seed) % 100) < worker->stat_percent;
+		uint64_t offset = 0;
+		if(worker->sizes[index] > worker->read_size) offset = rand_r(&worker->seed) % (worker->sizes[index] - worker->read_size + 1);
+
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		int32_t status = is_stat ? call(fd, SERVER_STAT, 0, worker->paths[index], 0, 0, NULL, &payload)
+			: call(fd, SERVER_READ, 0, worker->paths[index], offset, worker->read_size, NULL, &payload);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if(status == CLIENT_CLOSED) break;
+		if(status < 0) worker->errors++;
+		worker->latencies[worker->completed++] = elapsed_us(&start, &end);
+	}
+	free(payload.data);
+	close(fd);
+	return NULL;
+}
+
+static int compare_double(const void* a, const void* b) {
+	double x = *(const double*) a, y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+// Gerador de carga: várias conexões ao mesmo tempo, cada uma em uma thread, e o resumo das latências no fim
+static int run_load(const char* socket_path, int argc, char** argv) {
+	uint32_t connections = 8, requests = 10000, read_size = 4096, stat_percent = 20;
+	int opt;
+	optind = 1;
+	while((opt = getopt(argc, argv, "c:n:s:w:")) != -1) {
+		switch(opt) {
+			case 'c': connections = strtoul(optarg, NULL, 10); break;
+			case 'n': requests = strtoul(optarg, NULL, 10); break;
+			case 's': read_size = strtoul(optarg, NULL, 10); break;
+			case 'w': stat_percent = strtoul(optarg, NULL, 10); break;
+			default: return 2;
+		}
+	}
+	uint32_t path_count = argc - optind;
+	if(path_count == 0 || connections == 0 || read_size == 0 || read_size > SERVER_MAX_DATA) return 2;
+	char** paths = argv + optind;
+
+	// O tamanho de cada arquivo decide as posições das leituras
+	int fd = connect_server(socket_path);
+	if(fd < 0) return 1;
+	server_buffer_t payload = { 0 };
+	uint32_t* sizes = (uint32_t*) malloc(path_count * sizeof(uint32_t));
+	for(uint32_t i = 0; i < path_count; i++) {
+		if(call(fd, SERVER_STAT, 0, paths[i], 0, 0, NULL, &payload) < 0) {
+			print_error("load", paths[i], &payload);
+			free(payload.data);
+			free(sizes);
+			close(fd);
+			return 1;
+		}
+		server_entry_t entry;
+		memcpy(&entry, payload.data, sizeof(entry));
+		sizes[i] = entry.size;
+	}
+	free(payload.data);
+	close(fd);
+
+	load_worker_t* workers = (load_worker_t*) calloc(connections, sizeof(load_worker_t));
+	pthread_t* threads = (pthread_t*) malloc(connections * sizeof(pthread_t));
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(uint32_t i = 0; i < connections; i++) {
+		workers[i].socket_path = socket_path;
+		workers[i].paths = paths;
+		workers[i].sizes = sizes;
+		workers[i].path_count = path_count;
+		workers[i].requests = requests;
+		workers[i].read_size = read_size;
+		workers[i].stat_percent = stat_percent;
+		workers[i].seed = 0x9E3779B9u * (i + 1);
+		workers[i].latencies = (double*) malloc(requests * sizeof(double));
+		pthread_create(&threads[i], NULL, load_worker, &workers[i]);
+	}
+	for(uint32_t i = 0; i < connections; i++) pthread_join(threads[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	// Junta as latências de todas as conexões para os percentis
+	uint64_t total = 0, errors = 0;
+	for(uint32_t i = 0; i < connections; i++) total += workers[i].completed;
+	double* latencies = (double*) malloc((total ? total : 1) * sizeof(double));
+	double sum = 0;
+	uint64_t position = 0;
+	for(uint32_t i = 0; i < connections; i++) {
+		memcpy(latencies + position, workers[i].latencies, workers[i].completed * sizeof(double));
+		position += workers[i].completed;
+		errors += workers[i].errors;
+		free(workers[i].latencies);
+	}
+	for(uint64_t i = 0; i < total; i++) sum += latencies[i];
+	qsort(latencies, total, sizeof(double), compare_double);
+
+	double seconds = elapsed_us(&start, &end) / 1e6;
+	printf("Connections: %u, requests: %lu (%lu failed), stat: %u%%, read size: %u B\n", connections, total, errors, stat_percent, read_size);
+	if(total > 0) {
+		printf("Elapsed: %.3f s, %.0f requests/s\n", seconds, total / seconds);
+		printf("Latency (us): avg %.1f, p50 %.1f, p99 %.1f, max %.1f\n", sum / total,
+			latencies[(total - 1) / 2], latencies[(uint64_t) ((total - 1) * 0.99)], latencies[total - 1]);
+	}
+
+	free(latencies);
+	free(threads);
+	free(workers);
+	free(sizes);
+	return total == (uint64_t) connections * requests && errors == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+	const char* socket_path = NULL;
+	int opt;
+	// O + para no primeiro parâmetro que não é opção, para o load ler as próprias opções
+	while((opt = getopt(argc, argv, "+S:")) != -1) {
+		if(opt == 'S') socket_path = optarg;
+		else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if(socket_path == NULL || optind >= argc) {
+		usage(argv[0]);
+		return 2;
+	}
+	char* cmd = argv[optind];
+	char** args = argv + optind + 1;
+	int args_count = argc - optind - 1;
+
+	if(!strcmp(cmd, "load")) {
+		int result = run_load(socket_path, args_count + 1, argv + optind);
+		if(result == 2) usage(argv[0]);
+		return result;
+	}
+
+	int valid = (!strcmp(cmd, "read") && args_count == 3) || (!strcmp(cmd, "put") && args_count == 2)
+		|| ((!strcmp(cmd, "ls") || !strcmp(cmd, "stat") || !strcmp(cmd, "cat") || !strcmp(cmd, "rm")
+			|| !strcmp(cmd, "touch") || !strcmp(cmd, "mkdir")) && args_count == 1);
+	if(!valid) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	int fd = connect_server(socket_path);
+	if(fd < 0) return 1;
+	server_buffer_t payload = { 0 };
+	int failed = 0;
+	int32_t status = 0;
+
+	if(!strcmp(cmd, "cat")) failed = cat_file(fd, args[0], &payload);
+	else if(!strcmp(cmd, "put")) failed = put_file(fd, args[0], args[1], &payload);
+	else if(!strcmp(cmd, "read")) {
+		uint64_t size = strtoull(args[2], NULL, 10);
+		if(size > SERVER_MAX_DATA) size = SERVER_MAX_DATA;
+		status = call(fd, SERVER_READ, 0, args[0], strtoull(args[1], NULL, 10), size, NULL, &payload);
+		if(status >= 0) fwrite(payload.data, 1, status, stdout);
+	}
+	else if(!strcmp(cmd, "ls")) {
+		status = call(fd, SERVER_LIST, 0, args[0], 0, 0, NULL, &payload);
+		if(status >= 0) print_entries(&payload, status);
+	}
+	else if(!strcmp(cmd, "stat")) {
+		status = call(fd, SERVER_STAT, 0, args[0], 0, 0, NULL, &payload);
+		if(status >= 0) print_entries(&payload, 1);
+	}
+	else if(!strcmp(cmd, "rm")) status = call(fd, SERVER_DELETE, 0, args[0], 0, 0, NULL, &payload);
+	else status = call(fd, SERVER_CREATE, !strcmp(cmd, "mkdir") ? SERVER_CREATE_DIRECTORY : 0, args[0], 0, 0, NULL, &payload);
+
+	if(status < 0) {
+		print_error(cmd, args[0], &payload);
+		failed = 1;
+	}
+
+	free(payload.data);
+	close(fd);
+	return failed;
+}
@@ -0,0 +1,286 @@
+/**
+ *    Descrição: Kernels vetorizados (AVX2, SSE2 ou escalar, escolhidos em tempo de execução) para percorrer a FAT
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <string.h>
+#include "fat_simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FAT_SIMD_X86 1
+#endif
+
+// Continua a sequência livre atual com um bloco de bits (bit i ligado quando a entrada index + i está livre)
+// Retorna 1 quando a sequência chega a length, com o começo dela em start
+static inline int scan_run_block(uint32_t mask, uint32_t bits, size_t index, uint32_t length, uint32_t* run, size_t* start) {
+	uint32_t full = bits == 32 ? 0xFFFFFFFF : (1U << bits) - 1;
+	// Blocos todos livres ou todos usados não precisam olhar as sequências
+	if(mask == full) {
+		if(*run == 0) *start = index;
+		*run += bits;
+		return *run >= length;
+	}
+	if(mask == 0) {
+		*run = 0;
+		return 0;
+	}
+
+	// Os bits livres do começo continuam a sequência do bloco anterior
+	uint64_t free_bits = mask;
+	uint32_t position = __builtin_ctzll(~free_bits);
+	if(position) {
+		if(*run == 0) *start = index;
+		*run += position;
+		if(*run >= length) return 1;
+	}
+	*run = 0;
+	free_bits >>= position;
+
+	// Depois, uma volta por sequência de bits livres (os bits acima de bits são zero, então ~free_bits sempre tem um bit ligado)
+	while(free_bits) {
+		uint32_t skip = __builtin_ctzll(free_bits);
+		free_bits >>= skip;
+		position += skip;
+		uint32_t run_length = __builtin_ctzll(~free_bits);
+		*start = index + position;
+		*run = run_length;
+		if(run_length >= length) return 1;
+		free_bits >>= run_length;
+		position += run_length;
+	}
+	// Só a sequência que chega ao fim do bloco continua no próximo
+	if(position < bits) *run = 0;
+	return 0;
+}
+
+// -------------------------------- Escalar --------------------------------- //
+
+static uint32_t scalar_count_free(const uint32_t* entries, size_t count) {
+	uint32_t free_count = 0;
+	for(size_t i = 0; i < count; i++) free_count += (entries[i] & FAT_ENTRY_MASK) == 0;
+	return free_count;
+}
+
+static void scalar_mark_used(const uint32_t* entries, size_t count, uint64_t* bitmap) {
+	for(size_t i = 0; i < count; i++)
+		if(entries[i] & FAT_ENTRY_MASK) bitmap[i / 64] |= 1ULL << (i % 64);
+}
+
+static size_t scalar_find_free_run(const uint32_t* entries, size_t count, uint32_t length) {
+	uint32_t run = 0;
+	size_t start = 0;
+	if(length == 0) return 0;
+	for(size_t i = 0; i < count; i++) {
+		if(entries[i] & FAT_ENTRY_MASK) {
+			run = 0;
+			continue;
+		}
+		if(run == 0) start = i;
+		if(++run >= length) return start;
+	}
+	return count;
+}
+
+static size_t scalar_compare(const uint32_t* first, const uint32_t* second, size_t count, size_t* first_mismatch) {
+	size_t mismatches = 0;
+	for(size_t i = 0; i < count; i++) {
+		if(first[i] == second[i]) continue;
+		if(mismatches++ == 0) *first_mismatch = i;
+	}
+	return mismatches;
+}
+
+static const fat_kernels_t scalar_kernels = {
+	"scalar", scalar_count_free, scalar_mark_used, scalar_find_free_run, scalar_compare
+};
+
+#ifdef FAT_SIMD_X86
+
+// --------------------------------- SSE2 ----------------------------------- //
+
+// Bit i ligado se a entrada i das 4 estiver livre
+__attribute__((target("sse2")))
+static inline uint32_t sse2_free_mask(const uint32_t* entries) {
+	__m128i values = _mm_and_si128(_mm_loadu_si128((const __m128i*) entries), _mm_set1_epi32(FAT_ENTRY_MASK));
+	return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(values, _mm_setzero_si128())));
+}
+
+__attribute__((target("sse2")))
+static uint32_t sse2_count_free(const uint32_t* entries, size_t count) {
+	__m128i mask = _mm_set1_epi32(FAT_ENTRY_MASK);
+	__m128i total = _mm_setzero_si128();
+	size_t i = 0;
+	// A comparação dá -1 nas entradas livres, então subtrair soma 1 por entrada livre em cada coluna
+	for(; i + 4 <= count; i += 4) {
+		__m128i values = _mm_and_si128(_mm_loadu_si128((const __m128i*)(entries + i)), mask);
+		total = _mm_sub_epi32(total, _mm_cmpeq_epi32(values, _mm_setzero_si128()));
+	}
+	uint32_t columns[4];
+	_mm_storeu_si128((__m128i*) columns, total);
+	return columns[0] + columns[1] + columns[2] + columns[3] + scalar_count_free(entries + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void sse2_mark_used(const uint32_t* entries, size_t count, uint64_t* bitmap) {
+	size_t i = 0;
+	for(; i + 64 <= count; i += 64) {
+		uint64_t free_bits = 0;
+		for(int j = 0; j < 16; j++) free_bits |= (uint64_t) sse2_free_mask(entries + i + j * 4) << (j * 4);
+		bitmap[i / 64] |= ~free_bits;
+	}
+	scalar_mark_used(entries + i, count - i, bitmap + i / 64);
+}
+
+__attribute__((target("sse2")))
+static size_t sse2_find_free_run(const uint32_t* entries, size_t count, uint32_t length) {
+	uint32_t run = 0;
+	size_t start = 0, i = 0;
+	if(length == 0) return 0;
+	for(; i + 16 <= count; i += 16) {
+		uint32_t mask = sse2_free_mask(entries + i) | sse2_free_mask(entries + i + 4) << 4
+			| sse2_free_mask(entries + i + 8) << 8 | sse2_free_mask(entries + i + 12) << 12;
+		if(scan_run_block(mask, 16, i, length, &run, &start)) return start;
+	}
+	for(; i < count; i++)
+		if(scan_run_block((entries[i] & FAT_ENTRY_MASK) == 0, 1, i, length, &run, &start)) return start;
+	return count;
+}
+
+__attribute__((target("sse2")))
+static size_t sse2_compare(const uint32_t* first, const uint32_t* second, size_t count, size_t* first_mismatch) {
+	size_t mismatches = 0, i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(first + i)), _mm_loadu_si128((const __m128i*)(second + i)));
+		uint32_t different = ~_mm_movemask_ps(_mm_castsi128_ps(equal)) & 0xF;
+		if(!different) continue;
+		if(mismatches == 0) *first_mismatch = i + __builtin_ctz(different);
+		mismatches += __builtin_popcount(different);
+	}
+	size_t tail_mismatch = 0;
+	size_t tail = scalar_compare(first + i, second + i, count - i, &tail_mismatch);
+	if(tail && mismatches == 0) *first_mismatch = i + tail_mismatch;
+	return mismatches + tail;
+}
+
+static const fat_kernels_t sse2_kernels = {
+	"sse2", sse2_count_free, sse2_mark_used, sse2_find_free_run, sse2_compare
+};
+
+// --------------------------------- AVX2 ----------------------------------- //
+
+// Bit i ligado se a entrada i das 8 estiver livre
+__attribute__((target("avx2")))
+static inline uint32_t avx2_free_mask(const uint32_t* entries) {
+	__m256i values = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) entries), _mm256_set1_epi32(FAT_ENTRY_MASK));
+	return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(values, _mm256_setzero_si256())));
+}
+
+__attribute__((target("avx2")))
+static uint32_t avx2_count_free(const uint32_t* entries, size_t count) {
+	__m256i mask = _mm256_set1_epi32(FAT_ENTRY_MASK);
+	__m256i total = _mm256_setzero_si256();
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256i values = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(entries + i)), mask);
+		total = _mm256_sub_epi32(total, _mm256_cmpeq_epi32(values, _mm256_setzero_si256()));
+	}
+	uint32_t columns[8];
+	_mm256_storeu_si256((__m256i*) columns, total);
+	uint32_t free_count = 0;
+	for(int j = 0; j < 8; j++) free_count += columns[j];
+	return free_count + scalar_count_free(entries + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void avx2_mark_used(const uint32_t* entries, size_t count, uint64_t* bitmap) {
+	size_t i = 0;
+	for(; i + 64 <= count; i += 64) {
+		uint64_t free_bits = 0;
+		for(int j = 0; j < 8; j++) free_bits |= (uint64_t) avx2_free_mask(entries + i + j * 8) << (j * 8);
+		bitmap[i / 64] |= ~free_bits;
+	}
+	scalar_mark_used(entries + i, count - i, bitmap + i / 64);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_find_free_run(const uint32_t* entries, size_t count, uint32_t length) {
+	uint32_t run = 0;
+	size_t start = 0, i = 0;
+	if(length == 0) return 0;
+	for(; i + 32 <= count; i += 32) {
+		uint32_t mask = avx2_free_mask(entries + i) | avx2_free_mask(entries + i + 8) << 8
+			| avx2_free_mask(entries + i + 16) << 16 | avx2_free_mask(entries + i + 24) << 24;
+		if(scan_run_block(mask, 32, i, length, &run, &start)) return start;
+	}
+	for(; i < count; i++)
+		if(scan_run_block((entries[i] & FAT_ENTRY_MASK) == 0, 1, i, length, &run, &start)) return start;
+	return count;
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_compare(const uint32_t* first, const uint32_t* second, size_t count, size_t* first_mismatch) {
+	size_t mismatches = 0, i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256i equal = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(first + i)), _mm256_loadu_si256((const __m256i*)(second + i)));
+		uint32_t different = ~_mm256_movemask_ps(_mm256_castsi256_ps(equal)) & 0xFF;
+		if(!different) continue;
+		if(mismatches == 0) *first_mismatch = i + __builtin_ctz(different);
+		mismatches += __builtin_popcount(different);
+	}
+	size_t tail_mismatch = 0;
+	size_t tail = scalar_compare(first + i, second + i, count - i, &tail_mismatch);
+	if(tail && mismatches == 0) *first_mismatch = i + tail_mismatch;
+	return mismatches + tail;
+}
+
+static const fat_kernels_t avx2_kernels = {
+	"avx2", avx2_count_free, avx2_mark_used, avx2_find_free_run, avx2_compare
+};
+
+#endif
+
+// ------------------------------------------------------------------------ //
+
+// Conjuntos de kernels do melhor para o pior
+static const fat_kernels_t* all_kernels[] = {
+#ifdef FAT_SIMD_X86
+	&avx2_kernels, &sse2_kernels,
+#endif
+	&scalar_kernels
+};
+
+#define KERNEL_COUNT (int)(sizeof(all_kernels) / sizeof(all_kernels[0]))
+
+// Retorna 1 se o processador tem as instruções usadas pelo conjunto
+static int kernels_supported(const fat_kernels_t* kernels) {
+#ifdef FAT_SIMD_X86
+	__builtin_cpu_init();
+	if(kernels == &avx2_kernels) return __builtin_cpu_supports("avx2");
+	if(kernels == &sse2_kernels) return __builtin_cpu_supports("sse2");
+#endif
+	return 1;
+}
+
+// Melhor conjunto de kernels que o processador suporta, escolhido na primeira chamada
+const fat_kernels_t* fat_kernels() {
+	static const fat_kernels_t* selected = NULL;
+	if(selected == NULL) {
+		int i = 0;
+		while(!kernels_supported(all_kernels[i])) i++;
+		selected = all_kernels[i];
+	}
+	return selected;
+}
+
+// Conjunto pelo nome, NULL se não existir ou o processador não suportar
+const fat_kernels_t* fat_kernels_by_name(const char* name) {
+	for(int i = 0; i < KERNEL_COUNT; i++)
+		if(!strcmp(all_kernels[i]->name, name)) return kernels_supported(all_kernels[i]) ? all_kernels[i] : NULL;
+	return NULL;
+}
+
+// Nome do conjunto na posição index (do melhor para o pior), NULL depois do último
+const char* fat_kernels_name(int index) {
+	return index >= 0 && index < KERNEL_COUNT ? all_kernels[index]->name : NULL;
+}
@@ -0,0 +1,32 @@
+/**
+ *    Descrição: Kernels vetorizados (AVX2, SSE2 ou escalar, escolhidos em tempo de execução) para percorrer a FAT
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#ifndef FAT_SIMD_H
+#define FAT_SIMD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Só os 28 bits de baixo de uma entrada da FAT são o valor, uma entrada é livre quando eles são zero
+#define FAT_ENTRY_MASK 0x0FFFFFFF
+
+// Kernels de um conjunto de instruções
+typedef struct fat_kernels {
+	const char* name;
+	// Quantidade de entradas livres
+	uint32_t (*count_free)(const uint32_t* entries, size_t count);
+	// Liga no bitmap o bit de cada entrada usada (bitmap[0] bit 0 é a entries[0])
+	void (*mark_used)(const uint32_t* entries, size_t count, uint64_t* bitmap);
+	// Posição da primeira sequência de length entradas livres, ou count se não existir
+	size_t (*find_free_run)(const uint32_t* entries, size_t count, uint32_t length);
+	// Quantidade de entradas diferentes entre as duas cópias e a posição da primeira em first_mismatch
+	size_t (*compare)(const uint32_t* first, const uint32_t* second, size_t count, size_t* first_mismatch);
+} fat_kernels_t;
+
+const fat_kernels_t* fat_kernels();
+const fat_kernels_t* fat_kernels_by_name(const char* name);
+const char* fat_kernels_name(int index);
+
+#endif
@@ -0,0 +1,342 @@
+/**
+ *    Descrição: Teste de carga da API com várias threads (make stress): leitores conferindo o conteúdo dos arquivos
+ *               enquanto uma thread cria, escreve e remove arquivos na mesma imagem, gerada pelo próprio teste
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include "fat32.h"
+#include "block_device.h"
+#include "fat_cache.h"
+#include "dir_cache.h"
+
+// Imagem gerada: 64 MiB com clusters de 512 bytes (131 mil clusters, FAT32 de verdade)
+#define STRESS_IMAGE_SIZE (64 * 1024 * 1024)
+#define STRESS_SECTOR_SIZE 512
+#define STRESS_RESERVED_SECTORS 32
+// Arquivos fixos em /DATA, escritos em pedaços alternados para as cadeias ficarem fragmentadas
+#define STRESS_FILES 48
+#define STRESS_MAX_FILE (96 * 1024)
+#define STRESS_WRITE_CHUNK 1536
+// Arquivos que a thread de escrita mantém vivos em /CHURN
+#define STRESS_CHURN_LIVE 16
+#define STRESS_MAX_CHURN_FILE (48 * 1024)
+
+// Byte esperado no offset do arquivo com a semente seed, sem período que coincida com o tamanho do cluster
+static uint8_t pattern_byte(uint32_t seed, uint64_t offset) {
+	uint32_t x = (uint32_t) offset * 0x9E3779B1u ^ seed * 0x85EBCA6Bu;
+	x ^= x >> 15;
+	x *= 0x2C1B3C6Du;
+	return x >> 24;
+}
+
+static void fill_pattern(uint8_t* buffer, uint32_t seed, uint64_t offset, size_t size) {
+	for(size_t i = 0; i < size; i++) buffer[i] = pattern_byte(seed, offset + i);
+}
+
+// Tamanho do arquivo fixo i e do arquivo i de /CHURN
+static uint32_t data_file_size(uint32_t i) {
+	return i % 7 == 0 ? 0 : (i * 7919u) % STRESS_MAX_FILE;
+}
+
+static uint32_t churn_file_size(uint32_t i) {
+	return 1 + (i * 104729u) % STRESS_MAX_CHURN_FILE;
+}
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Gera uma imagem FAT32 vazia (boot sector, FSINFO, duas FATs e a raiz no cluster 2)
+static int format_image(const char* path) {
+	FILE* image = fopen(path, "wb");
+	if(image == NULL) return 0;
+
+	uint32_t total_sectors = STRESS_IMAGE_SIZE / STRESS_SECTOR_SIZE;
+	// Cada setor da FAT cobre 128 clusters; a conta usa o total como limite de cima
+	uint32_t fat_sectors = (total_sectors / 128) + 1;
+	uint32_t data_sectors = total_sectors - STRESS_RESERVED_SECTORS - 2 * fat_sectors;
+
+	struct boot_sector bs;
+	memset(&bs, 0, sizeof(bs));
+	memcpy(bs.BS_jmpBoot, "\xEB\x58\x90", 3);
+	memcpy(bs.BS_OEMName, "FATSTRES", 8);
+	bs.BPB_BytsPerSec = STRESS_SECTOR_SIZE;
+	bs.BPB_SecPerClus = 1;
+	bs.BPB_RsvdSecCnt = STRESS_RESERVED_SECTORS;
+	bs.BPB_NumFATs = 2;
+	bs.BPB_Media = 0xF8;
+	bs.BPB_TotSec32 = total_sectors;
+	bs.BPB_FATSz32 = fat_sectors;
+	bs.BPB_RootClus = 2;
+	bs.BPB_FSInfo = 1;
+	bs.BPB_BkBootSec = 6;
+	bs.BS_DrvNum = 0x80;
+	bs.BS_BootSig = 0x29;
+	bs.BS_VolID = 0x57E55000;
+	memcpy(bs.BS_VolLab, "STRESS     ", 11);
+	memcpy(bs.BS_FilSysType, "FAT32   ", 8);
+	bs.BS_Signature = 0xAA55;
+
+	struct FSInfo fs;
+	memset(&fs, 0, sizeof(fs));
+	fs.FSI_LeadSig = 0x41615252;
+	fs.FSI_StrucSig = 0x61417272;
+	// A raiz usa o cluster 2
+	fs.FSI_Free_Count = data_sectors - 1;
+	fs.FSI_Nxt_Free = 3;
+	fs.FSI_TrailSig = 0xAA550000;
+
+	uint32_t fat_start[3] = { 0x0FFFFFF8, 0x0FFFFFFF, END_OF_CHAIN };
+	int ok = fseek(image, STRESS_IMAGE_SIZE - 1, SEEK_SET) == 0 && fputc(0, image) != EOF;
+	ok = ok && fseek(image, 0, SEEK_SET) == 0 && fwrite(&bs, sizeof(bs), 1, image) == 1;
+	ok = ok && fseek(image, STRESS_SECTOR_SIZE, SEEK_SET) == 0 && fwrite(&fs, sizeof(fs), 1, image) == 1;
+	ok = ok && fseek(image, 6 * STRESS_SECTOR_SIZE, SEEK_SET) == 0 && fwrite(&bs, sizeof(bs), 1, image) == 1;
+	for(int i = 0; i < 2; i++) {
+		long fat_offset = (long) (STRESS_RESERVED_SECTORS + i * fat_sectors) * STRESS_SECTOR_SIZE;
+		ok = ok && fseek(image, fat_offset, SEEK_SET) == 0 && fwrite(fat_start, sizeof(fat_start), 1, image) == 1;
+	}
+	return fclose(image) == 0 && ok;
+}
+
+// Estado compartilhado entre as threads
+typedef struct stress {
+	fat32_t* volume;
+	double deadline;
+	// Próximo arquivo que a thread de escrita vai criar em /CHURN (os anteriores a ele podem existir)
+	uint32_t churn_next;
+	// Contadores, somados com operações atômicas
+	uint64_t reads;
+	uint64_t bytes;
+	uint64_t lists;
+	uint64_t churn_reads;
+	uint64_t writes;
+	uint64_t removes;
+	uint64_t failures;
+} stress_t;
+
+static void report_failure(stress_t* stress, const char* format, const char* path, int64_t value) {
+	// Só as primeiras falhas são impressas
+	if(__atomic_fetch_add(&stress->failures, 1, __ATOMIC_RELAXED) < 10) {
+		printf(format, path, (long long) value);
+		printf("\n");
+	}
+}
+
+// Lê um trecho do arquivo e confere com o padrão; expected_size é o tamanho que o arquivo precisa ter
+// Retorna os bytes lidos ou o código do erro de fat32_read
+static int64_t read_and_check(stress_t* stress, const char* path, uint32_t seed, uint32_t expected_size, uint64_t offset, uint64_t length, uint8_t* buffer) {
+	int64_t done = fat32_read(stress->volume, path, offset, buffer, length);
+	if(done < 0) return done;
+	uint64_t expected = offset >= expected_size ? 0 : (expected_size - offset < length ? expected_size - offset : length);
+	if((uint64_t) done != expected) {
+		report_failure(stress, "%s: short read (%lld bytes)", path, done);
+		return done;
+	}
+	for(int64_t i = 0; i < done; i++) {
+		if(buffer[i] != pattern_byte(seed, offset + i)) {
+			report_failure(stress, "%s: wrong data at offset %lld", path, offset + i);
+			break;
+		}
+	}
+	return done;
+}
+
+// Conta as entradas de uma listagem
+static int count_entry(void* context, const fat32_stat_t* status) {
+	(*(uint32_t*) context)++;
+	return 0;
+}
+
+static void* reader_thread(void* argument) {
+	stress_t* stress = (stress_t*) argument;
+	uint8_t* buffer = (uint8_t*) malloc(STRESS_MAX_FILE);
+	unsigned int seed = (unsigned int) (size_t) pthread_self();
+	char path[64];
+	uint64_t reads = 0, bytes = 0, lists = 0, churn_reads = 0;
+
+	while(now() < stress->deadline) {
+		int operation = rand_r(&seed) % 16;
+		if(operation == 0) {
+			// A listagem dos arquivos fixos nunca muda: '.', '..' e os arquivos
+			uint32_t count = 0;
+			int listed = fat32_list(stress->volume, "/DATA", count_entry, &count);
+			if(listed != STRESS_FILES + 2) report_failure(stress, "%s: listed %lld entries", "/DATA", listed);
+			lists++;
+		}
+		else if(operation < 4) {
+			// Arquivo de /CHURN: pode já ter sido removido, mas se existir tem que estar inteiro
+			uint32_t newest = __atomic_load_n(&stress->churn_next, __ATOMIC_ACQUIRE);
+			if(newest == 0) continue;
+			uint32_t file = newest - 1 - rand_r(&seed) % (2 * STRESS_CHURN_LIVE < newest ? 2 * STRESS_CHURN_LIVE : newest);
+			sprintf(path, "/CHURN/C%u.BIN", file);
+			// Um arquivo recém-criado pode estar vazio; depois da escrita, só o conteúdo inteiro é válido
+			int64_t done = fat32_read(stress->volume, path, 0, buffer, STRESS_MAX_CHURN_FILE);
+			if(done == FAT32_ENOENT) continue;
+			if(done < 0) report_failure(stress, "%s: read failed (%lld)", path, done);
+			else if(done != 0 && done != churn_file_size(file)) report_failure(stress, "%s: partial file (%lld bytes)", path, done);
+			else {
+				for(int64_t i = 0; i < done; i++) {
+					if(buffer[i] != pattern_byte(100000 + file, i)) {
+						report_failure(stress, "%s: wrong data at offset %lld", path, i);
+						break;
+					}
+				}
+			}
+			churn_reads++;
+		}
+		else {
+			uint32_t file = rand_r(&seed) % STRESS_FILES;
+			uint32_t size = data_file_size(file);
+			uint64_t offset = size ? rand_r(&seed) % size : 0;
+			uint64_t length = 1 + rand_r(&seed) % (16 * 1024);
+			sprintf(path, "/DATA/F%u.BIN", file);
+			int64_t done = read_and_check(stress, path, file, size, offset, length, buffer);
+			if(done < 0) report_failure(stress, "%s: read failed (%lld)", path, done);
+			else bytes += done;
+			reads++;
+		}
+	}
+
+	__atomic_add_fetch(&stress->reads, reads, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&stress->bytes, bytes, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&stress->lists, lists, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&stress->churn_reads, churn_reads, __ATOMIC_RELAXED);
+	free(buffer);
+	return NULL;
+}
+
+// Cria arquivos novos em /CHURN e remove os antigos, liberando clusters que voltam a ser usados pelos próximos
+static void* writer_thread(void* argument) {
+	stress_t* stress = (stress_t*) argument;
+	uint8_t* buffer = (uint8_t*) malloc(STRESS_MAX_CHURN_FILE);
+	char path[64];
+
+	while(now() < stress->deadline) {
+		uint32_t file = stress->churn_next;
+		sprintf(path, "/CHURN/C%u.BIN", file);
+		int result = fat32_create(stress->volume, path, 0);
+		if(result != FAT32_OK) report_failure(stress, "%s: create failed (%lld)", path, result);
+		__atomic_store_n(&stress->churn_next, file + 1, __ATOMIC_RELEASE);
+
+		uint32_t size = churn_file_size(file);
+		fill_pattern(buffer, 100000 + file, 0, size);
+		int64_t written = fat32_write(stress->volume, path, 0, buffer, size);
+		if(written != size) report_failure(stress, "%s: write failed (%lld)", path, written);
+		stress->writes++;
+
+		if(file >= STRESS_CHURN_LIVE) {
+			sprintf(path, "/CHURN/C%u.BIN", file - STRESS_CHURN_LIVE);
+			result = fat32_remove(stress->volume, path);
+			if(result != FAT32_OK) report_failure(stress, "%s: remove failed (%lld)", path, result);
+			stress->removes++;
+		}
+	}
+	free(buffer);
+	return NULL;
+}
+
+// Cria /DATA e /CHURN e escreve os arquivos fixos em pedaços alternados
+static int populate(fat32_t* volume) {
+	if(fat32_create(volume, "/DATA", 1) != FAT32_OK || fat32_create(volume, "/CHURN", 1) != FAT32_OK) return 0;
+
+	char path[64];
+	uint8_t buffer[STRESS_WRITE_CHUNK];
+	for(uint32_t i = 0; i < STRESS_FILES; i++) {
+		sprintf(path, "/DATA/F%u.BIN", i);
+		if(fat32_create(volume, path, 0) != FAT32_OK) return 0;
+	}
+	for(uint64_t offset = 0; offset < STRESS_MAX_FILE; offset += STRESS_WRITE_CHUNK) {
+		for(uint32_t i = 0; i < STRESS_FILES; i++) {
+			uint32_t size = data_file_size(i);
+			if(offset >= size) continue;
+			uint64_t length = size - offset < STRESS_WRITE_CHUNK ? size - offset : STRESS_WRITE_CHUNK;
+			sprintf(path, "/DATA/F%u.BIN", i);
+			fill_pattern(buffer, i, offset, length);
+			if(fat32_write(volume, path, offset, buffer, length) != (int64_t) length) return 0;
+		}
+	}
+	return 1;
+}
+
+static void usage(char* program) {
+	printf("Usage: %s [-r readers] [-s seconds] [-b pread|mmap] [image]\n", program);
+}
+
+int main(int argc, char** argv) {
+	mount_options_t options = { 0 };
+	options.fat_cache_size = FAT_CACHE_DEFAULT_BUDGET;
+	options.backend = BDEV_PREAD;
+	// Cache de diretórios pequena para as listagens concorrerem com as entradas saindo da cache
+	options.dir_cache_size = 64 * 1024;
+	int readers = 8;
+	double seconds = 3;
+
+	int opt;
+	while((opt = getopt(argc, argv, "r:s:b:")) != -1) {
+		switch(opt) {
+			case 'r':
+				readers = atoi(optarg);
+				break;
+			case 's':
+				seconds = atof(optarg);
+				break;
+			case 'b':
+				options.backend = bdev_backend_from_name(optarg);
+				if(options.backend < 0) {
+					usage(argv[0]);
+					return 2;
+				}
+				break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+	if(argc - optind > 1 || readers < 1) {
+		usage(argv[0]);
+		return 2;
+	}
+	const char* image_path = argc - optind == 1 ? argv[optind] : "fat_stress.img";
+
+	if(!format_image(image_path)) {
+		printf("%s: Unable to create image\n", image_path);
+		return 1;
+	}
+	fat32_t* volume = read_disk(image_path, &options);
+	if(volume == NULL || !populate(volume)) {
+		printf("%s: Unable to populate image\n", image_path);
+		return 1;
+	}
+
+	stress_t stress = { 0 };
+	stress.volume = volume;
+	stress.deadline = now() + seconds;
+	pthread_t* threads = (pthread_t*) malloc((readers + 1) * sizeof(pthread_t));
+	double start = now();
+	pthread_create(&threads[0], NULL, writer_thread, &stress);
+	for(int i = 1; i <= readers; i++) pthread_create(&threads[i], NULL, reader_thread, &stress);
+	for(int i = 0; i <= readers; i++) pthread_join(threads[i], NULL);
+	double elapsed = now() - start;
+	free(threads);
+
+	printf("%d readers + 1 writer, %.1f s\n", readers, elapsed);
+	printf("Reads: %llu (%.0f/s, %.1f MiB/s)\n", (unsigned long long) stress.reads, stress.reads / elapsed, stress.bytes / elapsed / (1 << 20));
+	printf("Listings: %llu, reads of changing files: %llu\n", (unsigned long long) stress.lists, (unsigned long long) stress.churn_reads);
+	printf("Files created: %llu, removed: %llu\n", (unsigned long long) stress.writes, (unsigned long long) stress.removes);
+
+	// No fim a imagem tem que estar consistente
+	fsck(volume, 0);
+	int inconsistent = take_command_failure(volume);
+	close_disk(volume);
+
+	printf("Failures: %llu%s\n", (unsigned long long) stress.failures, inconsistent ? ", fsck found problems" : "");
+	return stress.failures || inconsistent;
+}
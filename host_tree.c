@@ -0,0 +1,89 @@
+/**
+ *    Descrição: Leitura e criação de árvores de diretórios do computador (import e extract)
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "host_tree.h"
+
+// Acrescenta um nó com o caminho parent_path/name (ou só name na raiz)
+static void add_node(host_tree_t* tree, const char* parent_path, const char* name, struct stat* st, int32_t parent) {
+	if(tree->count == tree->capacity) {
+		tree->capacity = tree->capacity ? tree->capacity * 2 : 64;
+		tree->nodes = (host_node_t*) realloc(tree->nodes, tree->capacity * sizeof(host_node_t));
+	}
+	host_node_t* node = &tree->nodes[tree->count++];
+
+	size_t parent_length = parent_path ? strlen(parent_path) : 0;
+	node->path = (char*) malloc(parent_length + strlen(name) + 2);
+	if(parent_path) sprintf(node->path, "%s/%s", parent_path, name);
+	else strcpy(node->path, name);
+
+	// O nome é o último componente, ignorando barras no fim do caminho da raiz
+	size_t length = strlen(node->path);
+	while(length > 1 && node->path[length - 1] == '/') node->path[--length] = '\0';
+	char* slash = strrchr(node->path, '/');
+	node->name = slash && slash[1] ? slash + 1 : node->path;
+
+	node->size = S_ISREG(st->st_mode) ? st->st_size : 0;
+	node->is_directory = S_ISDIR(st->st_mode);
+	node->parent = parent;
+}
+
+// Lê a árvore a partir do diretório root (links simbólicos não são seguidos)
+// Retorna 0 se root não for um diretório
+int host_tree_scan(host_tree_t* tree, const char* root) {
+	memset(tree, 0, sizeof(host_tree_t));
+	struct stat st;
+	if(stat(root, &st) < 0 || !S_ISDIR(st.st_mode)) return 0;
+	add_node(tree, NULL, root, &st, -1);
+
+	// Os diretórios são lidos na ordem em que aparecem no vetor, o que dá a ordem em largura
+	for(uint32_t i = 0; i < tree->count; i++) {
+		if(!tree->nodes[i].is_directory) continue;
+		DIR* directory = opendir(tree->nodes[i].path);
+		if(directory == NULL) {
+			tree->skipped++;
+			continue;
+		}
+
+		struct dirent* child;
+		while((child = readdir(directory)) != NULL) {
+			if(!strcmp(child->d_name, ".") || !strcmp(child->d_name, "..")) continue;
+
+			char* child_path = (char*) malloc(strlen(tree->nodes[i].path) + strlen(child->d_name) + 2);
+			sprintf(child_path, "%s/%s", tree->nodes[i].path, child->d_name);
+			int usable = lstat(child_path, &st) == 0 && (S_ISREG(st.st_mode) || S_ISDIR(st.st_mode));
+			free(child_path);
+
+			if(!usable) {
+				tree->skipped++;
+				continue;
+			}
+			// add_node pode mover o vetor, então o caminho do pai é pego de novo a cada filho
+			add_node(tree, tree->nodes[i].path, child->d_name, &st, i);
+		}
+		closedir(directory);
+	}
+	return 1;
+}
+
+void host_tree_destroy(host_tree_t* tree) {
+	for(uint32_t i = 0; i < tree->count; i++) free(tree->nodes[i].path);
+	free(tree->nodes);
+	memset(tree, 0, sizeof(host_tree_t));
+}
+
+// Cria o diretório no computador, retorna 1 se ele foi criado ou já existia
+// Usa mkdirat porque o símbolo mkdir do programa é o comando da shell (fat32.c)
+int host_make_directory(const char* path) {
+	struct stat st;
+	if(mkdirat(AT_FDCWD, path, 0777) == 0) return 1;
+	return errno == EEXIST && stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
@@ -0,0 +1,36 @@
+/**
+ *    Descrição: Leitura e criação de árvores de diretórios do computador (import e extract)
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#ifndef HOST_TREE_H
+#define HOST_TREE_H
+
+#include <stdint.h>
+
+// Arquivo ou diretório encontrado na árvore
+typedef struct host_node {
+	// Caminho completo no computador
+	char* path;
+	// Último componente do caminho (aponta para dentro de path)
+	char* name;
+	uint64_t size;
+	int is_directory;
+	// Posição do diretório pai no vetor de nós, -1 na raiz
+	int32_t parent;
+} host_node_t;
+
+// Nós em ordem de largura: os filhos de um diretório ficam juntos e sempre depois do pai
+typedef struct host_tree {
+	host_node_t* nodes;
+	uint32_t count;
+	uint32_t capacity;
+	// Quantidade de entradas ignoradas (links, dispositivos, sem permissão)
+	uint32_t skipped;
+} host_tree_t;
+
+int host_tree_scan(host_tree_t* tree, const char* root);
+void host_tree_destroy(host_tree_t* tree);
+int host_make_directory(const char* path);
+
+#endif
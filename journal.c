@@ -0,0 +1,160 @@
+/**
+ *    Descrição: Journal de escrita antecipada (arquivo <imagem>.journal) para as gravações de metadados
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "journal.h"
+
+// "FATJRNL1" e "FATJCMT1" em little endian
+#define JOURNAL_MAGIC 0x314C4E524A544146ULL
+#define JOURNAL_COMMIT_MAGIC 0x31544D434A544146ULL
+
+// Formato no arquivo: cabeçalho, para cada escrita (cabeçalho + dados) e o bloco de commit
+// A transação só vale se o bloco de commit estiver completo e o checksum bater
+typedef struct journal_header {
+	uint64_t magic;
+	uint64_t sequence;
+	uint32_t record_count;
+	uint32_t reserved;
+	uint64_t payload_size;
+} __attribute__((packed)) journal_header_t;
+
+typedef struct journal_record_header {
+	uint64_t offset;
+	uint32_t length;
+	uint32_t reserved;
+} __attribute__((packed)) journal_record_header_t;
+
+typedef struct journal_commit_block {
+	uint64_t magic;
+	uint64_t sequence;
+	uint64_t checksum;
+} __attribute__((packed)) journal_commit_block_t;
+
+// FNV-1a de 64 bits
+static uint64_t checksum(const uint8_t* data, uint64_t size) {
+	uint64_t hash = 14695981039346656037ULL;
+	for(uint64_t i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Abre (ou cria) o journal ao lado da imagem, retorna NULL se não conseguir
+journal_t* journal_open(const char* image_path) {
+	char* path = (char*) malloc(strlen(image_path) + strlen(".journal") + 1);
+	sprintf(path, "%s.journal", image_path);
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	free(path);
+	if(fd < 0) return NULL;
+
+	journal_t* journal = (journal_t*) calloc(1, sizeof(journal_t));
+	journal->fd = fd;
+	return journal;
+}
+
+void journal_close(journal_t* journal) {
+	if(journal == NULL) return;
+	close(journal->fd);
+	free(journal);
+}
+
+// Reaplica na imagem a última transação confirmada, se existir
+// Retorna a quantidade de escritas reaplicadas (0 se o journal estiver vazio ou incompleto)
+int journal_replay(journal_t* journal, block_device_t* disk) {
+	struct stat st;
+	if(fstat(journal->fd, &st) < 0 || st.st_size < sizeof(journal_header_t) + sizeof(journal_commit_block_t)) {
+		journal_clear(journal);
+		return 0;
+	}
+
+	uint8_t* buffer = (uint8_t*) malloc(st.st_size);
+	if(pread(journal->fd, buffer, st.st_size, 0) != st.st_size) {
+		free(buffer);
+		return 0;
+	}
+
+	int replayed = 0;
+	journal_header_t* header = (journal_header_t*) buffer;
+	uint64_t commit_position = sizeof(journal_header_t) + header->payload_size;
+	if(header->magic == JOURNAL_MAGIC && commit_position + sizeof(journal_commit_block_t) <= st.st_size) {
+		journal_commit_block_t* commit = (journal_commit_block_t*) (buffer + commit_position);
+		if(commit->magic == JOURNAL_COMMIT_MAGIC && commit->sequence == header->sequence && commit->checksum == checksum(buffer, commit_position)) {
+			// Transação completa: aplica as escritas na ordem em que foram registradas
+			uint64_t position = sizeof(journal_header_t);
+			for(uint32_t i = 0; i < header->record_count && position + sizeof(journal_record_header_t) <= commit_position; i++) {
+				journal_record_header_t* record = (journal_record_header_t*) (buffer + position);
+				position += sizeof(journal_record_header_t);
+				if(position + record->length > commit_position || record->offset + record->length > disk->size) break;
+				bdev_write(disk, buffer + position, record->length, record->offset);
+				position += record->length;
+				replayed++;
+			}
+			bdev_sync(disk);
+			journal->sequence = header->sequence;
+		}
+	}
+	// Transação incompleta nunca chegou na imagem, então pode ser descartada
+	free(buffer);
+	journal->replayed += replayed;
+	journal_clear(journal);
+	return replayed;
+}
+
+// Grava a transação inteira no journal com uma única escrita e um único fsync
+// Retorna 1 se a transação foi confirmada
+int journal_commit(journal_t* journal, journal_record_t* records, uint32_t count) {
+	uint64_t payload_size = 0;
+	for(uint32_t i = 0; i < count; i++) payload_size += sizeof(journal_record_header_t) + records[i].length;
+	uint64_t total_size = sizeof(journal_header_t) + payload_size + sizeof(journal_commit_block_t);
+
+	uint8_t* buffer = (uint8_t*) malloc(total_size);
+	journal_header_t* header = (journal_header_t*) buffer;
+	header->magic = JOURNAL_MAGIC;
+	header->sequence = ++journal->sequence;
+	header->record_count = count;
+	header->reserved = 0;
+	header->payload_size = payload_size;
+
+	uint64_t position = sizeof(journal_header_t);
+	for(uint32_t i = 0; i < count; i++) {
+		journal_record_header_t* record = (journal_record_header_t*) (buffer + position);
+		record->offset = records[i].offset;
+		record->length = records[i].length;
+		record->reserved = 0;
+		position += sizeof(journal_record_header_t);
+		memcpy(buffer + position, records[i].data, records[i].length);
+		position += records[i].length;
+	}
+
+	journal_commit_block_t* commit = (journal_commit_block_t*) (buffer + position);
+	commit->magic = JOURNAL_COMMIT_MAGIC;
+	commit->sequence = header->sequence;
+	commit->checksum = checksum(buffer, position);
+
+	uint64_t done = 0;
+	while(done < total_size) {
+		ssize_t n = pwrite(journal->fd, buffer + done, total_size - done, done);
+		if(n <= 0) break;
+		done += n;
+	}
+	free(buffer);
+	if(done < total_size || fdatasync(journal->fd) < 0) return 0;
+
+	journal->commits++;
+	journal->records += count;
+	journal->bytes += total_size;
+	return 1;
+}
+
+// Esvazia o journal depois que a transação chegou na imagem
+void journal_clear(journal_t* journal) {
+	if(ftruncate(journal->fd, 0) < 0) perror("journal");
+}
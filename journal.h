@@ -0,0 +1,38 @@
+/**
+ *    Descrição: Journal de escrita antecipada (arquivo <imagem>.journal) para as gravações de metadados
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include "block_device.h"
+
+// Escrita que faz parte de uma transação
+typedef struct journal_record {
+	uint64_t offset;
+	uint32_t length;
+	const uint8_t* data;
+} journal_record_t;
+
+// Journal aberto
+typedef struct journal {
+	int fd;
+	uint64_t sequence;
+
+	// Contadores
+	uint64_t commits;
+	uint64_t records;
+	uint64_t bytes;
+	uint64_t replayed;
+} journal_t;
+
+journal_t* journal_open(const char* image_path);
+void journal_close(journal_t* journal);
+
+int journal_replay(journal_t* journal, block_device_t* disk);
+int journal_commit(journal_t* journal, journal_record_t* records, uint32_t count);
+void journal_clear(journal_t* journal);
+
+#endif
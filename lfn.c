@@ -0,0 +1,126 @@
+/**
+ *    Descrição: Decodificação dos nomes longos (VFAT) durante a leitura das entradas e conversão de UTF-16 para UTF-8
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <string.h>
+#include "lfn.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Checksum do nome curto guardado em LDIR_Chksum de cada entrada do nome longo
+uint8_t lfn_checksum(const char* short_name) {
+	uint8_t sum = 0;
+	for(int i = 0; i < 11; i++) sum = ((sum & 1) ? 0x80 : 0) + (sum >> 1) + (uint8_t) short_name[i];
+	return sum;
+}
+
+void lfn_reset(lfn_decoder_t* decoder) {
+	decoder->length = 0;
+	decoder->expected = 0;
+	decoder->pending = 0;
+}
+
+// Acrescenta uma entrada de nome longo, na ordem em que aparece no diretório (do último pedaço para o primeiro)
+// Entradas fora de ordem ou com checksum diferente descartam o nome em andamento
+void lfn_push(lfn_decoder_t* decoder, struct LongDirEntry* entry) {
+	uint8_t ordinal = entry->LDIR_Ord & ~LFN_LAST_ENTRY;
+
+	if(entry->LDIR_Ord & LFN_LAST_ENTRY) {
+		decoder->pending = ordinal >= 1 && ordinal <= LFN_MAX_ENTRIES;
+		decoder->expected = ordinal;
+		decoder->checksum = entry->LDIR_Chksum;
+		decoder->length = ordinal * LFN_UNITS_PER_ENTRY;
+	}
+	else if(ordinal == 0 || ordinal != decoder->expected || entry->LDIR_Chksum != decoder->checksum) decoder->pending = 0;
+	if(!decoder->pending) {
+		lfn_reset(decoder);
+		return;
+	}
+
+	// Os 13 caracteres ficam divididos em três campos da entrada
+	uint16_t* units = &decoder->units[(ordinal - 1) * LFN_UNITS_PER_ENTRY];
+	memcpy(units, entry->LDIR_Name1, sizeof(entry->LDIR_Name1));
+	memcpy(units + 5, entry->LDIR_Name2, sizeof(entry->LDIR_Name2));
+	memcpy(units + 11, entry->LDIR_Name3, sizeof(entry->LDIR_Name3));
+
+	// Só o último pedaço pode ser menor, terminado com 0x0000 (e completado com 0xFFFF)
+	if(entry->LDIR_Ord & LFN_LAST_ENTRY) {
+		for(int i = 0; i < LFN_UNITS_PER_ENTRY; i++) {
+			if(units[i] == 0x0000) {
+				decoder->length = (ordinal - 1) * LFN_UNITS_PER_ENTRY + i;
+				break;
+			}
+		}
+	}
+	decoder->expected--;
+}
+
+// Termina o nome na entrada curta que vem depois das entradas longas
+// Retorna o tamanho do nome em unidades UTF-16, ou 0 se não houver um nome completo com o checksum do nome curto
+uint32_t lfn_finish(lfn_decoder_t* decoder, const char* short_name) {
+	uint32_t length = 0;
+	if(decoder->pending && decoder->expected == 0 && decoder->checksum == lfn_checksum(short_name)) length = decoder->length;
+	decoder->pending = 0;
+	decoder->expected = 0;
+	return length;
+}
+
+// Converte um caractere (ou um par de surrogates) a partir de units[*position], avançando a posição
+// Surrogates sem par viram U+FFFD
+static size_t utf8_encode_unit(char* output, const uint16_t* units, size_t count, size_t* position) {
+	uint32_t code = units[(*position)++];
+	if(code >= 0xD800 && code <= 0xDBFF && *position < count && units[*position] >= 0xDC00 && units[*position] <= 0xDFFF)
+		code = 0x10000 + ((code - 0xD800) << 10) + (units[(*position)++] - 0xDC00);
+	else if(code >= 0xD800 && code <= 0xDFFF) code = 0xFFFD;
+
+	if(code < 0x80) {
+		output[0] = code;
+		return 1;
+	}
+	if(code < 0x800) {
+		output[0] = 0xC0 | (code >> 6);
+		output[1] = 0x80 | (code & 0x3F);
+		return 2;
+	}
+	if(code < 0x10000) {
+		output[0] = 0xE0 | (code >> 12);
+		output[1] = 0x80 | ((code >> 6) & 0x3F);
+		output[2] = 0x80 | (code & 0x3F);
+		return 3;
+	}
+	output[0] = 0xF0 | (code >> 18);
+	output[1] = 0x80 | ((code >> 12) & 0x3F);
+	output[2] = 0x80 | ((code >> 6) & 0x3F);
+	output[3] = 0x80 | (code & 0x3F);
+	return 4;
+}
+
+// Converte count unidades UTF-16 para UTF-8 terminado em '\0', output precisa de 3 * count + 1 bytes
+// Retorna o tamanho sem o '\0'
+// Com SSE2, blocos de 8 caracteres ASCII (o caso comum) são convertidos de uma vez
+size_t lfn_utf16_to_utf8(char* output, const uint16_t* units, size_t count) {
+	size_t length = 0;
+	size_t position = 0;
+	while(position < count) {
+#ifdef __SSE2__
+		if(count - position >= 8) {
+			__m128i block = _mm_loadu_si128((const __m128i*) (units + position));
+			// Todos os caracteres abaixo de 0x80: junta os bytes baixos e grava os 8 de uma vez
+			__m128i high_bits = _mm_and_si128(block, _mm_set1_epi16((short) 0xFF80));
+			if(_mm_movemask_epi8(_mm_cmpeq_epi16(high_bits, _mm_setzero_si128())) == 0xFFFF) {
+				_mm_storel_epi64((__m128i*) (output + length), _mm_packus_epi16(block, block));
+				length += 8;
+				position += 8;
+				continue;
+			}
+		}
+#endif
+		if(units[position] < 0x80) output[length++] = units[position++];
+		else length += utf8_encode_unit(output + length, units, count, &position);
+	}
+	output[length] = '\0';
+	return length;
+}
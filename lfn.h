@@ -0,0 +1,41 @@
+/**
+ *    Descrição: Decodificação dos nomes longos (VFAT) durante a leitura das entradas e conversão de UTF-16 para UTF-8
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#ifndef LFN_H
+#define LFN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "fat32.h"
+
+// Um nome longo tem no máximo 20 entradas de 13 caracteres UTF-16 (255 usados)
+#define LFN_MAX_ENTRIES 20
+#define LFN_UNITS_PER_ENTRY 13
+#define LFN_MAX_UNITS (LFN_MAX_ENTRIES * LFN_UNITS_PER_ENTRY)
+// Bit do LDIR_Ord que marca a última entrada do nome (a primeira no disco)
+#define LFN_LAST_ENTRY 0x40
+// Maior tamanho do nome em UTF-8, com o '\0' (cada unidade UTF-16 vira no máximo 3 bytes)
+#define LFN_MAX_UTF8 (LFN_MAX_UNITS * 3 + 1)
+
+// Nome longo sendo montado enquanto as entradas do diretório são lidas em ordem
+typedef struct lfn_decoder {
+	uint16_t units[LFN_MAX_UNITS];
+	uint32_t length;
+	// Ordinal esperado na próxima entrada, 0 quando não há nome em andamento ou ele já está completo
+	uint8_t expected;
+	uint8_t checksum;
+	// 1 enquanto as entradas lidas formam um nome válido
+	uint8_t pending;
+} lfn_decoder_t;
+
+uint8_t lfn_checksum(const char* short_name);
+
+void lfn_reset(lfn_decoder_t* decoder);
+void lfn_push(lfn_decoder_t* decoder, struct LongDirEntry* entry);
+uint32_t lfn_finish(lfn_decoder_t* decoder, const char* short_name);
+
+size_t lfn_utf16_to_utf8(char* output, const uint16_t* units, size_t count);
+
+#endif
@@ -6,102 +6,318 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <getopt.h>
+#include <signal.h>
 #include "fat32.h"
+#include "dir_cache.h"
+#include "server.h"
+#include "fat32_service.h"
 
-int main(int argc, char **argv) {
-	if(argc != 2) {
-		printf("Invalid parameter count: %d\n", argc);
-		printf("Usage: %s fat32image.img\n", argv[0]);
-		return 0;
+// unistd.h não pode ser incluído junto com fat32.h (rmdir tem outra assinatura na shell)
+int isatty(int fd);
+
+// Maior linha de comando aceita e maior quantidade de parâmetros de um comando
+#define COMMAND_LINE_SIZE 4096
+#define COMMAND_MAX_ARGS 256
+// Retorno de run_command quando o comando é o exit
+#define COMMAND_EXIT -1
+
+// Imprime o modo de uso do programa
+void usage(char* program) {
+	printf("Usage: %s [-m fat_cache_kib] [-d dir_cache_kib] [-b pread|mmap] [-j] [-t threads] [-i] [-c \"cmd; cmd\" | -f script | -S socket] fat32image.img\n", program);
+}
+
+// Separa a linha em parâmetros dentro dela mesma: espaços separam, "..." junta um parâmetro com espaços
+// (ex.: cd "My Documents") e \ tira o significado especial do caractere seguinte (cd My\ Documents)
+// Retorna a quantidade de parâmetros ou -1 se alguma aspa ficou aberta
+static int split_arguments(char* line, char** args, int max_args) {
+	int count = 0;
+	char* read = line;
+	char* write = line;
+	while(count < max_args) {
+		while(*read && strchr(" \t\r\n", *read)) read++;
+		if(*read == '\0') break;
+
+		// O parâmetro sem as aspas e as barras nunca é maior que o texto lido, então é reescrito no mesmo lugar
+		args[count++] = write;
+		int quoted = 0;
+		while(*read && (quoted || !strchr(" \t\r\n", *read))) {
+			char c = *read++;
+			if(c == '"') quoted = !quoted;
+			else if(c == '\\' && *read && (!quoted || *read == '"' || *read == '\\')) *write++ = *read++;
+			else *write++ = c;
+		}
+		if(quoted) return -1;
+		if(*read) read++;
+		*write++ = '\0';
 	}
+	return count;
+}
 
-	const char *disk_name = argv[1];
+// Executa uma linha de comando da shell (linhas vazias e começando com # são ignoradas)
+// Retorna 0 se deu certo, 1 se o comando falhou ou COMMAND_EXIT
+static int run_command(fat32_t* volume, char* line) {
+	// O comentário é ignorado antes de separar os parâmetros, então aspas nele não importam
+	line += strspn(line, " \t\r\n");
+	if(line[0] == '#') return 0;
 
-	read_disk(disk_name);
+	// Os parâmetros apontam para dentro da própria linha
+	char* args[COMMAND_MAX_ARGS + 1];
+	int args_count = split_arguments(line, args, COMMAND_MAX_ARGS);
+	if(args_count < 0) {
+		command_error(volume, "Unterminated quote\n");
+		return take_command_failure(volume);
+	}
+	args[args_count] = NULL;
+	if(args_count == 0) return 0;
 
-	// Buffer de entrada do usuário
-	char str[1024] = { 0 };
-	// Buffer que guarda o comando do linux
-	char cmd[1024];
-	// Buffer que guarda os parâmetros quem vem após o comando
-	char** args = (char**) malloc(sizeof(char*) * 1024);
+	char* cmd = args[0];
+
+	if(!strcmp(cmd, "exit")) {
+		return COMMAND_EXIT;
+	}
+	else if(!strcmp(cmd, "cd")) {
+		if(args_count != 2) command_error(volume, "cd: Invalid parameter count\n");
+		else cd(volume, args[1]);
+	}
+	else if(!strcmp(cmd, "info")) {
+		info(volume);	
+	}
+	else if(!strcmp(cmd, "sync")) {
+		sync_disk(volume);
+	}
+	else if(!strcmp(cmd, "cache")) {
+		cache_info(volume);
+	}
+	else if(!strcmp(cmd, "df")) {
+		df(volume);
+	}
+	else if(!strcmp(cmd, "ls")) {
+		ls(volume);	
+	}
+	else if(!strcmp(cmd, "cluster")) {
+		if(args_count != 2) command_error(volume, "cluster: Invalid parameter count\n");
+		else {
+			int cluster_number;
+			sscanf(args[1], "%d", &cluster_number);
+			cluster(volume, cluster_number);
+		}
+	}
+	else if(!strcmp(cmd, "cat")) {
+		if(args_count != 2) command_error(volume, "cat: Invalid parameter count\n");
+		else cat(volume, args[1]);
+	}
+	else if(!strcmp(cmd, "pwd")){
+		pwd(volume);
+	}
+	else if(!strcmp(cmd, "attr")){
+		if(args_count != 2) command_error(volume, "attr: Invalid parameter count\n");
+		else attr(volume, args[1]);
+	}
+	else if(!strcmp(cmd, "touch")) {
+		if(args_count != 2) command_error(volume, "touch: Invalid parameter count\n");
+		else touch(volume, args[1]);
+	}
+	else if(!strcmp(cmd, "rm")) {
+		if(args_count != 2) command_error(volume, "rm: Invalid parameter count\n");
+		else rm(volume, args[1]);
+	}
+	else if(!strcmp(cmd, "rmdir")) {
+		if(args_count != 2) command_error(volume, "rmdir: Invalid parameter count\n");
+		else rmdir(volume, args[1]);
+	}
+	else if(!strcmp(cmd, "rename")) {
+		if(args_count != 3) command_error(volume, "rename: Invalid parameter count\n");
+		else rename_dir_entry(volume, args[1], args[2]);
+	}
+	else if(!strcmp(cmd, "mkdir")) {
+		if(args_count != 2) command_error(volume, "mkdir: Invalid parameter count\n");
+		else mkdir(volume, args[1]);
+	}
+	else if(!strcmp(cmd, "cp")) {
+		if(args_count != 3) command_error(volume, "cp: Invalid parameter count\n");
+		else cp(volume, args[1], args[2]);
+	}
+	else if(!strcmp(cmd, "mv")) {
+		if(args_count != 3) command_error(volume, "mv: Invalid parameter count\n");
+		else mv(volume, args[1], args[2]);
+	}
+	else if(!strcmp(cmd, "import")) {
+		if(args_count != 2 && args_count != 3) command_error(volume, "import: Invalid parameter count\n");
+		else import(volume, args[1], args[2]);
+	}
+	else if(!strcmp(cmd, "extract")) {
+		if(args_count != 3) command_error(volume, "extract: Invalid parameter count\n");
+		else extract(volume, args[1], args[2]);
+	}
+	else if(!strcmp(cmd, "du")) {
+		if(args_count > 2) command_error(volume, "du: Invalid parameter count\n");
+		else du(volume, args[1]);
+	}
+	else if(!strcmp(cmd, "tree")) {
+		if(args_count > 2) command_error(volume, "tree: Invalid parameter count\n");
+		else tree(volume, args[1]);
+	}
+	else if(!strcmp(cmd, "find")) {
+		find(volume, args_count - 1, args + 1);
+	}
+	else if(!strcmp(cmd, "fsck")) {
+		if(args_count > 2 || (args_count == 2 && strcmp(args[1], "-r"))) command_error(volume, "fsck: Usage: fsck [-r]\n");
+		else fsck(volume, args_count == 2);
+	}
+	else if(!strcmp(cmd, "prealloc")) {
+		if(args_count != 3) command_error(volume, "prealloc: Invalid parameter count\n");
+		else prealloc(volume, args[1], args[2]);
+	}
+	else command_error(volume, "%s: Command not found\n", cmd);
 
+	// Grava as alterações pendentes se já houver muitas acumuladas
+	flush_disk_if_needed(volume);
+	return take_command_failure(volume);
+}
+
+// Executa as linhas de input até o exit ou o fim do arquivo, com o prompt se for interativo
+// Retorna 1 se algum comando falhou
+static int run_stream(fat32_t* volume, FILE* input, int interactive) {
+	// Buffer de entrada do usuário
+	char line[COMMAND_LINE_SIZE];
+	int failed = 0;
 	while(1) {
-		// Input do Usuário
-		printf("fatshell:[%s/] $ ", directory_stack_count ? directory_stack->name : "img");
-		fgets(str, 1024, stdin);
-		str[strcspn(str, "\n")] = '\0';
-		
-		// ----------------------- Formatação do input ---------------------------- //
-		char* token = strtok(str, " ");
-		int args_count = 0;
-
-		while (token != NULL) {
-			if(args_count == 0) strcpy(cmd, token);
-			
-
-			args[args_count] = (char*) malloc(sizeof(char) * strlen(token) + 1);
-			strcpy(args[args_count++], token);
-
-	
-			args[args_count] = NULL;
-
-			token = strtok(NULL, " ");
+		if(interactive) {
+			const char* directory_name = current_directory_name(volume);
+			printf("fatshell:[%s/] $ ", directory_name ? directory_name : "img");
+		}
+		if(fgets(line, sizeof(line), input) == NULL) break;
+		int result = run_command(volume, line);
+		if(result == COMMAND_EXIT) break;
+		failed |= result;
+	}
+	if(interactive && feof(input)) printf("\n");
+	return failed;
+}
+
+// Primeiro ';' fora de aspas e sem \ antes, NULL se não houver
+static char* find_separator(char* commands) {
+	int quoted = 0;
+	for(char* c = commands; *c; c++) {
+		if(*c == '\\' && c[1]) c++;
+		else if(*c == '"') quoted = !quoted;
+		else if(*c == ';' && !quoted) return c;
+	}
+	return NULL;
+}
+
+// Executa os comandos separados por ';' de -c (um ';' entre aspas faz parte do parâmetro)
+// Retorna 1 se algum comando falhou
+static int run_command_list(fat32_t* volume, char* commands) {
+	int failed = 0;
+	while(commands != NULL) {
+		char* separator = find_separator(commands);
+		if(separator) *separator++ = '\0';
+		int result = run_command(volume, commands);
+		if(result == COMMAND_EXIT) break;
+		failed |= result;
+		commands = separator;
+	}
+	return failed;
+}
+
+int main(int argc, char **argv) {
+	mount_options_t options = { 0 };
+	options.fat_cache_size = FAT_CACHE_DEFAULT_BUDGET;
+	options.backend = BDEV_PREAD;
+	options.dir_cache_size = DIR_CACHE_DEFAULT_BUDGET;
+	// Comandos de -c e script de -f; sem eles os comandos vêm da entrada padrão
+	char* command_list = NULL;
+	char* script_path = NULL;
+	// Socket do modo servidor (-S)
+	char* socket_path = NULL;
+
+	int opt;
+	while((opt = getopt(argc, argv, "m:d:b:jt:ic:f:S:")) != -1) {
+		switch(opt) {
+			case 'm':
+				options.fat_cache_size = strtoull(optarg, NULL, 10) * 1024;
+				break;
+			case 'd':
+				options.dir_cache_size = strtoull(optarg, NULL, 10) * 1024;
+				break;
+			case 'b':
+				options.backend = bdev_backend_from_name(optarg);
+				if(options.backend < 0) {
+					printf("%s: Unknown backend\n", optarg);
+					usage(argv[0]);
+					return 2;
+				}
+				break;
+			case 'j':
+				options.journal = 1;
+				break;
+			case 't':
+				options.threads = strtoul(optarg, NULL, 10);
+				break;
+			case 'i':
+				options.path_index = 1;
+				break;
+			case 'c':
+				command_list = optarg;
+				break;
+			case 'f':
+				script_path = optarg;
+				break;
+			case 'S':
+				socket_path = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return 2;
 		}
-		// ------------------------------------------------------------------------ //
-		
-
-		if(!strcmp(cmd, "exit")) {
-			close_disk();
-			break;
-		};
-		if(!strcmp(cmd, "cd")) {
-			if(args_count != 2) printf("cd: Invalid parameter count\n");
-			else cd(args[1]);
-		};
-		if(!strcmp(cmd, "info")) {
-			info();	
-		};
-		if(!strcmp(cmd, "ls")) {
-			ls();	
-		};
-		if(!strcmp(cmd, "cluster")) {
-			if(args_count != 2) printf("cluster: Invalid parameter count\n");
-			else {
-				int cluster_number;
-				sscanf(args[1], "%d", &cluster_number);
-				cluster(cluster_number);
-			}
-		};
-		if(!strcmp(cmd, "pwd")){
-			pwd();
-		};
-		if(!strcmp(cmd, "attr")){
-			if(args_count != 2) printf("attr: Invalid parameter count\n");
-			else attr(args[1]);
-		};
-		if(!strcmp(cmd, "touch")) {
-			if(args_count != 2) printf("touch: Invalid parameter count\n");
-			else touch(args[1]);
-		};
-		if(!strcmp(cmd, "rm")) {
-			if(args_count != 2) printf("rm: Invalid parameter count\n");
-			else rm(args[1]);
-		};
-		if(!strcmp(cmd, "rmdir")) {
-			if(args_count != 2) printf("rmdir: Invalid parameter count\n");
-			else rmdir(args[1]);
-		};
-		if(!strcmp(cmd, "rename")) {
-			if(args_count != 3) printf("rename: Invalid parameter count\n");
-			else rename_dir_entry(args[1], args[2]);
-		};
-		if(!strcmp(cmd, "mkdir")) {
-			if(args_count != 2) printf("mkdir: Invalid parameter count\n");
-			else mkdir(args[1]);
-		};
-		// Libera a memória para uma próxima leitura do input
-		for(int j = 0; j < args_count; j++) free(args[j]);
-	}
-	return 0;
+	}
+
+	if(argc - optind != 1 || (command_list && script_path) || (socket_path && (command_list || script_path))) {
+		printf("Invalid parameter count: %d\n", argc);
+		usage(argv[0]);
+		return 2;
+	}
+
+	// O script é aberto antes de montar a imagem para não abrir à toa
+	FILE* script = NULL;
+	if(script_path) {
+		script = fopen(script_path, "r");
+		if(script == NULL) {
+			printf("%s: Unable to open script\n", script_path);
+			return 1;
+		}
+	}
+
+	// Saída para um pipe fechado vira erro de escrita do comando (EPIPE) em vez de matar o processo
+	// antes do close_disk gravar as alterações da sessão
+	signal(SIGPIPE, SIG_IGN);
+
+	const char *disk_name = argv[optind];
+
+	fat32_t* volume = read_disk(disk_name, &options);
+	if(volume == NULL) {
+		printf("%s: Unable to open image\n", disk_name);
+		if(script) fclose(script);
+		return 1;
+	}
+
+	// A imagem é montada uma vez só para todos os comandos; no modo não interativo o código de saída é 1 se algum falhou
+	int failed;
+	// No modo servidor as threads de -t atendem as requisições até o SIGINT/SIGTERM
+	if(socket_path) failed = server_run(socket_path, options.threads, fat32_service_handle, volume) != 0;
+	else if(command_list) failed = run_command_list(volume, command_list);
+	else if(script) {
+		failed = run_stream(volume, script, 0);
+		fclose(script);
+	}
+	else {
+		int interactive = isatty(fileno(stdin));
+		failed = run_stream(volume, stdin, interactive);
+		if(interactive) failed = 0;
+	}
+
+	if(!close_disk(volume)) failed = 1;
+	return failed;
 }
@@ -0,0 +1,195 @@
+/**
+ *    Descrição: Índice persistente de caminhos (arquivo <imagem>.idx) lido com mmap, para achar caminhos sem ler diretórios
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "path_index.h"
+
+// "FATPIDX2" em little endian (a versão 1 tinha só os nomes 8.3 e é gerada de novo)
+#define PATH_INDEX_MAGIC 0x3258444950544146ULL
+
+// Formato no arquivo: cabeçalho, registros, tabela hash (primeiro registro de cada lista) e os caminhos
+typedef struct path_index_header {
+	uint64_t magic;
+	path_index_stamp_t stamp;
+	uint32_t record_count;
+	uint32_t bucket_count;
+	uint64_t names_size;
+} __attribute__((packed)) path_index_header_t;
+
+// FNV-1a de 32 bits do caminho em maiúsculas, como os nomes da FAT não diferenciam maiúsculas
+static uint32_t hash_path(const char* path) {
+	uint32_t hash = 2166136261U;
+	for(; *path; path++) {
+		hash ^= (uint8_t) toupper((unsigned char) *path);
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+// Caminho do índice ao lado da imagem (liberar com free)
+static char* index_file_path(const char* image_path, const char* suffix) {
+	char* path = (char*) malloc(strlen(image_path) + strlen(suffix) + 1);
+	sprintf(path, "%s%s", image_path, suffix);
+	return path;
+}
+
+// Preenche o carimbo com o tamanho e a data de modificação da imagem e o número de série do volume
+// Retorna 0 se não conseguir ler os dados da imagem
+int path_index_stamp(const char* image_path, uint32_t volume_id, path_index_stamp_t* stamp) {
+	struct stat st;
+	memset(stamp, 0, sizeof(path_index_stamp_t));
+	if(stat(image_path, &st) < 0) return 0;
+	stamp->image_size = st.st_size;
+	stamp->mtime_seconds = st.st_mtim.tv_sec;
+	stamp->mtime_nanoseconds = st.st_mtim.tv_nsec;
+	stamp->volume_id = volume_id;
+	return 1;
+}
+
+// Abre o índice da imagem com mmap
+// Retorna NULL se ele não existir, estiver incompleto ou tiver sido gerado para outro estado da imagem
+path_index_t* path_index_open(const char* image_path, path_index_stamp_t* stamp) {
+	char* path = index_file_path(image_path, ".idx");
+	int fd = open(path, O_RDONLY);
+	free(path);
+	if(fd < 0) return NULL;
+
+	struct stat st;
+	void* map = MAP_FAILED;
+	if(fstat(fd, &st) == 0 && st.st_size >= sizeof(path_index_header_t))
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) return NULL;
+
+	path_index_header_t* header = (path_index_header_t*) map;
+	uint64_t expected_size = sizeof(path_index_header_t) + (uint64_t)header->record_count * sizeof(path_index_record_t)
+		+ (uint64_t)header->bucket_count * sizeof(uint32_t) + header->names_size;
+	if(header->magic != PATH_INDEX_MAGIC || memcmp(&header->stamp, stamp, sizeof(path_index_stamp_t)) ||
+		header->bucket_count == 0 || header->names_size == 0 || expected_size != (uint64_t) st.st_size ||
+		((char*) map)[st.st_size - 1] != '\0') {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	path_index_t* index = (path_index_t*) calloc(1, sizeof(path_index_t));
+	index->map = map;
+	index->map_size = st.st_size;
+	index->record_count = header->record_count;
+	index->bucket_count = header->bucket_count;
+	index->records = (path_index_record_t*) (header + 1);
+	index->buckets = (uint32_t*) (index->records + index->record_count);
+	index->names = (const char*) (index->buckets + index->bucket_count);
+	return index;
+}
+
+void path_index_close(path_index_t* index) {
+	if(index == NULL) return;
+	munmap(index->map, index->map_size);
+	free(index);
+}
+
+// Procura o registro do caminho completo (/PASTA/ARQ.TXT), sem diferenciar maiúsculas
+// Retorna PATH_INDEX_NONE se o caminho não existir
+uint32_t path_index_lookup(path_index_t* index, const char* path) {
+	uint32_t record = index->buckets[hash_path(path) % index->bucket_count];
+	while(record < index->record_count) {
+		if(!strcasecmp(index->names + index->records[record].path, path)) return record;
+		record = index->records[record].hash_next;
+	}
+	return PATH_INDEX_NONE;
+}
+
+const char* path_index_path(path_index_t* index, uint32_t record) {
+	return index->names + index->records[record].path;
+}
+
+// Acrescenta um registro ao índice sendo montado e retorna a posição dele
+uint32_t path_index_add(path_index_builder_t* builder, const uint8_t* entry, uint32_t parent, uint32_t depth, const char* path) {
+	if(builder->record_count == builder->record_capacity) {
+		builder->record_capacity = builder->record_capacity ? builder->record_capacity * 2 : 1024;
+		builder->records = (path_index_record_t*) realloc(builder->records, builder->record_capacity * sizeof(path_index_record_t));
+	}
+	uint64_t length = strlen(path) + 1;
+	while(builder->names_size + length > builder->names_capacity) {
+		builder->names_capacity = builder->names_capacity ? builder->names_capacity * 2 : 64 * 1024;
+		builder->names = (char*) realloc(builder->names, builder->names_capacity);
+	}
+
+	path_index_record_t* record = &builder->records[builder->record_count];
+	memcpy(record->entry, entry, sizeof(record->entry));
+	record->parent = parent;
+	record->depth = depth;
+	record->path = builder->names_size;
+	record->hash_next = PATH_INDEX_NONE;
+	memcpy(builder->names + builder->names_size, path, length);
+	builder->names_size += length;
+	return builder->record_count++;
+}
+
+// Grava todo o buffer, repetindo as escritas parciais
+static int write_all(int fd, const void* data, uint64_t size) {
+	const uint8_t* bytes = (const uint8_t*) data;
+	while(size) {
+		ssize_t written = write(fd, bytes, size);
+		if(written <= 0) return 0;
+		bytes += written;
+		size -= written;
+	}
+	return 1;
+}
+
+// Monta a tabela hash e grava o índice em <imagem>.idx
+// O arquivo é escrito ao lado e renomeado no fim, então um índice pela metade nunca é aberto
+// Retorna 0 se não conseguir gravar
+int path_index_write(path_index_builder_t* builder, const char* image_path, path_index_stamp_t* stamp) {
+	path_index_header_t header = { 0 };
+	header.magic = PATH_INDEX_MAGIC;
+	header.stamp = *stamp;
+	header.record_count = builder->record_count;
+	header.names_size = builder->names_size;
+	// Potência de 2 com pelo menos uma lista por registro
+	header.bucket_count = 1024;
+	while(header.bucket_count < builder->record_count) header.bucket_count *= 2;
+
+	// Inseridos de trás para frente, cada lista fica na ordem dos registros
+	uint32_t* buckets = (uint32_t*) malloc(header.bucket_count * sizeof(uint32_t));
+	memset(buckets, 0xFF, header.bucket_count * sizeof(uint32_t));
+	for(uint32_t i = builder->record_count; i-- > 0;) {
+		uint32_t bucket = hash_path(builder->names + builder->records[i].path) % header.bucket_count;
+		builder->records[i].hash_next = buckets[bucket];
+		buckets[bucket] = i;
+	}
+
+	char* temporary_path = index_file_path(image_path, ".idx.tmp");
+	int fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	int written = fd >= 0 &&
+		write_all(fd, &header, sizeof(header)) &&
+		write_all(fd, builder->records, (uint64_t)builder->record_count * sizeof(path_index_record_t)) &&
+		write_all(fd, buckets, (uint64_t)header.bucket_count * sizeof(uint32_t)) &&
+		write_all(fd, builder->names, builder->names_size);
+	if(fd >= 0) close(fd);
+	free(buckets);
+
+	char* path = index_file_path(image_path, ".idx");
+	if(written) written = rename(temporary_path, path) == 0;
+	if(!written) unlink(temporary_path);
+	free(temporary_path);
+	free(path);
+	return written;
+}
+
+void path_index_builder_destroy(path_index_builder_t* builder) {
+	free(builder->records);
+	free(builder->names);
+	memset(builder, 0, sizeof(path_index_builder_t));
+}
@@ -0,0 +1,68 @@
+/**
+ *    Descrição: Índice persistente de caminhos (arquivo <imagem>.idx) lido com mmap, para achar caminhos sem ler diretórios
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#ifndef PATH_INDEX_H
+#define PATH_INDEX_H
+
+#include <stdint.h>
+
+// Registro inexistente (fim das listas e caminho não encontrado)
+#define PATH_INDEX_NONE UINT32_MAX
+
+// Carimbo da imagem quando o índice foi gerado, qualquer diferença invalida o índice
+typedef struct path_index_stamp {
+	uint64_t image_size;
+	int64_t mtime_seconds;
+	int64_t mtime_nanoseconds;
+	uint32_t volume_id;
+	uint32_t reserved;
+} __attribute__((packed)) path_index_stamp_t;
+
+// Um arquivo ou diretório da imagem
+typedef struct path_index_record {
+	// Entrada de diretório (32 bytes) como está na imagem; a da raiz é montada com o cluster dela
+	uint8_t entry[32];
+	// Registro do diretório pai (a raiz aponta para ela mesma)
+	uint32_t parent;
+	uint32_t depth;
+	// Deslocamento do caminho completo (/PASTA/ARQ.TXT, com os nomes longos como estão nas entradas) na área de nomes
+	uint32_t path;
+	// Próximo registro na mesma lista da tabela hash
+	uint32_t hash_next;
+} __attribute__((packed)) path_index_record_t;
+
+// Índice aberto, todos os ponteiros apontam para dentro do mapeamento
+typedef struct path_index {
+	void* map;
+	uint64_t map_size;
+	path_index_record_t* records;
+	uint32_t record_count;
+	uint32_t* buckets;
+	uint32_t bucket_count;
+	const char* names;
+} path_index_t;
+
+// Registros sendo montados antes de gravar o arquivo
+typedef struct path_index_builder {
+	path_index_record_t* records;
+	uint32_t record_count;
+	uint32_t record_capacity;
+	char* names;
+	uint64_t names_size;
+	uint64_t names_capacity;
+} path_index_builder_t;
+
+int path_index_stamp(const char* image_path, uint32_t volume_id, path_index_stamp_t* stamp);
+
+path_index_t* path_index_open(const char* image_path, path_index_stamp_t* stamp);
+void path_index_close(path_index_t* index);
+uint32_t path_index_lookup(path_index_t* index, const char* path);
+const char* path_index_path(path_index_t* index, uint32_t record);
+
+uint32_t path_index_add(path_index_builder_t* builder, const uint8_t* entry, uint32_t parent, uint32_t depth, const char* path);
+int path_index_write(path_index_builder_t* builder, const char* image_path, path_index_stamp_t* stamp);
+void path_index_builder_destroy(path_index_builder_t* builder);
+
+#endif
@@ -0,0 +1,397 @@
+/**
+ *    Descrição: Servidor em um socket Unix (-S) com laço de eventos epoll e threads para as operações na imagem,
+ *               e o protocolo de quadros com tamanho usado pelo servidor e pelo fat_client
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include "server.h"
+#include "thread_pool.h"
+
+// Eventos tratados por volta do laço e tamanho de cada leitura do socket
+#define SERVER_MAX_EVENTS 64
+#define SERVER_READ_CHUNK (64 * 1024)
+
+// Cliente conectado
+// Cada conexão tem no máximo uma requisição com as threads, então as respostas saem na ordem dos pedidos
+typedef struct connection {
+	int fd;
+	// Bytes recebidos que ainda não formaram uma requisição tratada
+	server_buffer_t input;
+	// Respostas ainda não enviadas, a partir de output_sent
+	server_buffer_t output;
+	size_t output_sent;
+	// 1 enquanto uma requisição da conexão está com as threads
+	int busy;
+	// 1 depois que o cliente fechou ou deu erro; a memória só é liberada quando a conexão não estiver busy
+	int closed;
+	// 1 se o epoll também está esperando o socket aceitar escrita
+	int waiting_output;
+	struct connection* prev;
+	struct connection* next;
+} connection_t;
+
+// Requisição entregue às threads, que devolvem a resposta na mesma estrutura
+typedef struct server_job {
+	connection_t* connection;
+	uint8_t* request;
+	uint32_t size;
+	server_buffer_t response;
+	struct server_job* next;
+} server_job_t;
+
+typedef struct server {
+	server_handler_t handler;
+	void* context;
+	int epoll_fd;
+	int listen_fd;
+	int signal_fd;
+	// As threads escrevem nele quando terminam uma requisição, para acordar o laço
+	int event_fd;
+	connection_t* connections;
+	// Conexões fechadas esperando para serem liberadas
+	uint32_t closed_count;
+
+	// Fila de requisições para as threads e lista das respostas prontas, protegidas por lock
+	pthread_mutex_t lock;
+	pthread_cond_t has_jobs;
+	server_job_t* queue_head;
+	server_job_t* queue_tail;
+	server_job_t* done;
+	int stopping;
+} server_t;
+
+void* server_buffer_reserve(server_buffer_t* buffer, size_t size) {
+	if(buffer->size + size > buffer->capacity) {
+		size_t capacity = buffer->capacity ? buffer->capacity : 256;
+		while(capacity < buffer->size + size) capacity *= 2;
+		buffer->data = (uint8_t*) realloc(buffer->data, capacity);
+		buffer->capacity = capacity;
+	}
+	void* start = buffer->data + buffer->size;
+	buffer->size += size;
+	return start;
+}
+
+void server_buffer_append(server_buffer_t* buffer, const void* data, size_t size) {
+	memcpy(server_buffer_reserve(buffer, size), data, size);
+}
+
+// Tira os primeiros size bytes do buffer
+static void server_buffer_consume(server_buffer_t* buffer, size_t size) {
+	memmove(buffer->data, buffer->data + size, buffer->size - size);
+	buffer->size -= size;
+}
+
+static void* server_worker(void* argument) {
+	server_t* server = (server_t*) argument;
+	while(1) {
+		pthread_mutex_lock(&server->lock);
+		while(server->queue_head == NULL && !server->stopping) pthread_cond_wait(&server->has_jobs, &server->lock);
+		server_job_t* job = server->queue_head;
+		if(job) {
+			server->queue_head = job->next;
+			if(server->queue_head == NULL) server->queue_tail = NULL;
+		}
+		pthread_mutex_unlock(&server->lock);
+		// Na parada, as requisições que já estavam na fila ainda são respondidas
+		if(job == NULL) break;
+
+		server_buffer_reserve(&job->response, sizeof(server_response_t));
+		server_response_t header;
+		header.status = server->handler(server->context, job->request, job->size, &job->response);
+		header.length = job->response.size - sizeof(header.length);
+		memcpy(job->response.data, &header, sizeof(header));
+		free(job->request);
+		job->request = NULL;
+
+		pthread_mutex_lock(&server->lock);
+		job->next = server->done;
+		server->done = job;
+		pthread_mutex_unlock(&server->lock);
+		uint64_t one = 1;
+		if(write(server->event_fd, &one, sizeof(one)) < 0) perror("server: eventfd");
+	}
+	return NULL;
+}
+
+// Muda os eventos esperados no socket da conexão (leitura sempre, escrita enquanto houver resposta presa)
+static void watch_output(server_t* server, connection_t* connection, int waiting) {
+	if(connection->waiting_output == waiting) return;
+	struct epoll_event event = { 0 };
+	event.events = EPOLLIN | EPOLLRDHUP | (waiting ? EPOLLOUT : 0);
+	event.data.ptr = connection;
+	epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+	connection->waiting_output = waiting;
+}
+
+static void free_connection(server_t* server, connection_t* connection) {
+	if(connection->prev) connection->prev->next = connection->next;
+	else server->connections = connection->next;
+	if(connection->next) connection->next->prev = connection->prev;
+	if(connection->closed) server->closed_count--;
+	free(connection->input.data);
+	free(connection->output.data);
+	free(connection);
+}
+
+// Fecha o socket; a memória fica até a requisição em andamento voltar das threads
+static void close_connection(server_t* server, connection_t* connection) {
+	if(connection->closed) return;
+	epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+	close(connection->fd);
+	connection->closed = 1;
+	server->closed_count++;
+}
+
+// Envia o que der das respostas pendentes sem bloquear
+static void flush_output(server_t* server, connection_t* connection) {
+	while(!connection->closed && connection->output_sent < connection->output.size) {
+		ssize_t sent = send(connection->fd, connection->output.data + connection->output_sent, connection->output.size - connection->output_sent, MSG_NOSIGNAL);
+		if(sent < 0 && errno == EINTR) continue;
+		if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			watch_output(server, connection, 1);
+			return;
+		}
+		if(sent <= 0) {
+			close_connection(server, connection);
+			return;
+		}
+		connection->output_sent += sent;
+	}
+	connection->output.size = 0;
+	connection->output_sent = 0;
+	if(!connection->closed) watch_output(server, connection, 0);
+}
+
+// Entrega às threads a próxima requisição completa da conexão, se ela não tiver outra em andamento
+static void dispatch_request(server_t* server, connection_t* connection) {
+	if(connection->busy || connection->closed || connection->input.size < sizeof(uint32_t)) return;
+
+	uint32_t length;
+	memcpy(&length, connection->input.data, sizeof(length));
+	if(length < sizeof(server_request_t) - sizeof(length) || length > SERVER_MAX_FRAME) {
+		close_connection(server, connection);
+		return;
+	}
+	uint32_t size = sizeof(length) + length;
+	if(connection->input.size < size) return;
+
+	server_job_t* job = (server_job_t*) calloc(1, sizeof(server_job_t));
+	job->connection = connection;
+	job->size = size;
+	job->request = (uint8_t*) malloc(size);
+	memcpy(job->request, connection->input.data, size);
+	server_buffer_consume(&connection->input, size);
+	connection->busy = 1;
+
+	pthread_mutex_lock(&server->lock);
+	if(server->queue_tail) server->queue_tail->next = job;
+	else server->queue_head = job;
+	server->queue_tail = job;
+	pthread_cond_signal(&server->has_jobs);
+	pthread_mutex_unlock(&server->lock);
+}
+
+// Lê tudo o que chegou no socket
+static void read_input(server_t* server, connection_t* connection) {
+	while(!connection->closed) {
+		// Um cliente que manda requisições sem ler as respostas não acumula mais que dois quadros
+		if(connection->input.size > 2 * SERVER_MAX_FRAME) {
+			close_connection(server, connection);
+			return;
+		}
+		uint8_t* buffer = (uint8_t*) server_buffer_reserve(&connection->input, SERVER_READ_CHUNK);
+		connection->input.size -= SERVER_READ_CHUNK;
+		ssize_t received = recv(connection->fd, buffer, SERVER_READ_CHUNK, 0);
+		if(received < 0 && errno == EINTR) continue;
+		if(received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+		if(received <= 0) {
+			close_connection(server, connection);
+			return;
+		}
+		connection->input.size += received;
+	}
+	dispatch_request(server, connection);
+}
+
+static void accept_connections(server_t* server) {
+	while(1) {
+		int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if(fd < 0) {
+			if(errno == EINTR) continue;
+			if(errno != EAGAIN && errno != EWOULDBLOCK) perror("server: accept");
+			return;
+		}
+		connection_t* connection = (connection_t*) calloc(1, sizeof(connection_t));
+		connection->fd = fd;
+		connection->next = server->connections;
+		if(server->connections) server->connections->prev = connection;
+		server->connections = connection;
+
+		struct epoll_event event = { 0 };
+		event.events = EPOLLIN | EPOLLRDHUP;
+		event.data.ptr = connection;
+		epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+	}
+}
+
+// Coloca as respostas prontas na saída das conexões e passa a próxima requisição de cada uma para as threads
+static void collect_responses(server_t* server) {
+	uint64_t count;
+	if(read(server->event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) perror("server: eventfd");
+
+	pthread_mutex_lock(&server->lock);
+	server_job_t* job = server->done;
+	server->done = NULL;
+	pthread_mutex_unlock(&server->lock);
+
+	while(job) {
+		server_job_t* next = job->next;
+		connection_t* connection = job->connection;
+		connection->busy = 0;
+		if(!connection->closed) {
+			server_buffer_append(&connection->output, job->response.data, job->response.size);
+			flush_output(server, connection);
+			dispatch_request(server, connection);
+		}
+		free(job->response.data);
+		free(job);
+		job = next;
+	}
+}
+
+// Socket do servidor, apagando um socket que sobrou de uma execução anterior
+static int open_listen_socket(const char* socket_path) {
+	struct sockaddr_un address = { 0 };
+	address.sun_family = AF_UNIX;
+	if(strlen(socket_path) >= sizeof(address.sun_path)) {
+		printf("server: %s: Socket path too long\n", socket_path);
+		return -1;
+	}
+	strcpy(address.sun_path, socket_path);
+
+	struct stat st;
+	if(lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(socket_path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(fd < 0 || bind(fd, (struct sockaddr*) &address, sizeof(address)) < 0 || listen(fd, SOMAXCONN) < 0) {
+		printf("server: %s: %s\n", socket_path, strerror(errno));
+		if(fd >= 0) close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void watch_fd(server_t* server, int fd, void* marker) {
+	struct epoll_event event = { 0 };
+	event.events = EPOLLIN;
+	event.data.ptr = marker;
+	epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+// Atende requisições no socket até receber SIGINT ou SIGTERM
+// As operações rodam em worker_count threads (0 usa uma por processador); o laço de eventos só lê e escreve nos sockets
+// Retorna 0 se o servidor parou normalmente
+int server_run(const char* socket_path, uint32_t worker_count, server_handler_t handler, void* context) {
+	server_t server = { 0 };
+	server.handler = handler;
+	server.context = context;
+	server.listen_fd = open_listen_socket(socket_path);
+	if(server.listen_fd < 0) return 1;
+
+	// Os sinais de parada viram eventos; as threads criadas depois herdam a máscara e não recebem esses sinais
+	sigset_t signals, previous_signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, &previous_signals);
+	server.signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+	server.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	// Os ponteiros dos descritores do próprio servidor identificam os eventos deles
+	watch_fd(&server, server.listen_fd, &server.listen_fd);
+	watch_fd(&server, server.signal_fd, &server.signal_fd);
+	watch_fd(&server, server.event_fd, &server.event_fd);
+
+	pthread_mutex_init(&server.lock, NULL);
+	pthread_cond_init(&server.has_jobs, NULL);
+	if(worker_count == 0) worker_count = thread_pool_default_size();
+	pthread_t* workers = (pthread_t*) malloc(worker_count * sizeof(pthread_t));
+	for(uint32_t i = 0; i < worker_count; i++) pthread_create(&workers[i], NULL, server_worker, &server);
+
+	printf("server: Listening on %s with %u workers\n", socket_path, worker_count);
+	fflush(stdout);
+
+	int running = 1;
+	struct epoll_event events[SERVER_MAX_EVENTS];
+	while(running) {
+		int count = epoll_wait(server.epoll_fd, events, SERVER_MAX_EVENTS, -1);
+		if(count < 0) {
+			if(errno == EINTR) continue;
+			perror("server: epoll_wait");
+			break;
+		}
+		for(int i = 0; i < count; i++) {
+			void* marker = events[i].data.ptr;
+			if(marker == &server.listen_fd) accept_connections(&server);
+			else if(marker == &server.signal_fd) {
+				// O sinal é consumido aqui, senão ele seria entregue quando a máscara antiga voltasse
+				struct signalfd_siginfo info;
+				if(read(server.signal_fd, &info, sizeof(info)) == sizeof(info)) running = 0;
+			}
+			else if(marker == &server.event_fd) collect_responses(&server);
+			else {
+				connection_t* connection = (connection_t*) marker;
+				// Uma conexão fechada antes nesta volta ainda pode aparecer nos eventos já retornados
+				if(connection->closed) continue;
+				if(events[i].events & EPOLLOUT) flush_output(&server, connection);
+				if(events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) read_input(&server, connection);
+			}
+		}
+		// As conexões fechadas só são liberadas fora da volta, quando nenhuma requisição delas está com as threads
+		connection_t* connection = server.closed_count ? server.connections : NULL;
+		while(connection) {
+			connection_t* next = connection->next;
+			if(connection->closed && !connection->busy) free_connection(&server, connection);
+			connection = next;
+		}
+	}
+
+	// Para de aceitar conexões, deixa as threads terminarem a fila e libera tudo
+	close(server.listen_fd);
+	unlink(socket_path);
+	pthread_mutex_lock(&server.lock);
+	server.stopping = 1;
+	pthread_cond_broadcast(&server.has_jobs);
+	pthread_mutex_unlock(&server.lock);
+	for(uint32_t i = 0; i < worker_count; i++) pthread_join(workers[i], NULL);
+	free(workers);
+
+	collect_responses(&server);
+	while(server.connections) {
+		close_connection(&server, server.connections);
+		free_connection(&server, server.connections);
+	}
+	close(server.epoll_fd);
+	close(server.event_fd);
+	close(server.signal_fd);
+	pthread_mutex_destroy(&server.lock);
+	pthread_cond_destroy(&server.has_jobs);
+	pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+	printf("server: Stopped\n");
+	return 0;
+}
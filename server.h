@@ -0,0 +1,79 @@
+/**
+ *    Descrição: Servidor em um socket Unix (-S) com laço de eventos epoll e threads para as operações na imagem,
+ *               e o protocolo de quadros com tamanho usado pelo servidor e pelo fat_client
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Operações do protocolo
+#define SERVER_LIST 1
+#define SERVER_STAT 2
+#define SERVER_READ 3
+#define SERVER_WRITE 4
+#define SERVER_CREATE 5
+#define SERVER_DELETE 6
+
+// Flag do SERVER_CREATE: cria um diretório em vez de um arquivo
+#define SERVER_CREATE_DIRECTORY 0x1
+
+// Maior quantidade de dados de um SERVER_READ ou SERVER_WRITE e maior quadro aceito
+#define SERVER_MAX_DATA (8 * 1024 * 1024)
+#define SERVER_MAX_FRAME (SERVER_MAX_DATA + 64 * 1024)
+
+// Status de uma requisição mal formada (os outros negativos são os FAT32_E* de fat32.h)
+#define SERVER_EPROTO -100
+
+// Requisição: o cabeçalho é seguido por path_length bytes do caminho (sem '\0') e, no SERVER_WRITE, pelos size bytes
+// dos dados; length conta todos os bytes depois dele mesmo. Todos os campos na ordem de bytes da máquina
+typedef struct server_request {
+	uint32_t length;
+	uint8_t opcode;
+	uint8_t flags;
+	uint16_t path_length;
+	// Posição no arquivo do SERVER_READ e do SERVER_WRITE
+	uint64_t offset;
+	// Bytes pedidos no SERVER_READ e bytes de dados no SERVER_WRITE
+	uint32_t size;
+}__attribute__((packed)) server_request_t;
+
+// Resposta: status negativo é erro e os dados são a mensagem dele; senão os dados dependem da operação
+// (SERVER_LIST: status entradas server_entry_t; SERVER_STAT: uma; SERVER_READ: status bytes lidos;
+// SERVER_WRITE: status é a quantidade escrita; SERVER_CREATE e SERVER_DELETE: nada)
+typedef struct server_response {
+	uint32_t length;
+	int32_t status;
+}__attribute__((packed)) server_response_t;
+
+// Entrada de diretório na resposta, seguida por name_length bytes do nome (UTF-8, sem '\0')
+typedef struct server_entry {
+	uint32_t size;
+	uint32_t first_cluster;
+	uint16_t write_date;
+	uint16_t write_time;
+	uint8_t attributes;
+	uint16_t name_length;
+}__attribute__((packed)) server_entry_t;
+
+// Buffer que cresce conforme os dados são acrescentados
+typedef struct server_buffer {
+	uint8_t* data;
+	size_t size;
+	size_t capacity;
+} server_buffer_t;
+
+// Reserva size bytes no fim do buffer e retorna o começo deles
+void* server_buffer_reserve(server_buffer_t* buffer, size_t size);
+void server_buffer_append(server_buffer_t* buffer, const void* data, size_t size);
+
+// Trata uma requisição inteira (request aponta para o cabeçalho, com size bytes no total), chamada pelas threads do servidor
+// Acrescenta em payload os dados da resposta e retorna o status; o cabeçalho da resposta é montado pelo servidor
+typedef int32_t (*server_handler_t)(void* context, const uint8_t* request, uint32_t size, server_buffer_t* payload);
+
+int server_run(const char* socket_path, uint32_t worker_count, server_handler_t handler, void* context);
+
+#endif
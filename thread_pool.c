@@ -0,0 +1,112 @@
+/**
+ *    Descrição: Grupo de threads com roubo de tarefas que executa tarefas independentes numeradas de 0 a task_count - 1
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "thread_pool.h"
+
+struct pool_worker;
+
+// Estado compartilhado pelas threads
+typedef struct thread_pool {
+	thread_pool_task_t task;
+	void* context;
+	uint32_t worker_count;
+	struct pool_worker* workers;
+} thread_pool_t;
+
+// Cada thread tem a sua fila de tarefas: o intervalo [next, end) de números de tarefas
+// A dona tira do começo, as outras roubam do fim
+typedef struct pool_worker {
+	thread_pool_t* pool;
+	uint32_t number;
+	uint32_t next;
+	uint32_t end;
+	pthread_mutex_t lock;
+} pool_worker_t;
+
+// Tira a próxima tarefa da própria fila, retorna 0 se ela estiver vazia
+static int take_task(pool_worker_t* worker, uint32_t* index) {
+	pthread_mutex_lock(&worker->lock);
+	int found = worker->next < worker->end;
+	if(found) *index = worker->next++;
+	pthread_mutex_unlock(&worker->lock);
+	return found;
+}
+
+// Rouba a metade final da fila de outra thread: executa a primeira tarefa roubada e guarda o resto na própria fila
+// Retorna 0 se todas as filas estiverem vazias
+static int steal_task(pool_worker_t* thief, uint32_t* index) {
+	thread_pool_t* pool = thief->pool;
+	for(uint32_t i = 1; i < pool->worker_count; i++) {
+		pool_worker_t* victim = &pool->workers[(thief->number + i) % pool->worker_count];
+
+		pthread_mutex_lock(&victim->lock);
+		uint32_t remaining = victim->end - victim->next;
+		uint32_t start = victim->end - (remaining + 1) / 2;
+		uint32_t end = victim->end;
+		if(remaining) victim->end = start;
+		pthread_mutex_unlock(&victim->lock);
+		if(remaining == 0) continue;
+
+		pthread_mutex_lock(&thief->lock);
+		thief->next = start + 1;
+		thief->end = end;
+		pthread_mutex_unlock(&thief->lock);
+		*index = start;
+		return 1;
+	}
+	return 0;
+}
+
+// Executa as tarefas da própria fila e, quando ela acaba, as roubadas das outras
+static void* worker_thread(void* argument) {
+	pool_worker_t* worker = (pool_worker_t*) argument;
+	uint32_t index;
+	while(take_task(worker, &index) || steal_task(worker, &index))
+		worker->pool->task(worker->pool->context, index, worker->number);
+	return NULL;
+}
+
+// Quantidade de threads padrão: uma por processador disponível
+uint32_t thread_pool_default_size() {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (uint32_t) count : 1;
+}
+
+// Executa todas as tarefas com worker_count threads e só retorna quando todas terminarem
+// As tarefas começam divididas em blocos contíguos, um por thread, e quem termina antes rouba das outras
+// A thread que chama também trabalha (como a thread 0)
+void thread_pool_run(uint32_t worker_count, uint32_t task_count, thread_pool_task_t task, void* context) {
+	if(task_count == 0) return;
+	if(worker_count == 0) worker_count = 1;
+	if(worker_count > task_count) worker_count = task_count;
+
+	pool_worker_t* workers = (pool_worker_t*) malloc(worker_count * sizeof(pool_worker_t));
+	pthread_t* threads = (pthread_t*) malloc(worker_count * sizeof(pthread_t));
+	thread_pool_t pool = { task, context, worker_count, workers };
+
+	for(uint32_t i = 0; i < worker_count; i++) {
+		workers[i].pool = &pool;
+		workers[i].number = i;
+		workers[i].next = (uint64_t)task_count * i / worker_count;
+		workers[i].end = (uint64_t)task_count * (i + 1) / worker_count;
+		pthread_mutex_init(&workers[i].lock, NULL);
+	}
+	// Se não conseguir criar uma thread a fila dela é roubada pelas outras
+	int* started = (int*) calloc(worker_count, sizeof(int));
+	for(uint32_t i = 1; i < worker_count; i++)
+		started[i] = pthread_create(&threads[i], NULL, worker_thread, &workers[i]) == 0;
+
+	worker_thread(&workers[0]);
+	for(uint32_t i = 1; i < worker_count; i++)
+		if(started[i]) pthread_join(threads[i], NULL);
+
+	for(uint32_t i = 0; i < worker_count; i++) pthread_mutex_destroy(&workers[i].lock);
+	free(started);
+	free(threads);
+	free(workers);
+}
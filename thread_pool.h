@@ -0,0 +1,17 @@
+/**
+ *    Descrição: Grupo de threads com roubo de tarefas que executa tarefas independentes numeradas de 0 a task_count - 1
+ *    Autores: Getulio Coimbra Regis, Igor Lara de Oliveira
+ *    Creation Date: 15 / 10 / 2026
+ * */
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdint.h>
+
+// Executa a tarefa task de número index, worker é o número da thread (0 a worker_count - 1)
+typedef void (*thread_pool_task_t)(void* context, uint32_t index, uint32_t worker);
+
+uint32_t thread_pool_default_size();
+void thread_pool_run(uint32_t worker_count, uint32_t task_count, thread_pool_task_t task, void* context);
+
+#endif